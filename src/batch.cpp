@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include "batch.hpp"
+#include "profile.hpp"
+
+// 向きごとの1マスの移動量（Directionの順）
+constexpr std::array<uint32_t, 4> batch_dx {0, 0, 1, static_cast<uint32_t>(-1)};
+constexpr std::array<uint32_t, 4> batch_dy {static_cast<uint32_t>(-1), 1, 0, 0};
+
+// コマンドと向きから1マス目に進む向きを引く表（左折・右折は曲がった先、それ以外は今の向き）
+// 左折は北→西→南→東→北、右折はその逆で、calcNextPositonと同じ
+constexpr std::array<std::array<uint8_t, 4>, Command::GameEnd> heading_table {{
+  {Direction::West, Direction::East, Direction::North, Direction::South},   // TurnLeft
+  {Direction::East, Direction::West, Direction::South, Direction::North},   // TurnRight
+  {Direction::North, Direction::South, Direction::East, Direction::West},   // ContinueStraight
+  {Direction::North, Direction::South, Direction::East, Direction::West},   // Accelerate
+  {Direction::North, Direction::South, Direction::East, Direction::West},   // Decelerate
+  {Direction::North, Direction::South, Direction::East, Direction::West},   // Stop
+}};
+
+// コマンドを実行できた場合の速度を引く表（moveCarと同じ）
+constexpr std::array<std::array<uint8_t, max_speed + 1>, Command::GameEnd> makeSpeedTable(void) {
+  std::array<std::array<uint8_t, max_speed + 1>, Command::GameEnd> table {};
+  for (unsigned int speed = 0; speed <= max_speed; speed++) {
+    table[Command::TurnLeft][speed] = speed;
+    table[Command::TurnRight][speed] = speed;
+    table[Command::ContinueStraight][speed] = speed;
+    table[Command::Accelerate][speed] = (speed < max_speed) ? speed + 1 : speed;
+    table[Command::Decelerate][speed] = (speed > min_speed) ? speed - 1 : speed;
+    table[Command::Stop][speed] = 0;
+  }
+  return table;
+}
+constexpr auto speed_table = makeSpeedTable();
+
+// 作業領域のstatusのビット
+constexpr uint8_t status_enabled = 1;  // コマンドを実行できた
+constexpr uint8_t status_off = 2;      // 道路外に出た
+constexpr uint8_t status_quit = 4;     // ゲーム終了のコマンドだった
+
+// num_lanes個のレーンをすべて初期状態にする関数
+void initGameBatch(GameBatch& batch, size_t num_lanes, const LandmarkIndex& index) {
+  const GameState initial = initialGameState();
+  batch.num_lanes = num_lanes;
+  batch.x.assign(num_lanes, initial.pos.x);
+  batch.y.assign(num_lanes, initial.pos.y);
+  batch.direction.assign(num_lanes, initial.pos.direction);
+  batch.speed.assign(num_lanes, initial.speed);
+  batch.fuel.assign(num_lanes, initial.fuel);
+  batch.steps.assign(num_lanes, initial.steps);
+  batch.arrived_words = static_cast<unsigned int>(index.arrived.size());
+  batch.arrived.assign(num_lanes * batch.arrived_words, 0);
+  batch.arrived_count.assign(num_lanes, 0);
+  batch.heading.assign(num_lanes, 0);
+  batch.moves.assign(num_lanes, 0);
+  batch.status.assign(num_lanes, 0);
+}
+
+// レーンlaneをゲーム状態stateと到達済みフラグ（indexのもの）にする関数
+void setBatchLane(GameBatch& batch, size_t lane, const GameState& state, const LandmarkIndex& index) {
+  batch.x[lane] = state.pos.x;
+  batch.y[lane] = state.pos.y;
+  batch.direction[lane] = state.pos.direction;
+  batch.speed[lane] = state.speed;
+  batch.fuel[lane] = state.fuel;
+  batch.steps[lane] = state.steps;
+  std::copy(index.arrived.begin(), index.arrived.end(), batch.arrived.begin() + lane * batch.arrived_words);
+  batch.arrived_count[lane] = index.arrived_count;
+}
+
+// レーンlaneのゲーム状態を返す関数
+GameState batchLaneState(const GameBatch& batch, size_t lane) {
+  return GameState {Position {batch.x[lane], batch.y[lane], static_cast<Direction>(batch.direction[lane])},
+                    batch.speed[lane], batch.steps[lane], batch.fuel[lane]};
+}
+
+// 全レーンをそれぞれのコマンドで1手進め、レーンごとの結果をoutcomesに書く関数
+void stepGameBatch(GameBatch& batch, const LandmarkIndex& index, const Command* commands, StepOutcome* outcomes) {
+  PROFILE_SCOPE("batch.stepGameBatch");
+  const size_t lanes = batch.num_lanes;
+  uint32_t* const x = batch.x.data();
+  uint32_t* const y = batch.y.data();
+  uint8_t* const direction = batch.direction.data();
+  uint8_t* const speed = batch.speed.data();
+  uint8_t* const heading = batch.heading.data();
+  uint8_t* const moves = batch.moves.data();
+  uint8_t* const status = batch.status.data();
+
+  // 1. 実行できるかの判定と速度の更新
+  // 1マス目の向きの隣のマスが道路なら実行でき（停止はどこでも可能）、表から引いた速度にする
+  for (size_t i = 0; i < lanes; i++) {
+    const unsigned int command = commands[i];
+    if (command >= Command::GameEnd) {
+      if (command != Command::GameEnd) {
+        throw std::logic_error("stepGameBatch() was called with unexpected Command.");
+      }
+      moves[i] = 0;
+      status[i] = status_quit;
+      continue;
+    }
+    const uint8_t head = heading_table[command][direction[i]];
+    const bool is_stop = (command == Command::Stop);
+    const bool enabled = is_stop || is_road(x[i] + batch_dx[head], y[i] + batch_dy[head]);
+    const uint8_t next_speed = enabled ? speed_table[command][speed[i]] : speed[i];
+    heading[i] = head;
+    speed[i] = next_speed;
+    moves[i] = (enabled && !is_stop) ? next_speed : 0;
+    status[i] = enabled ? status_enabled : 0;
+  }
+
+  // 2. 移動
+  // 進む向きに道路が続くマス数を直線の長さの表から引き、速度分に足りなければその端で止まって道路外に出たとする（calcNextPositonと同じ）
+  // 1マス目は実行できるかの判定で道路と分かっているので、進むマス数は1以上になる
+  for (size_t i = 0; i < lanes; i++) {
+    if (moves[i] > 0) {
+      const uint32_t steps = std::min<uint32_t>(straightRun(x[i], y[i], static_cast<Direction>(heading[i])), moves[i]);
+      x[i] += batch_dx[heading[i]] * steps;
+      y[i] += batch_dy[heading[i]] * steps;
+      direction[i] = heading[i];
+      status[i] |= (steps < moves[i]) ? status_off : 0;
+    }
+  }
+
+  // 3. 燃料の消費と到達の判定
+  const uint32_t num_landmarks = static_cast<uint32_t>(index.landmarks.size());
+  for (size_t i = 0; i < lanes; i++) {
+    if (status[i] & status_quit) {
+      outcomes[i] = StepOutcome::Quit;
+      continue;
+    }
+    if (status[i] & status_off) {
+      outcomes[i] = StepOutcome::OffRoad;
+      continue;
+    }
+    batch.fuel[i] -= fuel_consumption[speed[i]];
+    if (batch.fuel[i] <= 0) {
+      outcomes[i] = StepOutcome::FuelOut;
+      continue;
+    }
+    batch.steps[i]++;
+    const int landmark = findLandmark(index, x[i], y[i]);
+    if (landmark >= 0) {
+      uint64_t& word = batch.arrived[i * batch.arrived_words + landmark / 64];
+      const uint64_t bit = uint64_t {1} << (landmark % 64);
+      if (!(word & bit)) {
+        word |= bit;
+        batch.arrived_count[i]++;
+      }
+    }
+    if (batch.arrived_count[i] == num_landmarks) {
+      outcomes[i] = StepOutcome::AllArrived;
+    } else {
+      outcomes[i] = (status[i] & status_enabled) ? StepOutcome::Continue : StepOutcome::CommandRejected;
+    }
+  }
+}
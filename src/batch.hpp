@@ -0,0 +1,44 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <cstdint>
+#include <vector>
+#include "map.hpp"
+#include "game.hpp"
+
+// 多数の独立したゲーム（レーン）をまとめて1手ずつ進めるための状態
+// 1手の処理は項目ごとに全レーンをなめるので、レーンごとの構造体ではなく項目ごとの配列に持つ
+// 到達済みフラグはレーンごとにarrived_words個のワードを続けて置く
+typedef struct {
+  size_t num_lanes;                      // レーン数
+  std::vector<uint32_t> x;               // X座標
+  std::vector<uint32_t> y;               // Y座標
+  std::vector<uint8_t> direction;        // 向き
+  std::vector<uint8_t> speed;            // 速度
+  std::vector<int32_t> fuel;             // 残り燃料
+  std::vector<uint32_t> steps;           // 手数
+  unsigned int arrived_words;            // レーン1つあたりの到達済みフラグのワード数
+  std::vector<uint64_t> arrived;         // 到達済みフラグ（レーン番号 * arrived_words + ワード番号）
+  std::vector<uint32_t> arrived_count;   // 到達済みランドマーク数
+  std::vector<uint8_t> heading;          // 作業領域：1マス目に進む向き
+  std::vector<uint8_t> moves;            // 作業領域：進むマス数（実行できないコマンドと停止は0）
+  std::vector<uint8_t> status;           // 作業領域：コマンドを実行できたか・道路外に出たか
+} GameBatch;
+
+// num_lanes個のレーンをすべて初期状態（initialGameState、全ランドマーク未到達）にする関数
+void initGameBatch(GameBatch& batch, size_t num_lanes, const LandmarkIndex& index);
+
+// レーンlaneをゲーム状態stateと到達済みフラグ（indexのもの）にする関数
+void setBatchLane(GameBatch& batch, size_t lane, const GameState& state, const LandmarkIndex& index);
+
+// レーンlaneのゲーム状態を返す関数
+GameState batchLaneState(const GameBatch& batch, size_t lane);
+
+// 全レーンをそれぞれのコマンドで1手進め、レーンごとの結果をoutcomesに書く関数
+// 結果・状態・到達済みフラグは、レーンごとにstepGameを呼んだ場合と完全に同じになる
+// 処理は全レーンで足並みをそろえ、実行できるかの判定と速度の更新、直線の長さの表を引いた移動、燃料と到達の判定の順に
+// 項目ごとの配列をなめる（道路や表の参照はレーンごとに別の場所を引くので、ベクトル化はされない）
+// 表示のみのコマンドと履歴のコマンドは渡さないこと（stepGameと同じ）。終わったレーンも進めるので、続ける場合は呼び出し側で戻すこと
+void stepGameBatch(GameBatch& batch, const LandmarkIndex& index, const Command* commands, StepOutcome* outcomes);
+
+#endif  // BATCH_HPP
@@ -0,0 +1,351 @@
+// 地図と移動の処理時間を計測するベンチマーク
+// 標準マップと、生成した碁盤の目の地図（100x50〜10000x10000、ランドマーク10〜10000個）、
+// mapgen.hppで生成した地図（同じ大きさ、ランドマーク最大1000個）で
+// 各関数の1回あたりの時間(ns)、メモリ確保回数、処理量を計測し、JSONで標準出力に書き出す
+//
+//   ./bench [--max-size <地図の一辺の上限>] [--min-time <1項目の最短計測秒数>]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "map.hpp"
+#include "game.hpp"
+#include "mapgen.hpp"
+#include "batch.hpp"
+
+// 生成する地図の道路の間隔（この間隔ごとの行・列と、最後の行・列を道路にする）
+constexpr unsigned int lattice_spacing = 5;
+// 移動・ランドマーク判定の計測に使う位置の数
+constexpr size_t num_positions = 4096;
+
+// 計算結果の書き込み先（最適化で呼び出しが消えないようにする）
+static volatile size_t bench_sink {0};
+
+// メモリ確保回数（operator newを置き換えて数える）
+static unsigned long long allocation_count {0};
+
+void* operator new(size_t size) {
+  allocation_count++;
+  void* ptr = std::malloc((size == 0) ? 1 : size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+void operator delete(void* ptr, size_t) noexcept {
+  std::free(ptr);
+}
+
+// 書き込まれた文字を捨てる出力先（displayMapの出力先にする）
+class NullBuffer : public std::streambuf {
+ protected:
+  int overflow(int c) override { return c; }
+  std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+// 1項目の計測結果
+typedef struct {
+  std::string map;         // 地図の名前
+  unsigned int size_x;     // 地図のX方向のマス数
+  unsigned int size_y;     // 地図のY方向のマス数
+  size_t landmarks;        // ランドマーク数
+  std::string name;        // 計測した関数
+  unsigned long long ops;  // 実行回数
+  double ns_per_op;        // 1回あたりの時間(ns)
+  double allocs_per_op;    // 1回あたりのメモリ確保回数
+  double items_per_sec;    // 1秒あたりの処理量
+  std::string item;        // 処理量の単位
+} BenchResult;
+
+// 計測中の地図の情報
+typedef struct {
+  std::string name;
+  LandmarkIndex index;
+  std::vector<Position> positions;  // 計測に使う道路上の位置（前が道路になる向き）
+} BenchMap;
+
+// 計測の設定
+typedef struct {
+  unsigned int max_size;  // 生成する地図の一辺の上限
+  double min_time;        // 1項目の最短計測秒数
+} BenchConfig;
+
+// fnを最短計測秒数以上、回数を倍にしながら繰り返し、1回あたりの時間とメモリ確保回数を求める関数
+// items_per_opは1回で処理する量（マス数など）
+static BenchResult measure(const BenchConfig& config, const BenchMap& map, const std::string& name,
+                           double items_per_op, const std::string& item, const std::function<void()>& fn) {
+  fn();  // 暖機
+  unsigned long long ops {1};
+  double seconds {0};
+  unsigned long long allocations {0};
+  while (true) {
+    unsigned long long start_allocations = allocation_count;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long long i = 0; i < ops; i++) {
+      fn();
+    }
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    allocations = allocation_count - start_allocations;
+    if (seconds >= config.min_time) {
+      break;
+    }
+    ops *= 2;
+  }
+  return BenchResult {map.name, road_map.size_x, road_map.size_y, map.index.landmarks.size(), name, ops,
+                      seconds * 1e9 / ops, static_cast<double>(allocations) / ops, items_per_op * ops / seconds, item};
+}
+
+// 碁盤の目の地図を道路ビットマップに作る関数
+static void generateLattice(unsigned int size_x, unsigned int size_y) {
+  initBitGrid(road_map, size_x, size_y);
+  // 道路の行は全マス、それ以外の行は道路の列のマスだけが道路
+  std::vector<uint64_t> full_row(road_map.words_per_row, 0);
+  std::vector<uint64_t> column_row(road_map.words_per_row, 0);
+  for (unsigned int x = 0; x < size_x; x++) {
+    full_row[x / 64] |= uint64_t {1} << (x % 64);
+    if ((x % lattice_spacing == 0) || (x == size_x - 1)) {
+      column_row[x / 64] |= uint64_t {1} << (x % 64);
+    }
+  }
+  for (unsigned int y = 0; y < size_y; y++) {
+    const std::vector<uint64_t>& row = ((y % lattice_spacing == 0) || (y == size_y - 1)) ? full_row : column_row;
+    for (unsigned int w = 0; w < road_map.words_per_row; w++) {
+      setGridWord(road_map, w, y, row[w]);
+    }
+  }
+  initial_position = Position {0, 0, Direction::East};
+  buildStraightRuns();
+}
+
+// 道路上のランダムなマスを返す関数（道路の行か列のどちらかの上から選ぶ）
+static Position randomRoadCell(std::mt19937& rng) {
+  Position pos {};
+  do {
+    pos.x = rng() % road_map.size_x;
+    pos.y = rng() % road_map.size_y;
+    if (rng() % 2 == 0) {
+      pos.y -= pos.y % lattice_spacing;
+    } else {
+      pos.x -= pos.x % lattice_spacing;
+    }
+  } while (!is_road(pos.x, pos.y));
+  return pos;
+}
+
+// 道路上のランダムなマスを返す関数（碁盤の目以外の地図用に、全マスから選ぶ）
+static Position randomAnyRoadCell(std::mt19937& rng) {
+  Position pos {};
+  do {
+    pos.x = rng() % road_map.size_x;
+    pos.y = rng() % road_map.size_y;
+  } while (!is_road(pos.x, pos.y));
+  return pos;
+}
+
+// 計測に使う位置を用意する関数（is_latticeがfalseの場合は碁盤の目を前提にせず選ぶ）
+static void preparePositions(BenchMap& map, std::mt19937& rng, bool is_lattice = true) {
+  map.positions.clear();
+  for (size_t i = 0; i < num_positions; i++) {
+    Position pos = is_lattice ? randomRoadCell(rng) : randomAnyRoadCell(rng);
+    pos.direction = static_cast<Direction>(rng() % 4);
+    while (!is_continue_straight_enable(pos)) {
+      pos.direction = rotateDirection(pos.direction, true);
+    }
+    map.positions.push_back(pos);
+  }
+}
+
+// 1つの地図で全項目を計測する関数
+static void benchMap(const BenchConfig& config, BenchMap& map, std::vector<BenchResult>& results) {
+  const double cells = static_cast<double>(road_map.size_x) * road_map.size_y;
+  const double landmarks = map.index.landmarks.size();
+  const double positions = map.positions.size();
+
+  results.push_back(measure(config, map, "validateMap", cells, "cells", [] { validateMap(); }));
+  results.push_back(measure(config, map, "validateLandmarks", landmarks, "landmarks", [&] { validateLandmarks(map.index); }));
+  results.push_back(measure(config, map, "validateReachability", cells, "cells", [&] { validateReachability(map.index); }));
+  results.push_back(measure(config, map, "buildStraightRuns", cells, "cells", [] { buildStraightRuns(); }));
+  results.push_back(measure(config, map, "fuelLowerBound", landmarks, "landmarks", [&] { bench_sink = fuelLowerBound(map.index); }));
+
+  NullBuffer null_buffer;
+  std::streambuf* original = std::cout.rdbuf(&null_buffer);
+  results.push_back(measure(config, map, "displayMap", cells, "cells", [&] { displayMap(map.index, map.positions[0]); }));
+  std::cout.rdbuf(original);
+
+  // 位置ごとの関数は、用意した位置を一巡する分を1回とする（時間とメモリ確保回数は位置1つあたりに直す）
+  size_t sink {0};
+  auto per_position = [&](const std::string& name, const std::function<void(const Position&)>& fn) {
+    BenchResult result = measure(config, map, name, positions, "positions", [&] {
+      for (const Position& pos : map.positions) {
+        fn(pos);
+      }
+    });
+    result.ops *= map.positions.size();
+    result.ns_per_op /= positions;
+    result.allocs_per_op /= positions;
+    results.push_back(result);
+  };
+  per_position("lookforNearLandmark", [&](const Position& pos) { sink += lookforNearLandmark(map.index, pos).size(); });
+  per_position("judgeArriveLandmarks", [&](const Position& pos) { sink += judgeArriveLandmarks(map.index, pos); });
+  per_position("calcNextPositon", [&](const Position& pos) {
+    Position next {pos};
+    sink += calcNextPositon(next, Command::ContinueStraight, 1) ? next.x : 0;
+  });
+  resetArrived(map.index);
+
+  // 1手の進め方は、全位置を1手ずつ進める分を1回とし、stepGameを位置ごとに呼ぶ場合とstepGameBatchでまとめて進める場合を比べる
+  // どちらも毎回、用意した位置・速度1・初期燃料から始め、位置ごとに決めたコマンドで進める
+  std::vector<Command> commands(map.positions.size());
+  for (size_t i = 0; i < commands.size(); i++) {
+    commands[i] = static_cast<Command>((i * 7 + i / 5) % Command::GameEnd);
+  }
+  std::vector<StepOutcome> outcomes(map.positions.size());
+  std::vector<StepOutcome> batch_outcomes(map.positions.size());
+  GameBatch batch {};
+  initGameBatch(batch, map.positions.size(), map.index);
+  auto step_scalar = [&] {
+    for (size_t i = 0; i < map.positions.size(); i++) {
+      GameState state {map.positions[i], 1, 0, fuel_init};
+      outcomes[i] = stepGame(state, map.index, commands[i]);
+      sink += state.pos.x;
+    }
+  };
+  auto step_batch = [&] {
+    for (size_t i = 0; i < map.positions.size(); i++) {
+      batch.x[i] = map.positions[i].x;
+      batch.y[i] = map.positions[i].y;
+      batch.direction[i] = map.positions[i].direction;
+    }
+    std::fill(batch.speed.begin(), batch.speed.end(), 1);
+    std::fill(batch.fuel.begin(), batch.fuel.end(), fuel_init);
+    stepGameBatch(batch, map.index, commands.data(), batch_outcomes.data());
+    sink += batch.x[0];
+  };
+  // 計測の前に、到達済みフラグを空にした状態から1手進めた結果が位置ごとに同じであることを確かめる
+  resetArrived(map.index);
+  step_batch();
+  for (size_t i = 0; i < map.positions.size(); i++) {
+    resetArrived(map.index);
+    GameState state {map.positions[i], 1, 0, fuel_init};
+    StepOutcome outcome = stepGame(state, map.index, commands[i]);
+    GameState lane = batchLaneState(batch, i);
+    if ((outcome != batch_outcomes[i]) || (lane.pos.x != state.pos.x) || (lane.pos.y != state.pos.y)
+     || (lane.pos.direction != state.pos.direction) || (lane.speed != state.speed) || (lane.fuel != state.fuel)) {
+      std::cerr << "Error: stepGameBatch differs from stepGame at position " << i << " on " << map.name << "." << std::endl;
+      std::exit(1);
+    }
+  }
+  resetArrived(map.index);
+  BenchResult scalar = measure(config, map, "stepGame", positions, "lanes", step_scalar);
+  BenchResult batched = measure(config, map, "stepGameBatch", positions, "lanes", step_batch);
+  for (BenchResult* result : {&scalar, &batched}) {
+    result->ops *= map.positions.size();
+    result->ns_per_op /= positions;
+    result->allocs_per_op /= positions;
+    results.push_back(*result);
+  }
+  resetArrived(map.index);
+  bench_sink = sink;
+}
+
+// 結果をJSONで書き出す関数
+static void printResults(const std::vector<BenchResult>& results) {
+  std::ostringstream out;
+  out << "{\"benchmarks\": [\n";
+  for (size_t i = 0; i < results.size(); i++) {
+    const BenchResult& r = results[i];
+    out << "  {\"map\": \"" << r.map << "\", \"size_x\": " << r.size_x << ", \"size_y\": " << r.size_y
+        << ", \"landmarks\": " << r.landmarks << ", \"name\": \"" << r.name << "\", \"ops\": " << r.ops
+        << ", \"ns_per_op\": " << r.ns_per_op << ", \"allocs_per_op\": " << r.allocs_per_op
+        << ", \"items_per_second\": " << r.items_per_sec << ", \"item\": \"" << r.item << "\"}"
+        << ((i + 1 < results.size()) ? ",\n" : "\n");
+  }
+  out << "]}\n";
+  std::cout << out.str();
+}
+
+int main(int argc, char* argv[]) {
+  BenchConfig config {10000, 0.2};
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string option(argv[i]);
+    if (option == "--max-size") {
+      config.max_size = std::stoul(argv[i + 1]);
+    } else if (option == "--min-time") {
+      config.min_time = std::stod(argv[i + 1]);
+    } else {
+      std::cerr << "Error: Unknown option \"" << option << "\"." << std::endl;
+      return 1;
+    }
+  }
+
+  std::vector<BenchResult> results;
+  std::mt19937 rng(1);
+
+  // 標準マップ
+  {
+    BenchMap map {"stock", {}, {}};
+    loadStockMap();
+    std::vector<LandMark> landmarks;
+    for (const StockLandmark& lm : stock_landmarks) {
+      landmarks.push_back(LandMark {lm.name, lm.x, lm.y});
+    }
+    buildLandmarkIndex(map.index, landmarks);
+    preparePositions(map, rng);
+    std::cerr << "Benchmarking stock map" << std::endl;
+    benchMap(config, map, results);
+  }
+
+  // 生成した地図（道路マスの半分を超えるランドマーク数の組み合わせは計測しない）
+  const std::vector<std::pair<unsigned int, unsigned int>> sizes {{100, 50}, {1000, 1000}, {10000, 10000}};
+  const std::vector<size_t> landmark_counts {10, 1000, 10000};
+  for (const auto& [size_x, size_y] : sizes) {
+    if (std::max(size_x, size_y) > config.max_size) {
+      continue;
+    }
+    generateLattice(size_x, size_y);
+    const size_t road_cells = static_cast<size_t>(size_x) * (size_y / lattice_spacing + 1) + static_cast<size_t>(size_y) * (size_x / lattice_spacing + 1);
+    for (size_t count : landmark_counts) {
+      if (count > road_cells / 2) {
+        continue;
+      }
+      BenchMap map {"lattice-" + std::to_string(size_x) + "x" + std::to_string(size_y) + "-" + std::to_string(count), {}, {}};
+      std::vector<LandMark> landmarks;
+      std::unordered_set<uint64_t> used;
+      while (landmarks.size() < count) {
+        Position pos = randomRoadCell(rng);
+        if (used.insert(cellKey(pos.x, pos.y)).second) {
+          landmarks.push_back(LandMark {"lm" + std::to_string(landmarks.size()), pos.x, pos.y});
+        }
+      }
+      buildLandmarkIndex(map.index, landmarks);
+      preparePositions(map, rng);
+      std::cerr << "Benchmarking " << map.name << std::endl;
+      benchMap(config, map, results);
+    }
+
+    // 同じ大きさの生成した地図（区間の抜けた碁盤の目）
+    BenchMap map {"generated-" + std::to_string(size_x) + "x" + std::to_string(size_y), {}, {}};
+    MapGenConfig gen {size_x, size_y, std::min<size_t>(1000, static_cast<size_t>(size_x) * size_y / 20), 1,
+                      default_min_gap, default_max_gap, default_removal_percent};
+    std::vector<LandMark> landmarks;
+    generateMap(gen, landmarks, 0);
+    buildLandmarkIndex(map.index, landmarks);
+    preparePositions(map, rng, false);
+    std::cerr << "Benchmarking " << map.name << std::endl;
+    benchMap(config, map, results);
+  }
+
+  printResults(results);
+  return 0;
+}
@@ -0,0 +1,272 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "cache.hpp"
+#include "game.hpp"
+#include "mapfile.hpp"
+#include "profile.hpp"
+
+// ファイルの先頭の印と書式番号
+constexpr char validation_magic[] = "MAPVALID";
+constexpr char fields_magic[] = "MAPFIELD";
+constexpr uint32_t fields_version = 1;
+constexpr char graph_magic[] = "MAPGRAPH";
+constexpr uint32_t graph_version = 1;
+// 距離場・道路グラフのファイルのヘッダの大きさ（バイト）
+constexpr size_t fields_header_size = 64;
+constexpr size_t graph_header_size = 64;
+
+// 道路グラフの配列は詰め物の無い32ビット値の並びとしてそのまま書く
+static_assert(sizeof(GraphNode) == 2 * sizeof(uint32_t), "GraphNode must be two 32-bit values.");
+static_assert(sizeof(GraphEdge) == 3 * sizeof(uint32_t), "GraphEdge must be three 32-bit values.");
+
+// キャッシュのファイルのパスを返す関数
+static std::string cachePath(const std::string& directory, uint64_t fingerprint, const std::string& extension) {
+  std::ostringstream path;
+  path << directory << "/" << std::hex << std::setw(16) << std::setfill('0') << fingerprint << extension;
+  return path.str();
+}
+
+// 数値をリトルエンディアンで書き込む・読み出す関数
+static void putValue(std::string& bytes, uint64_t value, unsigned int size) {
+  for (unsigned int k = 0; k < size; k++) {
+    bytes.push_back(static_cast<char>((value >> (k * 8)) & 0xff));
+  }
+}
+static uint64_t getValue(const char* bytes, unsigned int size) {
+  uint64_t value {0};
+  for (unsigned int k = 0; k < size; k++) {
+    value |= static_cast<uint64_t>(static_cast<unsigned char>(bytes[k])) << (k * 8);
+  }
+  return value;
+}
+
+// バイト列をキャッシュのファイルに書く関数（書き込めない場合はfalseを返す）
+// 同時に起動した他のプロセスに書きかけのファイルを読ませないよう、一時ファイルに書いてから名前を変える
+static bool writeCacheFile(const std::string& directory, const std::string& path, const char* data, size_t size) {
+  if ((mkdir(directory.c_str(), 0755) != 0) && (errno != EEXIST)) {
+    return false;
+  }
+  const std::string temporary = path + ".tmp" + std::to_string(getpid());
+  {
+    std::ofstream file(temporary, std::ios::binary);
+    if (!file.write(data, size)) {
+      std::remove(temporary.c_str());
+      return false;
+    }
+  }
+  if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+    std::remove(temporary.c_str());
+    return false;
+  }
+  return true;
+}
+
+// 検証に通ったことがキャッシュにあるかを返す関数
+bool is_validation_cached(const std::string& directory, uint64_t fingerprint) {
+  std::ifstream file(cachePath(directory, fingerprint, ".valid"), std::ios::binary);
+  char bytes[16] {};
+  if (!file.read(bytes, sizeof(bytes))) {
+    return false;
+  }
+  return (std::memcmp(bytes, validation_magic, 8) == 0) && (getValue(bytes + 8, 8) == fingerprint);
+}
+
+// 検証に通ったことをキャッシュに書く関数
+void storeValidation(const std::string& directory, uint64_t fingerprint) {
+  std::string bytes(validation_magic, 8);
+  putValue(bytes, fingerprint, 8);
+  writeCacheFile(directory, cachePath(directory, fingerprint, ".valid"), bytes.data(), bytes.size());
+}
+
+// 距離場の表をキャッシュから読み込む関数（番号付けは済ませておくこと。無い、または合わない場合はfalseを返す）
+static bool loadCachedFields(LandmarkFields& fields, const std::string& path, uint64_t fingerprint) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  std::shared_ptr<const MappedFile> file;
+  try {
+    file = std::make_shared<const MappedFile>(path, "cache file");
+  } catch (const std::runtime_error&) {
+    return false;
+  }
+  const char* header = file->data();
+  if ((file->size() != fields_header_size + fields.num_entries * 2 * sizeof(uint16_t))
+   || (std::memcmp(header, fields_magic, 8) != 0) || (getValue(header + 8, 4) != fields_version)
+   || (getValue(header + 16, 8) != fingerprint) || (getValue(header + 24, 8) != fields.num_road)
+   || (getValue(header + 32, 8) != fields.num_entries)) {
+    return false;
+  }
+  fields.fuel = reinterpret_cast<const uint16_t*>(header + fields_header_size);
+  fields.steps = fields.fuel + fields.num_entries;
+  fields.mapping = file;
+  fields.is_enabled = true;
+  return true;
+#else
+  // ビッグエンディアンでは表をそのまま指せないので、キャッシュを使わない
+  (void)fields;
+  (void)path;
+  (void)fingerprint;
+  return false;
+#endif
+}
+
+// 距離場の表をキャッシュに書く関数
+static void storeCachedFields(const LandmarkFields& fields, const std::string& directory, const std::string& path, uint64_t fingerprint) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  std::string bytes(fields_magic, 8);
+  putValue(bytes, fields_version, 4);
+  putValue(bytes, 0, 4);
+  putValue(bytes, fingerprint, 8);
+  putValue(bytes, fields.num_road, 8);
+  putValue(bytes, fields.num_entries, 8);
+  bytes.resize(fields_header_size, '\0');
+  // 表はfuel、stepsの順にownedへ並んでいるので、そのまま続けて書く
+  bytes.append(reinterpret_cast<const char*>(fields.owned->data()), fields.owned->size() * sizeof(uint16_t));
+  writeCacheFile(directory, path, bytes.data(), bytes.size());
+#else
+  (void)fields;
+  (void)directory;
+  (void)path;
+  (void)fingerprint;
+#endif
+}
+
+// 距離場をキャッシュから読み込み、無ければ作ってキャッシュに書く関数
+void prepareLandmarkFields(LandmarkFields& fields, const LandmarkIndex& index, const std::string& directory) {
+  PROFILE_SCOPE("cache.prepareLandmarkFields");
+  if (directory.empty()) {
+    buildLandmarkFields(fields, index);
+    return;
+  }
+  // 距離場を作らない大きさの地図では、キャッシュも使わない
+  if (!initFieldNumbering(fields, index)) {
+    return;
+  }
+  const uint64_t fingerprint = gameFingerprint(index);
+  const std::string path = cachePath(directory, fingerprint, ".fields");
+  if (loadCachedFields(fields, path, fingerprint)) {
+    return;
+  }
+  buildLandmarkFields(fields, index);
+  storeCachedFields(fields, directory, path, fingerprint);
+}
+
+// 配列をバイト列の末尾に書き足す・バイト列から写す関数
+template <typename T>
+static void appendArray(std::string& bytes, const std::vector<T>& values) {
+  bytes.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+template <typename T>
+static const char* copyArray(std::vector<T>& values, const char* bytes, size_t count) {
+  values.resize(count);
+  std::memcpy(values.data(), bytes, count * sizeof(T));
+  return bytes + count * sizeof(T);
+}
+
+// 道路グラフをキャッシュから読み込む関数（無い、または合わない場合はfalseを返す）
+static bool loadCachedGraph(RoadGraph& graph, const LandmarkIndex& index, const std::string& path, uint64_t fingerprint) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  std::unique_ptr<const MappedFile> file;
+  try {
+    file = std::make_unique<const MappedFile>(path, "cache file");
+  } catch (const std::runtime_error&) {
+    return false;
+  }
+  const char* header = file->data();
+  if ((file->size() < graph_header_size) || (std::memcmp(header, graph_magic, 8) != 0)
+   || (getValue(header + 8, 4) != graph_version) || (getValue(header + 16, 8) != fingerprint)
+   || (getValue(header + 56, 4) != index.landmarks.size())) {
+    return false;
+  }
+  const uint64_t num_nodes = getValue(header + 24, 8);
+  const uint64_t num_up_edges = getValue(header + 32, 8);
+  const uint64_t num_landmarks = index.landmarks.size();
+  // ノード数はノード番号（32ビット）に収まり、各配列の大きさの合計がファイルの大きさと一致すること
+  if ((num_nodes >= no_route) || (num_up_edges > (file->size() / sizeof(GraphEdge)))
+   || (file->size() != graph_header_size + num_nodes * sizeof(GraphNode) + (num_nodes + 1) * sizeof(uint32_t)
+                       + num_up_edges * sizeof(GraphEdge) + (num_landmarks * num_landmarks + num_landmarks) * sizeof(uint32_t))) {
+    return false;
+  }
+  const char* bytes = header + graph_header_size;
+  bytes = copyArray(graph.nodes, bytes, num_nodes);
+  bytes = copyArray(graph.up_begin, bytes, num_nodes + 1);
+  bytes = copyArray(graph.up_edges, bytes, num_up_edges);
+  bytes = copyArray(graph.landmark_distances, bytes, num_landmarks * num_landmarks);
+  copyArray(graph.start_distances, bytes, num_landmarks);
+  graph.num_edges = getValue(header + 40, 8);
+  graph.num_shortcuts = getValue(header + 48, 8);
+  graph.num_landmarks = num_landmarks;
+
+  // 壊れたファイルで問い合わせが範囲外を読まないよう、添字になる値を確かめる
+  bool is_valid = (graph.up_begin[0] == 0) && (graph.up_begin[num_nodes] == num_up_edges);
+  for (uint64_t node = 0; is_valid && (node < num_nodes); node++) {
+    is_valid = (graph.up_begin[node] <= graph.up_begin[node + 1])
+            && (graph.nodes[node].x < road_map.size_x) && (graph.nodes[node].y < road_map.size_y);
+  }
+  for (uint64_t e = 0; is_valid && (e < num_up_edges); e++) {
+    const GraphEdge& edge = graph.up_edges[e];
+    is_valid = (edge.to < num_nodes) && ((edge.middle < num_nodes) || (edge.middle == no_route));
+  }
+  if (!is_valid) {
+    graph = RoadGraph {};
+    return false;
+  }
+  indexGraphNodes(graph);
+  return true;
+#else
+  // ビッグエンディアンでは配列をそのまま写せないので、キャッシュを使わない
+  (void)graph;
+  (void)index;
+  (void)path;
+  (void)fingerprint;
+  return false;
+#endif
+}
+
+// 道路グラフをキャッシュに書く関数
+static void storeCachedGraph(const RoadGraph& graph, const std::string& directory, const std::string& path, uint64_t fingerprint) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  std::string bytes(graph_magic, 8);
+  putValue(bytes, graph_version, 4);
+  putValue(bytes, 0, 4);
+  putValue(bytes, fingerprint, 8);
+  putValue(bytes, graph.nodes.size(), 8);
+  putValue(bytes, graph.up_edges.size(), 8);
+  putValue(bytes, graph.num_edges, 8);
+  putValue(bytes, graph.num_shortcuts, 8);
+  putValue(bytes, graph.num_landmarks, 4);
+  bytes.resize(graph_header_size, '\0');
+  appendArray(bytes, graph.nodes);
+  appendArray(bytes, graph.up_begin);
+  appendArray(bytes, graph.up_edges);
+  appendArray(bytes, graph.landmark_distances);
+  appendArray(bytes, graph.start_distances);
+  writeCacheFile(directory, path, bytes.data(), bytes.size());
+#else
+  (void)graph;
+  (void)directory;
+  (void)path;
+  (void)fingerprint;
+#endif
+}
+
+// 道路グラフをキャッシュから読み込み、無ければ作ってキャッシュに書く関数
+void prepareRoadGraph(RoadGraph& graph, const LandmarkIndex& index, const std::string& directory) {
+  PROFILE_SCOPE("cache.prepareRoadGraph");
+  if (directory.empty()) {
+    buildRoadGraph(graph, index);
+    return;
+  }
+  const uint64_t fingerprint = gameFingerprint(index);
+  const std::string path = cachePath(directory, fingerprint, ".graph");
+  if (loadCachedGraph(graph, index, path, fingerprint)) {
+    return;
+  }
+  buildRoadGraph(graph, index);
+  storeCachedGraph(graph, directory, path, fingerprint);
+}
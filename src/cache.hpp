@@ -0,0 +1,52 @@
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include <cstdint>
+#include <string>
+#include "map.hpp"
+#include "field.hpp"
+#include "graph.hpp"
+
+// 事前計算のキャッシュ
+// 指定したディレクトリに、マップ・初期位置・ランドマーク・速度と燃料の設定の指紋（gameFingerprint）ごとに次のファイルを置く
+//   <指紋16桁>.valid   マップファイルの検証（ランドマーク・初期位置・到達可能性）に通ったことの印
+//   <指紋16桁>.fields  距離場（LandmarkFields）の表
+//   <指紋16桁>.graph   ヒント用の道路グラフ（RoadGraph）の索引と距離表
+// どれかが変わると指紋が変わって別のファイルになるので、古いキャッシュを使うことは無い
+// キャッシュは読み書きできなければ使わないだけで、エラーにはしない
+//
+// 距離場のファイルの書式（数値はすべてリトルエンディアン）
+//   0   "MAPFIELD"
+//   8   書式番号（32ビット）
+//   16  指紋（64ビット）
+//   24  道路マス数（64ビット）
+//   32  表1つの状態数（64ビット）
+//   64  最小の燃料の表（16ビット × 状態数）、続けて最小の手数の表（同じ大きさ）
+// 表はLandmarkFieldsと同じ並びなので、読み込む時はファイルをメモリマップして直接指し、コピーしない
+//
+// 道路グラフのファイルの書式（数値はすべてリトルエンディアン）
+//   0   "MAPGRAPH"
+//   8   書式番号（32ビット）
+//   16  指紋（64ビット）
+//   24  ノード数（64ビット）
+//   32  上向きの辺の数（64ビット）
+//   40  道路区間の辺の数（64ビット）
+//   48  ショートカットの数（64ビット）
+//   56  ランドマーク数（32ビット）
+//   64  nodes、up_begin、up_edges、landmark_distances、start_distancesの順に、RoadGraphの配列と同じ並びで続ける
+// マス→ノード番号の対応とノードのビットマップは、読み込む時にnodesから作り直す
+
+// 検証に通ったことがキャッシュにあるかを返す関数
+bool is_validation_cached(const std::string& directory, uint64_t fingerprint);
+// 検証に通ったことをキャッシュに書く関数
+void storeValidation(const std::string& directory, uint64_t fingerprint);
+
+// 距離場をキャッシュから読み込み、無ければ作ってキャッシュに書く関数（directoryが空の場合は作るだけ）
+// 読み込みは表をメモリマップするだけなので、地図の大きさによらずすぐに終わる
+void prepareLandmarkFields(LandmarkFields& fields, const LandmarkIndex& index, const std::string& directory);
+
+// 道路グラフをキャッシュから読み込み、無ければ作ってキャッシュに書く関数（directoryが空の場合は作るだけ）
+// 読み込みは配列をファイルから写すだけなので、索引を作り直すより桁違いに速い
+void prepareRoadGraph(RoadGraph& graph, const LandmarkIndex& index, const std::string& directory);
+
+#endif  // CACHE_HPP
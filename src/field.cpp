@@ -0,0 +1,161 @@
+#include <algorithm>
+#include <array>
+#include "field.hpp"
+#include "profile.hpp"
+
+// 距離場の探索の待ち行列に積む状態
+typedef struct {
+  unsigned int x;
+  unsigned int y;
+  Direction direction;
+  unsigned int speed;
+} FieldState;
+
+// 向きごとの1マスの移動量
+constexpr std::array<int, 4> direction_dx {0, 0, 1, -1};
+constexpr std::array<int, 4> direction_dy {-1, 1, 0, 0};
+
+// 状態stateに1手で来られる状態（前の状態）と、その手の重みを列挙する関数
+// 前の状態は、stateの向きに速度分のマスを逆にたどった位置にあり、その間がすべて道路である必要がある
+//   直進：同じ向き・同じ速度
+//   加速：同じ向き・速度が1小さい（最大速度のままの加速は直進と同じ）
+//   減速：同じ向き・速度が1大きい（最低速度のままの減速は直進と同じ）
+//   左折・右折：横向き・同じ速度（曲がった先のマスから、残りの速度分は直進する）
+//   停止：同じ位置・同じ向きで、速度0でない状態から速度0になる
+// 実行できないコマンドや速度0での移動は状態が変わらないので列挙しない
+template <typename Visit>
+static void forEachPredecessor(const FieldState& state, const std::array<int, max_speed + 1>& weights, Visit visit) {
+  if (state.speed == 0) {
+    for (unsigned int speed = 1; speed <= max_speed; speed++) {
+      visit(FieldState {state.x, state.y, state.direction, speed}, weights[0]);
+    }
+    return;
+  }
+
+  // 逆向き（北と南、東と西はDirectionの番号の最下位ビットだけが違う）に道路が速度分続くかを、直線の長さの表で1回で調べる
+  const Direction backward = static_cast<Direction>(state.direction ^ 1);
+  if (straightRun(state.x, state.y, backward) < state.speed) {
+    return;
+  }
+  const unsigned int x = state.x - direction_dx[state.direction] * static_cast<int>(state.speed);
+  const unsigned int y = state.y - direction_dy[state.direction] * static_cast<int>(state.speed);
+  const int weight = weights[state.speed];
+  visit(FieldState {x, y, state.direction, state.speed}, weight);
+  visit(FieldState {x, y, state.direction, state.speed - 1}, weight);
+  if ((state.speed + 1 <= max_speed) && (state.speed + 1 > min_speed)) {
+    visit(FieldState {x, y, state.direction, state.speed + 1}, weight);
+  }
+  visit(FieldState {x, y, rotateDirection(state.direction, true), state.speed}, weight);
+  visit(FieldState {x, y, rotateDirection(state.direction, false), state.speed}, weight);
+}
+
+// 1つのランドマークの距離場を、ランドマークのマスから手を逆向きにたどって求める関数
+// 手の重みは小さな整数なので、重みの最大値 + 1 個のバケツを巡回させる待ち行列で距離の小さい順に確定させる
+// fuel_init以上になる状態は使わないので、そこで探索を打ち切る
+static void searchField(const LandmarkFields& fields, unsigned int landmark, const LandMark& lm,
+                        const std::array<int, max_speed + 1>& weights, uint16_t* field) {
+  const int num_buckets = *std::max_element(weights.begin(), weights.end()) + 1;
+  std::vector<std::vector<FieldState>> buckets(num_buckets);
+  for (Direction direction : {Direction::North, Direction::South, Direction::East, Direction::West}) {
+    for (unsigned int speed = 0; speed <= max_speed; speed++) {
+      field[fieldEntry(fields, landmark, Position {lm.x, lm.y, direction}, speed)] = 0;
+      buckets[0].push_back(FieldState {lm.x, lm.y, direction, speed});
+    }
+  }
+
+  size_t pending = buckets[0].size();
+  for (int dist = 0; (dist < fuel_init) && (pending > 0); dist++) {
+    std::vector<FieldState>& bucket = buckets[dist % num_buckets];
+    // 処理中に同じバケツへ積まれることは無い（重みは1以上）
+    for (const FieldState& state : bucket) {
+      pending--;
+      if (field[fieldEntry(fields, landmark, Position {state.x, state.y, state.direction}, state.speed)] != dist) {
+        continue;  // より短い距離で確定済み
+      }
+      forEachPredecessor(state, weights, [&](const FieldState& prev, int weight) {
+        int next = dist + weight;
+        uint16_t& entry = field[fieldEntry(fields, landmark, Position {prev.x, prev.y, prev.direction}, prev.speed)];
+        if ((next < fuel_init) && (next < entry)) {
+          entry = next;
+          buckets[next % num_buckets].push_back(prev);
+          pending++;
+        }
+      });
+    }
+    bucket.clear();
+  }
+}
+
+// 道路マスの番号付け（num_roadとword_rank）と表の状態数だけを用意する関数
+bool initFieldNumbering(LandmarkFields& fields, const LandmarkIndex& index) {
+  fields = LandmarkFields {};
+  const unsigned int words = road_map.words_per_row;
+  fields.word_rank.resize(static_cast<size_t>(words) * road_map.size_y);
+  for (unsigned int y = 0; y < road_map.size_y; y++) {
+    for (unsigned int w = 0; w < words; w++) {
+      fields.word_rank[static_cast<size_t>(y) * words + w] = fields.num_road;
+      fields.num_road += __builtin_popcountll(gridWord(road_map, w, y));
+    }
+  }
+
+  fields.num_entries = index.landmarks.size() * fields.num_road * 4 * (max_speed + 1);
+  if (fields.num_entries * 2 * sizeof(uint16_t) > max_field_bytes) {
+    fields.word_rank.clear();
+    fields.word_rank.shrink_to_fit();
+    return false;
+  }
+  return true;
+}
+
+// 全ランドマークの距離場を作る関数
+void buildLandmarkFields(LandmarkFields& fields, const LandmarkIndex& index) {
+  PROFILE_SCOPE("field.buildLandmarkFields");
+  if (!initFieldNumbering(fields, index)) {
+    return;
+  }
+  fields.owned = std::make_shared<std::vector<uint16_t>>(fields.num_entries * 2, field_unreachable);
+  uint16_t* fuel = fields.owned->data();
+  uint16_t* steps = fuel + fields.num_entries;
+  std::array<int, max_speed + 1> unit_weights;
+  unit_weights.fill(1);
+  for (unsigned int i = 0; i < index.landmarks.size(); i++) {
+    searchField(fields, i, index.landmarks[i], fuel_consumption, fuel);
+    searchField(fields, i, index.landmarks[i], unit_weights, steps);
+  }
+  fields.fuel = fuel;
+  fields.steps = steps;
+  fields.is_enabled = true;
+}
+
+// 残りの燃料では着けなくなった未到達のランドマークの番号を返す関数
+// 着く手で燃料が0以下になると燃料切れなので、要る燃料が残りの燃料未満でなければ着けない
+int findUnreachableLandmark(const LandmarkFields& fields, const LandmarkIndex& index, const GameState& state) {
+  PROFILE_SCOPE("field.findUnreachableLandmark");
+  if (!fields.is_enabled) {
+    return -1;
+  }
+  for (unsigned int i = 0; i < index.landmarks.size(); i++) {
+    if (!is_arrived(index, i) && (fields.fuel[fieldEntry(fields, i, state.pos, state.speed)] >= state.fuel)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// 残りの燃料では全ランドマークを回り切れなくなった場合に表示する警告を返す関数
+std::string finishWarning(const LandmarkFields& fields, const LandmarkIndex& index, const GameState& state) {
+  int landmark = findUnreachableLandmark(fields, index, state);
+  if (landmark < 0) {
+    return "";
+  }
+  std::string str = "Warning: \"" + index.landmarks[landmark].name + "\" can no longer be reached with the remaining fuel";
+  size_t entry = fieldEntry(fields, landmark, state.pos, state.speed);
+  if (fields.fuel[entry] != field_unreachable) {
+    str += " (needs " + std::to_string(fields.fuel[entry]) + " fuel";
+    if (fields.steps[entry] != field_unreachable) {
+      str += ", at least " + std::to_string(fields.steps[entry]) + " steps";
+    }
+    str += ")";
+  }
+  return str + ".";
+}
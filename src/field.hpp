@@ -0,0 +1,59 @@
+#ifndef FIELD_HPP
+#define FIELD_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "map.hpp"
+#include "game.hpp"
+
+// 距離場に使うメモリの上限（超える地図では距離場を作らず、完走可否の判定も行わない）
+constexpr size_t max_field_bytes = size_t {256} << 20;
+// 距離場の値の上限（fuel_init以上かかる状態と、たどり着けない状態はこの値にする）
+constexpr uint16_t field_unreachable = UINT16_MAX;
+static_assert(fuel_init < field_unreachable, "fuel_init must fit in a 16-bit distance field entry.");
+
+// ランドマークごとの距離場構造体
+// 状態（道路マス, 向き, 速度）ごとに、そのランドマークに着くまでの最小の燃料と最小の手数を16ビットで持つ
+// 値はランドマークから手を逆向きにたどって求め、fuel_init以上かかるものはfield_unreachableにまとめる
+// 道路マスの番号は行優先の順で、ワードごとの前までの道路マス数（word_rank）と、ワード内のビット数から求める
+// 表は作った場合はownedに持ち、事前計算のキャッシュから読み込んだ場合はメモリマップしたファイルを直接指す
+typedef struct {
+  bool is_enabled;                               // 距離場を作ったか（メモリの上限を超える地図ではfalse）
+  size_t num_road;                               // 道路マス数
+  size_t num_entries;                            // 表1つの状態数（ランドマーク数 * 道路マス数 * 4 * (max_speed + 1)）
+  std::vector<uint32_t> word_rank;               // ワード（y * words_per_row + ワード番号）より前の道路マス数
+  const uint16_t* fuel;                          // 最小の燃料（((ランドマーク番号 * 道路マス数 + 道路マス番号) * 4 + 向き) * (max_speed + 1) + 速度）
+  const uint16_t* steps;                         // 最小の手数（並びはfuelと同じ）
+  std::shared_ptr<std::vector<uint16_t>> owned;  // 作った表（fuel、stepsの順に並べ、fuelとstepsが指す）
+  std::shared_ptr<const void> mapping;           // fuelとstepsが指すメモリマップしたファイル（保持用）
+} LandmarkFields;
+
+// 道路マスの番号を返す関数（道路マスであること）
+inline size_t roadNumber(const LandmarkFields& fields, unsigned int x, unsigned int y) {
+  const uint64_t below = (uint64_t {1} << (x % 64)) - 1;
+  return fields.word_rank[static_cast<size_t>(y) * road_map.words_per_row + x / 64] + __builtin_popcountll(gridWord(road_map, x / 64, y) & below);
+}
+
+// 距離場の中の状態の番号を返す関数
+inline size_t fieldEntry(const LandmarkFields& fields, unsigned int landmark, const Position& pos, unsigned int speed) {
+  return ((landmark * fields.num_road + roadNumber(fields, pos.x, pos.y)) * 4 + pos.direction) * (max_speed + 1) + speed;
+}
+
+// 道路マスの番号付け（num_roadとword_rank）と表の状態数だけを用意する関数（表は作らない）
+// 全体がmax_field_bytesを超える地図ではfalseを返し、word_rankは空にする
+bool initFieldNumbering(LandmarkFields& fields, const LandmarkIndex& index);
+
+// 全ランドマークの距離場を作る関数
+void buildLandmarkFields(LandmarkFields& fields, const LandmarkIndex& index);
+
+// 残りの燃料では着けなくなった未到達のランドマークの番号を返す関数（無い場合は-1）
+// 未到達のランドマークそれぞれについて、今の状態から着くのに要る最小の燃料を引くだけなので、ランドマーク数に比例する時間で済む
+// 1つずつ着けるかを見るだけなので、全部を回り切れないことを見逃す場合はあるが、着けないと判定したものは実際に着けない
+int findUnreachableLandmark(const LandmarkFields& fields, const LandmarkIndex& index, const GameState& state);
+
+// 残りの燃料では全ランドマークを回り切れなくなった場合に表示する警告を返す関数（回り切れる可能性がある場合は空文字列）
+std::string finishWarning(const LandmarkFields& fields, const LandmarkIndex& index, const GameState& state);
+
+#endif  // FIELD_HPP
@@ -0,0 +1,274 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "game.hpp"
+#include "profile.hpp"
+
+// 初期状態を返す関数
+GameState initialGameState(void) {
+  return GameState {initial_position, min_speed, 0, fuel_init};
+}
+
+// コマンドに応じて位置と速度を更新する関数
+MoveResult moveCar(Position& pos, unsigned int& speed, Command command) {
+  PROFILE_SCOPE("game.moveCar");
+  bool is_enable {false};
+  if (command == Command::TurnLeft) {
+    is_enable = is_turn_left_enable(pos);
+  } else if (command == Command::TurnRight) {
+    is_enable = is_turn_right_enable(pos);
+  } else if (command == Command::Stop) {
+    // 停止はどこでも可能で、移動しない
+    speed = 0;
+    return MoveResult::Moved;
+  } else {
+    // 直進・加速・減速は直進できる位置でのみ可能
+    is_enable = is_continue_straight_enable(pos);
+  }
+  if (!is_enable) {
+    return MoveResult::Rejected;
+  }
+
+  // 加速・減速は先にスピード設定値を変えてから直進する
+  if (command == Command::Accelerate) {
+    if (speed < max_speed) {
+      speed++;
+    }
+    command = Command::ContinueStraight;
+  } else if (command == Command::Decelerate) {
+    if (speed > min_speed) {
+      speed--;
+    }
+    command = Command::ContinueStraight;
+  }
+
+  if (!calcNextPositon(pos, command, speed)) {
+    return MoveResult::WentOff;
+  }
+  return MoveResult::Moved;
+}
+
+// コマンドを1手分適用してゲーム状態とランドマーク到達状況を更新する関数
+StepOutcome stepGame(GameState& state, LandmarkIndex& landmarks, Command command) {
+  PROFILE_SCOPE("game.stepGame");
+  if (command == Command::GameEnd) {
+    return StepOutcome::Quit;
+  }
+
+  // 実行できないコマンドでも手数と燃料は消費する
+  MoveResult move = moveCar(state.pos, state.speed, command);
+  if (move == MoveResult::WentOff) {
+    return StepOutcome::OffRoad;
+  }
+
+  // 燃料消費量の計算と反映
+  state.fuel -= fuel_consumption[state.speed];
+  if (state.fuel <= 0) {
+    return StepOutcome::FuelOut;
+  }
+
+  // step数をインクリメント
+  state.steps++;
+
+  // ランドマークに到達したかのチェック
+  if (judgeArriveLandmarks(landmarks, state.pos)) {
+    return StepOutcome::AllArrived;
+  }
+  return (move == MoveResult::Rejected) ? StepOutcome::CommandRejected : StepOutcome::Continue;
+}
+
+// 向きごとの1マスの移動量（Directionの順）
+constexpr std::array<int, 4> move_dx {0, 0, 1, -1};
+constexpr std::array<int, 4> move_dy {-1, 1, 0, 0};
+
+// コマンドに応じて次の自己位置を計算する関数
+// スピード出しすぎで道路外に出た場合はfalseを返す（その時のposは道路外に出る直前の位置）
+bool calcNextPositon(Position& pos, Command user_command, unsigned int speed) {
+  // 1マス目に進む向き（左折・右折は曲がった先、直進は今の向き）を決め、2マス目以降は同じ向きに直進する
+  Direction heading {pos.direction};
+  if (user_command == Command::TurnLeft) {
+    heading = rotateDirection(pos.direction, true);
+  } else if (user_command == Command::TurnRight) {
+    heading = rotateDirection(pos.direction, false);
+  } else if (user_command != Command::ContinueStraight) {
+    // 左折、右折、直進以外でここに来ることは無いので、来た場合はlogic_errorを返す。
+    throw std::logic_error("calcNextPositon() was called with unexpected Command.");
+  }
+  if (speed == 0) {
+    return true;
+  }
+
+  // 進む向きに道路が続くマス数を直線の長さの表から1回で引き、速度に足りなければ道路の端で止まって道路外に出たとする
+  // TurnLeft, Rightはすでに1マス目が道路であることを確認してからここに来るので、進むマス数は1以上になる
+  // 1マスずつ進めて確認する場合と同じ位置になるので、速度がいくつでも手間は変わらない
+  const unsigned int run = straightRun(pos.x, pos.y, heading);
+  const unsigned int moves = std::min(run, speed);
+  if (moves > 0) {
+    pos.x += move_dx[heading] * static_cast<int>(moves);
+    pos.y += move_dy[heading] * static_cast<int>(moves);
+    pos.direction = heading;
+  }
+  return moves == speed;
+}
+
+// 燃料の下限を求める関数
+// 最小全域木は頂点数の2乗のPrim法で求める（マンハッタン距離は座標から直接計算できるので距離表は作らない）
+int fuelLowerBound(const LandmarkIndex& index) {
+  PROFILE_SCOPE("game.fuelLowerBound");
+  std::vector<LandMark> points {LandMark {"", initial_position.x, initial_position.y}};
+  points.insert(points.end(), index.landmarks.begin(), index.landmarks.end());
+  std::vector<uint64_t> nearest(points.size(), UINT64_MAX);
+  std::vector<bool> in_tree(points.size(), false);
+  uint64_t total {0};
+  size_t next {0};
+  nearest[0] = 0;
+  for (size_t added = 0; added < points.size(); added++) {
+    size_t u = next;
+    in_tree[u] = true;
+    total += nearest[u];
+    uint64_t best {UINT64_MAX};
+    for (size_t v = 0; v < points.size(); v++) {
+      if (in_tree[v]) {
+        continue;
+      }
+      uint64_t dx = (points[u].x > points[v].x) ? points[u].x - points[v].x : points[v].x - points[u].x;
+      uint64_t dy = (points[u].y > points[v].y) ? points[u].y - points[v].y : points[v].y - points[u].y;
+      nearest[v] = std::min(nearest[v], dx + dy);
+      if (nearest[v] < best) {
+        best = nearest[v];
+        next = v;
+      }
+    }
+  }
+
+  // 速度 s では1手で s マス進み fuel_consumption[s] を消費するので、最も効率の良い速度で道のりを割った手数分の燃料が要る
+  uint64_t bound {UINT64_MAX};
+  for (unsigned int speed = std::max(min_speed, 1u); speed <= max_speed; speed++) {
+    bound = std::min(bound, (total * fuel_consumption[speed] + speed - 1) / speed);
+  }
+  return static_cast<int>(std::min<uint64_t>(bound, INT32_MAX));
+}
+
+// 燃料の下限を検証する関数
+// 最後の1手の後に燃料が残っていなければ燃料切れになるので、下限が初期の燃料以上ならクリアできない
+void validateFuel(const LandmarkIndex& index) {
+  int bound = fuelLowerBound(index);
+  if (bound >= fuel_init) {
+    throw std::runtime_error("Fuel is too small to reach all landmarks (fuel_init must be more than " + std::to_string(bound) + ").");
+  }
+}
+
+// 実行できないコマンドが入力された時のメッセージを返す関数
+std::string rejectedMessage(Command user_command) {
+  std::string str;
+
+  if (user_command == Command::TurnLeft) {
+    str = "Can't turn left here.";
+  } else if (user_command == Command::TurnRight) {
+    str = "Can't turn right here.";
+  } else if (user_command == Command::ContinueStraight) {
+    str = "Can't continue straight here.";
+  } else if (user_command == Command::Accelerate) {
+    str = "Can't accelerate here.";
+  } else {  // (user_command == Command::Decelerate)
+    str = "Can't decelerate here.";
+  }
+  return str;
+}
+
+// 入力文字列をCommandに変換する関数
+bool str2command(const std::string& str, Command& command) {
+  PROFILE_SCOPE("game.str2command");
+  bool ret {true};
+
+  if ((str == "turn left") || (str == "l")) {
+    command = Command::TurnLeft;
+  } else if ((str == "turn right") || (str == "r")) {
+    command = Command::TurnRight;
+  } else if ((str == "continue straight") || (str == "c")) {
+    command = Command::ContinueStraight;
+  } else if ((str == "accelerate") || (str == "a")) {
+    command = Command::Accelerate;
+  } else if ((str == "decelerate") || (str == "d")) {
+    command = Command::Decelerate;
+  } else if ((str == "stop") || (str == "s")) {
+    command = Command::Stop;
+  } else if (str == "game end") {
+    command = Command::GameEnd;
+  } else if ((str == "overview") || (str == "o")) {
+    command = Command::ToggleOverview;
+  } else if ((str == "hint") || (str == "h")) {
+    command = Command::Hint;
+  } else if ((str == "undo") || (str == "u")) {
+    command = Command::Undo;
+  } else if ((str == "redo") || (str == "y")) {
+    command = Command::Redo;
+  } else {
+    ret = false;
+  }
+  return ret;
+}
+
+// Commandの表示補助関数（短縮コマンドを返す）
+std::string command2str(Command command) {
+  std::string str;
+
+  if (command == Command::TurnLeft) {
+    str = "l";
+  } else if (command == Command::TurnRight) {
+    str = "r";
+  } else if (command == Command::ContinueStraight) {
+    str = "c";
+  } else if (command == Command::Accelerate) {
+    str = "a";
+  } else if (command == Command::Decelerate) {
+    str = "d";
+  } else if (command == Command::Stop) {
+    str = "s";
+  } else if (command == Command::ToggleOverview) {
+    str = "o";
+  } else if (command == Command::Hint) {
+    str = "h";
+  } else if (command == Command::Undo) {
+    str = "u";
+  } else if (command == Command::Redo) {
+    str = "y";
+  } else {  // (command == Command::GameEnd)
+    str = "game end";
+  }
+  return str;
+}
+
+// マップ・ランドマーク・ゲーム設定の指紋（FNV-1a）を返す関数
+uint64_t gameFingerprint(const LandmarkIndex& index) {
+  uint64_t hash {14695981039346656037ull};
+  auto mix = [&](uint64_t value) {
+    for (unsigned int k = 0; k < 8; k++) {
+      hash = (hash ^ ((value >> (k * 8)) & 0xff)) * 1099511628211ull;
+    }
+  };
+  mix(road_map.size_x);
+  mix(road_map.size_y);
+  for (unsigned int y = 0; y < road_map.size_y; y++) {
+    for (unsigned int w = 0; w < road_map.words_per_row; w++) {
+      mix(gridWord(road_map, w, y));
+    }
+  }
+  mix(initial_position.x);
+  mix(initial_position.y);
+  mix(static_cast<uint64_t>(initial_position.direction));
+  for (const LandMark& lm : index.landmarks) {
+    mix(lm.x);
+    mix(lm.y);
+  }
+  mix(max_speed);
+  mix(min_speed);
+  mix(static_cast<uint64_t>(fuel_init));
+  for (int fuel : fuel_consumption) {
+    mix(static_cast<uint64_t>(fuel));
+  }
+  return hash;
+}
@@ -0,0 +1,116 @@
+#ifndef GAME_HPP
+#define GAME_HPP
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include "map.hpp"
+
+// 設定値定義
+constexpr unsigned int max_speed = 3;
+constexpr unsigned int min_speed = 1;
+constexpr int fuel_init = 1000;
+constexpr std::array<int, (max_speed + 1)> fuel_consumption {1, 1, 3, 9};
+
+// 設定値の検証（不正な設定はコンパイルエラーにする）
+constexpr bool is_fuel_consumption_positive(void) {
+  for (int fuel : fuel_consumption) {
+    if (fuel <= 0) {
+      return false;
+    }
+  }
+  return true;
+}
+static_assert(min_speed <= max_speed, "min_speed must not exceed max_speed.");
+static_assert(max_speed <= max_straight_run, "max_speed must not exceed max_straight_run (the straight run table saturates there).");
+static_assert(fuel_init > 0, "fuel_init must be positive.");
+static_assert(is_fuel_consumption_positive(), "fuel_consumption must be positive for every speed.");
+
+// コマンドのEnum定義
+typedef enum {
+  TurnLeft,          // 左折
+  TurnRight,         // 右折
+  ContinueStraight,  // 直進
+  Accelerate,        // 加速
+  Decelerate,        // 減速
+  Stop,              // 停止
+  GameEnd,           // ゲーム終了
+  ToggleOverview,    // 縮小図の表示切替（表示のみのコマンドで、ゲームは進めない）
+  Hint,              // 次に向かうランドマークと経路の提示（表示のみのコマンド）
+  Undo,              // 直前の手を取り消す（履歴のコマンドで、stepGameには渡さない）
+  Redo,              // 取り消した手をやり直す（履歴のコマンド）
+} Command;
+
+// 表示のみのコマンド（手数・燃料を消費せず、ゲームを進めない）か否かを返す関数
+inline bool is_display_command(Command command) {
+  return (command == Command::ToggleOverview) || (command == Command::Hint);
+}
+
+// 履歴のコマンド（手の取り消し・やり直し）か否かを返す関数
+inline bool is_history_command(Command command) {
+  return (command == Command::Undo) || (command == Command::Redo);
+}
+
+// ゲーム状態
+typedef struct {
+  Position pos;        // 自己位置
+  unsigned int speed;  // 速度
+  unsigned int steps;  // 手数
+  int fuel;            // 残り燃料
+} GameState;
+
+// 移動処理の結果
+typedef enum {
+  Moved,     // 移動した（停止を含む）
+  Rejected,  // その位置では実行できないコマンド
+  WentOff,   // スピード出しすぎで道路外に出た
+} MoveResult;
+
+// 1手進めた結果
+typedef enum {
+  Continue,          // ゲーム継続
+  CommandRejected,   // 実行できないコマンドだった（手数と燃料は消費してゲーム継続）
+  AllArrived,        // 全ランドマークに到達した（目標達成）
+  OffRoad,           // 道路外に出た（ゲームオーバー）
+  FuelOut,           // 燃料を使い切った（ゲームオーバー）
+  Quit,              // ユーザによる終了
+} StepOutcome;
+
+// 初期状態を返す関数
+GameState initialGameState(void);
+
+// コマンドに応じて位置と速度を更新する関数（燃料・手数・ランドマークは扱わない）
+MoveResult moveCar(Position& pos, unsigned int& speed, Command command);
+
+// コマンドを1手分適用してゲーム状態とランドマーク到達状況を更新する関数
+// 入出力や例外を伴わないので、スクリプト実行や探索から高速に呼び出せる
+// 表示のみのコマンド（is_display_command）と履歴のコマンド（is_history_command）は呼び出し側で処理し、ここには渡さないこと
+StepOutcome stepGame(GameState& state, LandmarkIndex& landmarks, Command command);
+
+// コマンドに応じて自己位置を速度分進める関数
+// スピード出しすぎで道路外に出た場合はfalseを返す（posは道路外に出る直前の道路マスになる）
+// 直線の長さの表（straight_runs）を1回引くだけで判定するので、速度によらず定数時間で済む
+bool calcNextPositon(Position& pos, Command user_command, unsigned int speed);
+
+// 初期位置から全ランドマークを回るのに必要な燃料の下限を返す関数
+// 回る道のり（マス数）は、初期位置とランドマークを頂点としマンハッタン距離を重みとする最小全域木の重み以上であり、
+// 1マスあたりの燃料消費が最も少ない速度で進んでもその分の燃料が要ることから求める
+int fuelLowerBound(const LandmarkIndex& index);
+// 燃料の下限が初期の燃料に収まるかを検証する関数（収まらない場合はruntime_errorをthrowする）
+void validateFuel(const LandmarkIndex& index);
+
+// マップ・初期位置・ランドマーク・速度と燃料の設定の指紋（FNV-1a）を返す関数
+// どれかが変わるとゲームの結果や事前計算が変わるので、リプレイ記録の照合と事前計算のキャッシュの見分けに使う
+uint64_t gameFingerprint(const LandmarkIndex& index);
+
+// 実行できないコマンド（左折・右折・直進・加速・減速）が入力された時のメッセージを返す関数
+std::string rejectedMessage(Command user_command);
+
+// 入力文字列をCommandに変換する関数
+// 基本コマンド・短縮コマンド以外の文字列の場合はfalseを返す
+bool str2command(const std::string& str, Command& command);
+
+// Commandの表示補助関数（短縮コマンドを返す）
+std::string command2str(Command command);
+
+#endif  // GAME_HPP
@@ -0,0 +1,720 @@
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <queue>
+#include <tuple>
+#include "graph.hpp"
+
+// 縮約時の迂回路探索（ショートカットが不要かの確認）で確定させるノード数の上限
+// 上限で打ち切った場合は迂回路が無いものとしてショートカットを加える（距離は正しいまま、索引が少し大きくなる）
+constexpr unsigned int witness_settle_limit = 200;
+// 縮約していないノードがこの割合まで減るたびに、残りのノードの番号を詰め直す
+// 終盤に残る重要なノードは辺が多く探索も重いので、作業領域を小さくまとめてキャッシュに載るようにする
+constexpr unsigned int compact_ratio = 2;
+
+// 道路区間の上でのマスの位置
+typedef struct {
+  bool is_road;        // 道路上か
+  bool is_horizontal;  // 横方向の区間か（ノード上の場合は未使用）
+  uint32_t node_a;     // 区間の西端または北端のノード（ノード上の場合はそのノード）
+  uint32_t dist_a;     // node_aまでの距離
+  uint32_t node_b;     // 区間の東端または南端のノード（ノード上の場合はそのノード）
+  uint32_t dist_b;     // node_bまでの距離
+} CellLocation;
+
+// 縮約中の迂回路探索の作業領域
+typedef struct {
+  std::vector<uint32_t> dist;      // ノードごとの距離
+  std::vector<uint32_t> bound;     // 組の相手のノードごとの、縮約するノードを通る距離（相手でなければno_route）
+  std::vector<uint32_t> hop_dist;  // 2辺以内の迂回路の確認用の、組の片側から1辺で行けるノードまでの距離
+  std::vector<uint32_t> targets;   // 迂回路を探す組の相手のノード
+  std::vector<uint32_t> touched;   // distに距離を書いたノード
+  std::vector<uint64_t> heap;      // 優先度付きキュー（距離 << 32 | ノード番号）
+} WitnessSearch;
+
+// 指定した向きに1マス進める関数
+static void stepCell(unsigned int& x, unsigned int& y, Direction direction) {
+  if (direction == Direction::North) {
+    y--;
+  } else if (direction == Direction::South) {
+    y++;
+  } else if (direction == Direction::East) {
+    x++;
+  } else {  // (direction == Direction::West)
+    x--;
+  }
+}
+
+// 優先度付きキュー（最小ヒープ）の操作
+static void pushHeap(std::vector<uint64_t>& heap, uint32_t dist, uint32_t node) {
+  heap.push_back((static_cast<uint64_t>(dist) << 32) | node);
+  std::push_heap(heap.begin(), heap.end(), std::greater<uint64_t>());
+}
+
+static uint64_t popHeap(std::vector<uint64_t>& heap) {
+  std::pop_heap(heap.begin(), heap.end(), std::greater<uint64_t>());
+  uint64_t top = heap.back();
+  heap.pop_back();
+  return top;
+}
+
+// ノードにするマスのビットマップを作る関数
+// まっすぐな区間の途中（東西だけ、または南北だけが道路）以外の道路マスを、袋小路の検証と同じ要領で64マスずつ判定する
+static void markNodeCells(BitGrid& node_cells, const LandmarkIndex& index) {
+  initBitGrid(node_cells, road_map.size_x, road_map.size_y);
+  const unsigned int words = road_map.words_per_row;
+  for (unsigned int y = 0; y < road_map.size_y; y++) {
+    for (unsigned int w = 0; w < words; w++) {
+      uint64_t road = gridWord(road_map, w, y);
+      if (road == 0) {
+        continue;
+      }
+      uint64_t prev = (w > 0) ? gridWord(road_map, w - 1, y) : 0;
+      uint64_t next = (w + 1 < words) ? gridWord(road_map, w + 1, y) : 0;
+      uint64_t west = (road << 1) | (prev >> 63);
+      uint64_t east = (road >> 1) | (next << 63);
+      uint64_t north = (y > 0) ? gridWord(road_map, w, y - 1) : 0;
+      uint64_t south = (y + 1 < road_map.size_y) ? gridWord(road_map, w, y + 1) : 0;
+      uint64_t straight = (west & east & ~north & ~south) | (north & south & ~west & ~east);
+      setGridWord(node_cells, w, y, road & ~straight);
+    }
+  }
+
+  // ランドマークと初期位置は、区間の途中でもノードにする
+  for (const LandMark& lm : index.landmarks) {
+    setGridBit(node_cells, lm.x, lm.y, true);
+  }
+  setGridBit(node_cells, initial_position.x, initial_position.y, true);
+}
+
+// ノードでないマスから、指定した向きに区間の端のノードまでたどる関数
+static void walkToNode(const RoadGraph& graph, unsigned int x, unsigned int y, Direction direction, uint32_t& node, uint32_t& dist) {
+  dist = 0;
+  do {
+    stepCell(x, y, direction);
+    dist++;
+  } while (!gridBit(graph.node_cells, x, y));
+  node = graph.node_index.find(cellKey(x, y))->second;
+}
+
+// マスが道路グラフのどこにあるかを求める関数
+static CellLocation locateCell(const RoadGraph& graph, const GraphNode& cell) {
+  CellLocation location {};
+  if (!is_road(cell.x, cell.y)) {
+    return location;
+  }
+  location.is_road = true;
+  if (gridBit(graph.node_cells, cell.x, cell.y)) {
+    location.node_a = graph.node_index.find(cellKey(cell.x, cell.y))->second;
+    location.node_b = location.node_a;
+    return location;
+  }
+
+  // ノードでない道路マスはまっすぐな区間の途中なので、両側の端のノードまでたどる
+  location.is_horizontal = is_road(cell.x - 1, cell.y);
+  walkToNode(graph, cell.x, cell.y, location.is_horizontal ? Direction::West : Direction::North, location.node_a, location.dist_a);
+  walkToNode(graph, cell.x, cell.y, location.is_horizontal ? Direction::East : Direction::South, location.node_b, location.dist_b);
+  return location;
+}
+
+// 同じ区間の途中にある2つのマスの間の距離を返す関数（同じ区間でなければno_route）
+static uint32_t directDistance(const CellLocation& from, const CellLocation& to) {
+  if ((from.node_a == from.node_b) || (to.node_a == to.node_b) || (from.is_horizontal != to.is_horizontal)
+   || (from.node_a != to.node_a) || (from.node_b != to.node_b)) {
+    return no_route;
+  }
+  return (from.dist_a > to.dist_a) ? from.dist_a - to.dist_a : to.dist_a - from.dist_a;
+}
+
+// 隣接リストに辺を加える関数（同じノードへの辺が既にあれば短い方を残す）
+// 同じノードへの辺は1本だけなので、走査は次数の分で済む
+static void addEdge(std::vector<GraphEdge>& edges, uint32_t to, uint32_t weight, uint32_t middle) {
+  for (GraphEdge& edge : edges) {
+    if (edge.to == to) {
+      if (weight < edge.weight) {
+        edge.weight = weight;
+        edge.middle = middle;
+      }
+      return;
+    }
+  }
+  edges.push_back(GraphEdge {to, weight, middle});
+}
+
+// 隣接リストからtoへの辺を取り除く関数（最後の辺を空いた位置へ移すので、辺の順番は保たない）
+static void removeEdge(std::vector<GraphEdge>& edges, uint32_t to) {
+  for (GraphEdge& edge : edges) {
+    if (edge.to == to) {
+      edge = edges.back();
+      edges.pop_back();
+      return;
+    }
+  }
+}
+
+// 縮約していないノードだけを通り、viaを通らずにsourceから組の相手（targets）への迂回路を探す関数
+// 相手への距離がboundまでに収まれば迂回路が見つかったものとし、すべての相手で見つかるか、
+// 残りの相手のboundをすべて超えるか、witness_settle_limit個のノードを確定させたら打ち切る
+static void searchWitness(const std::vector<std::vector<GraphEdge>>& adjacency, uint32_t source, uint32_t via, WitnessSearch& search) {
+  for (uint32_t node : search.touched) {
+    search.dist[node] = no_route;
+  }
+  search.touched.clear();
+  search.heap.clear();
+
+  // 迂回路がまだ見つかっていない相手の数と、その中で最も遠いbound
+  size_t open_targets = search.targets.size();
+  uint32_t max_dist {0};
+  for (uint32_t target : search.targets) {
+    max_dist = std::max(max_dist, search.bound[target]);
+  }
+
+  search.dist[source] = 0;
+  search.touched.push_back(source);
+  pushHeap(search.heap, 0, source);
+  unsigned int settled {0};
+  while (!search.heap.empty() && (settled < witness_settle_limit)) {
+    uint64_t top = popHeap(search.heap);
+    uint32_t dist = top >> 32;
+    uint32_t node = top & 0xffffffff;
+    if (dist > search.dist[node]) {
+      continue;
+    }
+    if (dist > max_dist) {
+      break;
+    }
+    settled++;
+    for (const GraphEdge& edge : adjacency[node]) {
+      if (edge.to == via) {
+        continue;
+      }
+      uint32_t next = dist + edge.weight;
+      if ((next > max_dist) || (next >= search.dist[edge.to])) {
+        continue;
+      }
+      const bool is_open = (search.dist[edge.to] > search.bound[edge.to]);
+      if (search.dist[edge.to] == no_route) {
+        search.touched.push_back(edge.to);
+      }
+      search.dist[edge.to] = next;
+      pushHeap(search.heap, next, edge.to);
+      // 相手への迂回路が見つかったら、残りの相手だけで打ち切りの距離を決め直す
+      if (is_open && (next <= search.bound[edge.to])) {
+        if (--open_targets == 0) {
+          return;
+        }
+        max_dist = 0;
+        for (uint32_t target : search.targets) {
+          if (search.dist[target] > search.bound[target]) {
+            max_dist = std::max(max_dist, search.bound[target]);
+          }
+        }
+      }
+    }
+  }
+}
+
+// ノードを縮約する時に必要なショートカット（両端, 距離）を求める関数
+// 隣接ノードの組ごとに、縮約するノードを通らない同じ距離以下の迂回路が無ければショートカットが必要
+// まず2辺以内の迂回路を調べ、見つからなかった組だけを探索する（is_exactがfalseの場合は探索せず、ショートカットが要るものとして数える）
+static void findShortcuts(const std::vector<std::vector<GraphEdge>>& adjacency, uint32_t node, bool is_exact, WitnessSearch& search,
+                          std::vector<std::tuple<uint32_t, uint32_t, uint32_t>>& shortcuts) {
+  shortcuts.clear();
+  const std::vector<GraphEdge>& edges = adjacency[node];
+  for (size_t i = 0; i + 1 < edges.size(); i++) {
+    const uint32_t source = edges[i].to;
+    for (const GraphEdge& edge : adjacency[source]) {
+      search.hop_dist[edge.to] = edge.weight;
+    }
+    search.targets.clear();
+    for (size_t j = i + 1; j < edges.size(); j++) {
+      const uint32_t target = edges[j].to;
+      const uint32_t via_node = edges[i].weight + edges[j].weight;
+      // sourceから1辺、またはsourceの隣から1辺でtargetに届くか（縮約するノード自身を経由する道は距離が足りない）
+      bool has_witness = (search.hop_dist[target] <= via_node);
+      for (size_t k = 0; !has_witness && (k < adjacency[target].size()); k++) {
+        const GraphEdge& edge = adjacency[target][k];
+        has_witness = (edge.to != node) && (search.hop_dist[edge.to] != no_route) && (search.hop_dist[edge.to] + edge.weight <= via_node);
+      }
+      if (has_witness) {
+        continue;
+      }
+      if (is_exact) {
+        search.bound[target] = via_node;
+        search.targets.push_back(target);
+      } else {
+        shortcuts.emplace_back(source, target, via_node);
+      }
+    }
+    for (const GraphEdge& edge : adjacency[source]) {
+      search.hop_dist[edge.to] = no_route;
+    }
+    if (search.targets.empty()) {
+      continue;
+    }
+
+    searchWitness(adjacency, source, node, search);
+    for (uint32_t target : search.targets) {
+      if (search.dist[target] > search.bound[target]) {
+        shortcuts.emplace_back(source, target, search.bound[target]);
+      }
+      search.bound[target] = no_route;
+    }
+  }
+}
+
+// 縮約の優先度（小さいほど先に縮約する）を求める関数
+// 加えるショートカット数と消える辺の数の差を重く見て、縮約済みの隣接ノード数と階層の深さを足し、
+// 縮約が地図の一部に偏らず、全体から少しずつ進むようにする
+// is_exactがfalseの場合は2辺以内の迂回路だけで見積もる（隣接ノードの計算し直しは縮約のたびに何度も行うので、探索はしない）
+static int64_t contractionPriority(const std::vector<std::vector<GraphEdge>>& adjacency, const std::vector<uint32_t>& deleted_neighbors,
+                                   const std::vector<uint32_t>& levels, uint32_t node, bool is_exact, WitnessSearch& search,
+                                   std::vector<std::tuple<uint32_t, uint32_t, uint32_t>>& shortcuts) {
+  findShortcuts(adjacency, node, is_exact, search, shortcuts);
+  return 8 * (static_cast<int64_t>(shortcuts.size()) - static_cast<int64_t>(adjacency[node].size()))
+       + deleted_neighbors[node] + levels[node];
+}
+
+// 道路区間をたどってノード間の辺を作る関数
+static void extractEdges(RoadGraph& graph, std::vector<std::vector<GraphEdge>>& adjacency) {
+  static const std::array<Direction, 4> directions {Direction::North, Direction::South, Direction::East, Direction::West};
+  adjacency.assign(graph.nodes.size(), {});
+  graph.num_edges = 0;
+  for (uint32_t u = 0; u < graph.nodes.size(); u++) {
+    for (Direction direction : directions) {
+      unsigned int x = graph.nodes[u].x;
+      unsigned int y = graph.nodes[u].y;
+      stepCell(x, y, direction);
+      if (!is_road(x, y)) {
+        continue;
+      }
+      uint32_t v {};
+      uint32_t weight {};
+      walkToNode(graph, graph.nodes[u].x, graph.nodes[u].y, direction, v, weight);
+      // 同じ区間は両端から見つかるので、番号の小さい側から見つけた時だけ加える
+      if (u < v) {
+        addEdge(adjacency[u], v, weight, no_route);
+        addEdge(adjacency[v], u, weight, no_route);
+        graph.num_edges++;
+      }
+    }
+  }
+}
+
+// 縮約していないノードの番号を詰め直す関数
+// ids（詰めた番号→元のノード番号）と、詰めた番号で引く隣接リスト・優先度などをまとめて作り直す
+static void compactRemaining(std::vector<uint32_t>& ids, const std::vector<uint32_t>& rank,
+                             std::vector<std::vector<GraphEdge>>& adjacency, std::vector<int64_t>& priorities,
+                             std::vector<uint32_t>& deleted_neighbors, std::vector<uint32_t>& levels) {
+  std::vector<uint32_t> remap(ids.size(), no_route);
+  std::vector<uint32_t> new_ids;
+  for (uint32_t v = 0; v < ids.size(); v++) {
+    if (rank[ids[v]] == no_route) {
+      remap[v] = new_ids.size();
+      new_ids.push_back(ids[v]);
+    }
+  }
+  std::vector<std::vector<GraphEdge>> new_adjacency(new_ids.size());
+  std::vector<int64_t> new_priorities(new_ids.size());
+  std::vector<uint32_t> new_deleted_neighbors(new_ids.size());
+  std::vector<uint32_t> new_levels(new_ids.size());
+  for (uint32_t v = 0; v < ids.size(); v++) {
+    const uint32_t u = remap[v];
+    if (u == no_route) {
+      continue;
+    }
+    new_adjacency[u] = adjacency[v];
+    for (GraphEdge& edge : new_adjacency[u]) {
+      edge.to = remap[edge.to];
+    }
+    new_priorities[u] = priorities[v];
+    new_deleted_neighbors[u] = deleted_neighbors[v];
+    new_levels[u] = levels[v];
+  }
+  ids.swap(new_ids);
+  adjacency.swap(new_adjacency);
+  priorities.swap(new_priorities);
+  deleted_neighbors.swap(new_deleted_neighbors);
+  levels.swap(new_levels);
+}
+
+// 重要度の低いノードから順に縮約し、上向きの辺の索引を作る関数
+// 縮約中の隣接リストなどは、縮約していないノードを詰めた番号で引く（辺のmiddleだけは元のノード番号）
+static void contractGraph(RoadGraph& graph, std::vector<std::vector<GraphEdge>>& adjacency) {
+  const uint32_t num_nodes = graph.nodes.size();
+  std::vector<uint32_t> ids(num_nodes);  // 詰めた番号→元のノード番号
+  for (uint32_t v = 0; v < num_nodes; v++) {
+    ids[v] = v;
+  }
+  WitnessSearch search {std::vector<uint32_t>(num_nodes, no_route), std::vector<uint32_t>(num_nodes, no_route),
+                        std::vector<uint32_t>(num_nodes, no_route), {}, {}, {}};
+  std::vector<std::tuple<uint32_t, uint32_t, uint32_t>> shortcuts;
+  std::vector<uint32_t> deleted_neighbors(num_nodes, 0);
+  std::vector<uint32_t> levels(num_nodes, 0);
+  std::vector<std::vector<GraphEdge>> up_lists(num_nodes);  // 元のノード番号ごとの上向きの辺（元のノード番号）
+
+  // 縮約するとその隣接ノードの優先度が変わるので、隣接ノードの優先度を計算し直して積み直す
+  // キューに残った古い優先度の項目は、取り出した時に今の優先度と比べて読み飛ばす
+  typedef std::pair<int64_t, uint32_t> QueueEntry;
+  std::vector<int64_t> priorities(num_nodes);
+  std::vector<QueueEntry> entries(num_nodes);
+  for (uint32_t v = 0; v < num_nodes; v++) {
+    priorities[v] = contractionPriority(adjacency, deleted_neighbors, levels, v, false, search, shortcuts);
+    entries[v] = QueueEntry {priorities[v], v};
+  }
+  std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> queue(std::greater<QueueEntry>(), std::move(entries));
+
+  std::vector<uint32_t> rank(num_nodes, no_route);  // 元のノード番号ごとの縮約順
+  std::vector<uint32_t> contracted;                 // 縮約した順の元のノード番号
+  contracted.reserve(num_nodes);
+  graph.num_shortcuts = 0;
+  while (!queue.empty()) {
+    const auto [priority, v] = queue.top();
+    queue.pop();
+    if ((rank[ids[v]] != no_route) || (priority != priorities[v])) {
+      continue;
+    }
+    // 積んだ優先度は見積もりなので、縮約する直前に探索したショートカットで求め直し、まだ最も小さいかを確かめる
+    priorities[v] = contractionPriority(adjacency, deleted_neighbors, levels, v, true, search, shortcuts);
+    if (!queue.empty() && (priorities[v] > queue.top().first)) {
+      queue.emplace(priorities[v], v);
+      continue;
+    }
+
+    // vを縮約：残っている隣接ノードはすべてvより後に縮約される（＝重要）ので、上向きの辺として残す
+    const uint32_t original = ids[v];
+    rank[original] = contracted.size();
+    contracted.push_back(original);
+    for (const GraphEdge& edge : adjacency[v]) {
+      up_lists[original].push_back(GraphEdge {ids[edge.to], edge.weight, edge.middle});
+      removeEdge(adjacency[edge.to], v);
+      deleted_neighbors[edge.to]++;
+      levels[edge.to] = std::max(levels[edge.to], levels[v] + 1);
+    }
+    for (const auto& [a, b, weight] : shortcuts) {
+      addEdge(adjacency[a], b, weight, original);
+      addEdge(adjacency[b], a, weight, original);
+    }
+    graph.num_shortcuts += shortcuts.size();
+    std::vector<GraphEdge> neighbors;
+    neighbors.swap(adjacency[v]);
+    for (const GraphEdge& edge : neighbors) {
+      priorities[edge.to] = contractionPriority(adjacency, deleted_neighbors, levels, edge.to, false, search, shortcuts);
+      queue.emplace(priorities[edge.to], edge.to);
+    }
+
+    // 残りのノードが減ったら番号を詰め直し、キューも今の優先度で積み直す
+    const uint32_t remaining = num_nodes - contracted.size();
+    if ((remaining > 0) && (remaining * compact_ratio <= ids.size())) {
+      compactRemaining(ids, rank, adjacency, priorities, deleted_neighbors, levels);
+      search.dist.assign(ids.size(), no_route);
+      search.bound.assign(ids.size(), no_route);
+      search.hop_dist.assign(ids.size(), no_route);
+      search.touched.clear();
+      std::vector<QueueEntry> remaining_entries(ids.size());
+      for (uint32_t u = 0; u < ids.size(); u++) {
+        remaining_entries[u] = QueueEntry {priorities[u], u};
+      }
+      queue = std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>>(std::greater<QueueEntry>(), std::move(remaining_entries));
+    }
+  }
+
+  // ノード番号を縮約順に振り直し、上向きの辺を1つの配列に詰める
+  // どの問い合わせも最後は重要なノードの辺をたどるので、それらの辺が配列の末尾にまとまってキャッシュに載りやすくなる
+  std::vector<GraphNode> nodes(num_nodes);
+  for (uint32_t v = 0; v < num_nodes; v++) {
+    nodes[rank[v]] = graph.nodes[v];
+  }
+  graph.nodes.swap(nodes);
+  for (auto& entry : graph.node_index) {
+    entry.second = rank[entry.second];
+  }
+  graph.up_begin.assign(num_nodes + 1, 0);
+  graph.up_edges.clear();
+  graph.up_edges.reserve(graph.num_edges + graph.num_shortcuts);
+  for (uint32_t u = 0; u < num_nodes; u++) {
+    graph.up_begin[u] = graph.up_edges.size();
+    for (const GraphEdge& edge : up_lists[contracted[u]]) {
+      graph.up_edges.push_back(GraphEdge {rank[edge.to], edge.weight, (edge.middle == no_route) ? no_route : rank[edge.middle]});
+    }
+  }
+  graph.up_begin[num_nodes] = graph.up_edges.size();
+}
+
+// 上向きの探索を、区間の両端のノードを起点にして始める関数（前回の探索で書いた距離は戻す）
+static void startUpward(UpwardSearch& search, const CellLocation& location) {
+  for (uint32_t node : search.touched) {
+    search.dist[node] = no_route;
+  }
+  search.touched.clear();
+  search.heap.clear();
+  for (const auto& [node, seed] : {std::make_pair(location.node_a, location.dist_a), std::make_pair(location.node_b, location.dist_b)}) {
+    if (seed < search.dist[node]) {
+      if (search.dist[node] == no_route) {
+        search.touched.push_back(node);
+      }
+      search.dist[node] = seed;
+      search.parent[node] = no_route;
+      pushHeap(search.heap, seed, node);
+    }
+  }
+}
+
+// 上向きの探索で次に近いノードを確定させ、その上向きの辺を広げる関数（確定したノードを返す。残りが無ければno_route）
+// 辺は両向きに通れるので、上向きの辺の先にあるより重要なノードを経由した方が近いノードは、
+// 最短経路の途中にならないものとして先へ広げない（stall-on-demand）
+static uint32_t settleUpward(const RoadGraph& graph, UpwardSearch& search) {
+  while (!search.heap.empty()) {
+    uint64_t top = popHeap(search.heap);
+    uint32_t d = top >> 32;
+    uint32_t node = top & 0xffffffff;
+    if (d > search.dist[node]) {
+      continue;
+    }
+    const GraphEdge* begin = &graph.up_edges[graph.up_begin[node]];
+    const GraphEdge* end = &graph.up_edges[graph.up_begin[node + 1]];
+    if (std::any_of(begin, end, [&](const GraphEdge& edge) { return (search.dist[edge.to] != no_route) && (search.dist[edge.to] + edge.weight < d); })) {
+      return node;
+    }
+    for (const GraphEdge* edge = begin; edge != end; edge++) {
+      uint32_t next = d + edge->weight;
+      if (next < search.dist[edge->to]) {
+        if (search.dist[edge->to] == no_route) {
+          search.touched.push_back(edge->to);
+        }
+        search.dist[edge->to] = next;
+        search.parent[edge->to] = edge - graph.up_edges.data();
+        pushHeap(search.heap, next, edge->to);
+      }
+    }
+    return node;
+  }
+  return no_route;
+}
+
+// 探索の次に確定する候補の距離を返す関数（残りが無ければno_route）
+static uint32_t nextDistance(const UpwardSearch& search) {
+  return search.heap.empty() ? no_route : static_cast<uint32_t>(search.heap.front() >> 32);
+}
+
+// 区間の両端のノードを起点に、上向きの辺だけをたどって届くすべてのノードの距離を求める関数
+static void searchUpward(const RoadGraph& graph, UpwardSearch& search, const CellLocation& location) {
+  startUpward(search, location);
+  while (settleUpward(graph, search) != no_route) {
+  }
+}
+
+// 道路ビットマップとランドマークから道路グラフと索引を作る関数
+void buildRoadGraph(RoadGraph& graph, const LandmarkIndex& index) {
+  // ノードの抽出（ノード番号は行優先の順）
+  markNodeCells(graph.node_cells, index);
+  graph.nodes.clear();
+  graph.node_index.clear();
+  for (unsigned int y = 0; y < road_map.size_y; y++) {
+    for (unsigned int w = 0; w < graph.node_cells.words_per_row; w++) {
+      for (uint64_t bits = gridWord(graph.node_cells, w, y); bits != 0; bits &= bits - 1) {
+        unsigned int x = w * 64 + __builtin_ctzll(bits);
+        graph.node_index.emplace(cellKey(x, y), graph.nodes.size());
+        graph.nodes.push_back(GraphNode {x, y});
+      }
+    }
+  }
+
+  // 辺の抽出と縮約
+  std::vector<std::vector<GraphEdge>> adjacency;
+  extractEdges(graph, adjacency);
+  contractGraph(graph, adjacency);
+
+  // ランドマーク間と初期位置からの距離表
+  RouteWorkspace workspace {};
+  initRouteWorkspace(workspace, graph);
+  std::vector<GraphNode> landmark_cells;
+  for (const LandMark& lm : index.landmarks) {
+    landmark_cells.push_back(GraphNode {lm.x, lm.y});
+  }
+  graph.num_landmarks = landmark_cells.size();
+  graph.landmark_distances = routeDistanceTable(graph, workspace, landmark_cells, landmark_cells);
+  graph.start_distances = routeDistanceTable(graph, workspace, {GraphNode {initial_position.x, initial_position.y}}, landmark_cells);
+}
+
+// ノードの並びから、ノードのあるマスのビットマップとマス→ノード番号の対応を作り直す関数
+void indexGraphNodes(RoadGraph& graph) {
+  initBitGrid(graph.node_cells, road_map.size_x, road_map.size_y);
+  graph.node_index.clear();
+  graph.node_index.reserve(graph.nodes.size());
+  for (uint32_t node = 0; node < graph.nodes.size(); node++) {
+    setGridBit(graph.node_cells, graph.nodes[node].x, graph.nodes[node].y, true);
+    graph.node_index.emplace(cellKey(graph.nodes[node].x, graph.nodes[node].y), node);
+  }
+}
+
+// 問い合わせの作業領域を初期化する関数
+void initRouteWorkspace(RouteWorkspace& workspace, const RoadGraph& graph) {
+  for (UpwardSearch* search : {&workspace.forward, &workspace.backward}) {
+    search->dist.assign(graph.nodes.size(), no_route);
+    search->parent.assign(graph.nodes.size(), no_route);
+    search->touched.clear();
+    search->heap.clear();
+  }
+}
+
+// 両側から上向きの辺だけをたどり、両方の探索が届いたノードを経由する距離の最小値を求める関数
+// 両側の探索は次に確定する距離が近い方から1ノードずつ交互に進め、どちらの候補も見つかった距離以上になったら打ち切る
+// meetingには経由したノード（同じ区間の途中どうしで直接たどる方が近い場合はno_route）を返す
+static uint32_t searchBoth(const RoadGraph& graph, RouteWorkspace& workspace, const CellLocation& from, const CellLocation& to, uint32_t& meeting) {
+  // 同じ区間の途中にある場合は、直接の距離より遠くは探さない
+  uint32_t best = directDistance(from, to);
+  meeting = no_route;
+  startUpward(workspace.forward, from);
+  startUpward(workspace.backward, to);
+  while (true) {
+    const uint32_t forward_next = nextDistance(workspace.forward);
+    const uint32_t backward_next = nextDistance(workspace.backward);
+    if (std::min(forward_next, backward_next) >= best) {
+      break;
+    }
+    UpwardSearch& search = (forward_next <= backward_next) ? workspace.forward : workspace.backward;
+    const UpwardSearch& other = (forward_next <= backward_next) ? workspace.backward : workspace.forward;
+    const uint32_t node = settleUpward(graph, search);
+    if ((node != no_route) && (other.dist[node] != no_route) && (search.dist[node] + other.dist[node] < best)) {
+      best = search.dist[node] + other.dist[node];
+      meeting = node;
+    }
+  }
+  return best;
+}
+
+// 上向きの辺の番号から、辺の出発側のノードを返す関数
+static uint32_t edgeSource(const RoadGraph& graph, uint32_t edge) {
+  return std::upper_bound(graph.up_begin.begin(), graph.up_begin.end(), edge) - graph.up_begin.begin() - 1;
+}
+
+// ノードaとbを結ぶ辺の経由ノードを返す関数（辺は縮約順の小さい側の上向きの辺として持っている）
+static uint32_t edgeMiddle(const RoadGraph& graph, uint32_t a, uint32_t b) {
+  uint32_t lower = std::min(a, b);
+  uint32_t upper = std::max(a, b);
+  for (uint32_t e = graph.up_begin[lower]; e < graph.up_begin[lower + 1]; e++) {
+    if (graph.up_edges[e].to == upper) {
+      return graph.up_edges[e].middle;
+    }
+  }
+  return no_route;
+}
+
+// ショートカットを道路区間の辺まで展開し、aからbへの途中のノード（両端を除く）を順にpathへ加える関数
+static void unpackEdge(const RoadGraph& graph, uint32_t a, uint32_t b, uint32_t middle, std::vector<uint32_t>& path) {
+  if (middle == no_route) {
+    return;
+  }
+  unpackEdge(graph, a, middle, edgeMiddle(graph, a, middle), path);
+  path.push_back(middle);
+  unpackEdge(graph, middle, b, edgeMiddle(graph, middle, b), path);
+}
+
+// 2つのマスの間の最短距離を返す関数
+uint32_t routeDistance(const RoadGraph& graph, RouteWorkspace& workspace, const GraphNode& from, const GraphNode& to) {
+  CellLocation from_location = locateCell(graph, from);
+  CellLocation to_location = locateCell(graph, to);
+  if (!from_location.is_road || !to_location.is_road) {
+    return no_route;
+  }
+  uint32_t meeting {};
+  return searchBoth(graph, workspace, from_location, to_location, meeting);
+}
+
+// 2つのマスの間の最短経路を、曲がる地点の並びで返す関数
+// 経由ノードから両側の探索でたどった辺を起点へさかのぼり、ショートカットを展開してつなげる
+std::vector<GraphNode> routePath(const RoadGraph& graph, RouteWorkspace& workspace, const GraphNode& from, const GraphNode& to) {
+  std::vector<GraphNode> path;
+  CellLocation from_location = locateCell(graph, from);
+  CellLocation to_location = locateCell(graph, to);
+  if (!from_location.is_road || !to_location.is_road) {
+    return path;
+  }
+  uint32_t meeting {};
+  if (searchBoth(graph, workspace, from_location, to_location, meeting) == no_route) {
+    return path;
+  }
+
+  std::vector<uint32_t> nodes;
+  if (meeting != no_route) {
+    // 出発側：経由ノードから起点へさかのぼった後、向きを逆にする
+    for (uint32_t node = meeting; workspace.forward.parent[node] != no_route;) {
+      const GraphEdge& edge = graph.up_edges[workspace.forward.parent[node]];
+      uint32_t source = edgeSource(graph, workspace.forward.parent[node]);
+      nodes.push_back(node);
+      std::vector<uint32_t> inner;
+      unpackEdge(graph, node, source, edge.middle, inner);
+      nodes.insert(nodes.end(), inner.begin(), inner.end());
+      node = source;
+      if (workspace.forward.parent[node] == no_route) {
+        nodes.push_back(node);
+      }
+    }
+    if (nodes.empty()) {
+      nodes.push_back(meeting);
+    }
+    std::reverse(nodes.begin(), nodes.end());
+
+    // 到着側：経由ノードから起点へたどる
+    for (uint32_t node = meeting; workspace.backward.parent[node] != no_route;) {
+      const GraphEdge& edge = graph.up_edges[workspace.backward.parent[node]];
+      uint32_t source = edgeSource(graph, workspace.backward.parent[node]);
+      unpackEdge(graph, node, source, edge.middle, nodes);
+      nodes.push_back(source);
+      node = source;
+    }
+  }
+
+  // マスの並びにする（出発・到着のマスがノードの場合は重ねない）
+  path.push_back(from);
+  for (uint32_t node : nodes) {
+    path.push_back(graph.nodes[node]);
+  }
+  path.push_back(to);
+  path.erase(std::unique(path.begin(), path.end(), [](const GraphNode& a, const GraphNode& b) { return (a.x == b.x) && (a.y == b.y); }), path.end());
+  return path;
+}
+
+// 複数のマスの間の最短距離表を返す関数
+// 到着側の探索が届いたノードに（到着側の番号, 距離）を置いておき、出発側の探索で拾い集める
+std::vector<uint32_t> routeDistanceTable(const RoadGraph& graph, RouteWorkspace& workspace,
+                                         const std::vector<GraphNode>& from, const std::vector<GraphNode>& to) {
+  std::vector<uint32_t> table(from.size() * to.size(), no_route);
+  std::vector<CellLocation> to_locations;
+  std::unordered_map<uint32_t, std::vector<std::pair<uint32_t, uint32_t>>> buckets;
+  for (uint32_t j = 0; j < to.size(); j++) {
+    to_locations.push_back(locateCell(graph, to[j]));
+    if (!to_locations[j].is_road) {
+      continue;
+    }
+    searchUpward(graph, workspace.backward, to_locations[j]);
+    for (uint32_t node : workspace.backward.touched) {
+      buckets[node].emplace_back(j, workspace.backward.dist[node]);
+    }
+  }
+
+  for (size_t i = 0; i < from.size(); i++) {
+    CellLocation from_location = locateCell(graph, from[i]);
+    if (!from_location.is_road) {
+      continue;
+    }
+    uint32_t* row = &table[i * to.size()];
+    searchUpward(graph, workspace.forward, from_location);
+    for (uint32_t node : workspace.forward.touched) {
+      auto bucket = buckets.find(node);
+      if (bucket == buckets.end()) {
+        continue;
+      }
+      for (const auto& [j, dist] : bucket->second) {
+        row[j] = std::min(row[j], workspace.forward.dist[node] + dist);
+      }
+    }
+    for (size_t j = 0; j < to.size(); j++) {
+      if (to_locations[j].is_road) {
+        row[j] = std::min(row[j], directDistance(from_location, to_locations[j]));
+      }
+    }
+  }
+  return table;
+}
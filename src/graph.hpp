@@ -0,0 +1,84 @@
+#ifndef GRAPH_HPP
+#define GRAPH_HPP
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "map.hpp"
+
+// 経路が無いことを表す距離
+constexpr uint32_t no_route = UINT32_MAX;
+
+// グラフのノード（マスの座標）
+typedef struct {
+  unsigned int x;  // X座標
+  unsigned int y;  // Y座標
+} GraphNode;
+
+// グラフの辺
+typedef struct {
+  uint32_t to;      // 行き先のノード番号
+  uint32_t weight;  // 道のりのマス数
+  uint32_t middle;  // ショートカットが経由するノード番号（道路区間そのものの辺はno_route）
+} GraphEdge;
+
+// 道路グラフの構造体
+// 交差点・曲がり角・ランドマーク・初期位置のマスをノードとし、その間のまっすぐな道路区間を辺とする
+// 最短経路の問い合わせ用に、重要度の低いノードから順に縮約して作った索引（Contraction Hierarchies）を持つ
+// 距離は向きや速度の制約を考えない、道路上を縦横にたどるマス数
+typedef struct {
+  std::vector<GraphNode> nodes;                        // ノードごとのマス（ノード番号は縮約順で、大きいほど重要）
+  BitGrid node_cells;                                  // ノードのあるマスのビットマップ
+  std::unordered_map<uint64_t, uint32_t> node_index;   // マス(cellKey)→ノード番号
+  std::vector<uint32_t> up_begin;                      // ノードごとの上向きの辺の開始位置（ノード数 + 1 個）
+  std::vector<GraphEdge> up_edges;                     // 自分より重要なノードへの辺（ショートカットを含む）
+  size_t num_edges;                                    // 道路区間の辺の数
+  size_t num_shortcuts;                                // 縮約で加えたショートカットの数
+  unsigned int num_landmarks;                          // ランドマーク数
+  std::vector<uint32_t> landmark_distances;            // ランドマーク間の距離（i * ランドマーク数 + j）
+  std::vector<uint32_t> start_distances;               // 初期位置から各ランドマークへの距離
+} RoadGraph;
+
+// 上向きの辺だけをたどる探索の片側の状態
+typedef struct {
+  std::vector<uint32_t> dist;     // ノードごとの距離
+  std::vector<uint32_t> parent;   // ノードごとの探索で通った辺（up_edgesの番号、起点はno_route）
+  std::vector<uint32_t> touched;  // distに距離を書いたノード（次の探索の前に戻す）
+  std::vector<uint64_t> heap;     // 優先度付きキュー（距離 << 32 | ノード番号）
+} UpwardSearch;
+
+// 問い合わせの作業領域（同時に問い合わせるスレッドごとに1つ持つ）
+typedef struct {
+  UpwardSearch forward;   // 出発側の探索
+  UpwardSearch backward;  // 到着側の探索
+} RouteWorkspace;
+
+// 道路ビットマップとランドマークから道路グラフと索引を作り、ランドマーク間の距離表を求める関数
+// 1スレッドで作るので、ノード数が数十万を超える地図では分単位の時間がかかる
+void buildRoadGraph(RoadGraph& graph, const LandmarkIndex& index);
+
+// ノードの並び（nodes）から、ノードのあるマスのビットマップとマス→ノード番号の対応を作り直す関数
+// キャッシュから読み込んだ道路グラフで使う
+void indexGraphNodes(RoadGraph& graph);
+
+// 問い合わせの作業領域を初期化する関数
+void initRouteWorkspace(RouteWorkspace& workspace, const RoadGraph& graph);
+
+// 2つのマスの間の最短距離を返す関数（どちらかが道路外、または経路が無い場合はno_route）
+uint32_t routeDistance(const RoadGraph& graph, RouteWorkspace& workspace, const GraphNode& from, const GraphNode& to);
+
+// 2つのマスの間の最短経路を、曲がる地点（出発・到着のマスと、経路上のノード）の並びで返す関数
+// 隣り合う地点は同じ行か同じ列にあり、その間はまっすぐな道路区間になる（経路が無い場合は空）
+std::vector<GraphNode> routePath(const RoadGraph& graph, RouteWorkspace& workspace, const GraphNode& from, const GraphNode& to);
+
+// 複数のマスの間の最短距離表（from.size() * to.size()、i * to.size() + j）を返す関数
+// 到着側ごとに1回、出発側ごとに1回だけ索引を探索する
+std::vector<uint32_t> routeDistanceTable(const RoadGraph& graph, RouteWorkspace& workspace,
+                                         const std::vector<GraphNode>& from, const std::vector<GraphNode>& to);
+
+// 前計算したランドマーク間の距離を返す関数
+inline uint32_t landmarkDistance(const RoadGraph& graph, unsigned int from, unsigned int to) {
+  return graph.landmark_distances[static_cast<size_t>(from) * graph.num_landmarks + to];
+}
+
+#endif  // GRAPH_HPP
@@ -0,0 +1,67 @@
+#include "history.hpp"
+#include "profile.hpp"
+
+// スナップショットを取る関数
+GameSnapshot takeSnapshot(const GameState& state, const LandmarkIndex& index) {
+  return GameSnapshot {packState(state), index.arrived.empty() ? 0 : index.arrived[0]};
+}
+
+// スナップショットを戻す関数
+void restoreSnapshot(const GameSnapshot& snapshot, GameState& state, LandmarkIndex& index) {
+  state = unpackState(snapshot.state);
+  if (!index.arrived.empty()) {
+    index.arrived[0] = snapshot.arrived;
+  }
+  index.arrived_count = __builtin_popcountll(snapshot.arrived);
+}
+
+// 履歴を空にする関数
+void initMoveHistory(MoveHistory& history) {
+  history.entries.resize(max_history_moves);
+  history.size = 0;
+  history.position = 0;
+}
+
+// stepGameで1手進め、その手を履歴に記録する関数
+// 終了コマンドは状態を変えないので記録しない
+StepOutcome stepGameWithHistory(MoveHistory& history, GameState& state, LandmarkIndex& index, Command command) {
+  PROFILE_SCOPE("history.stepGameWithHistory");
+  const PackedState before = packState(state);
+  const unsigned int arrived_count = index.arrived_count;
+  StepOutcome outcome = stepGame(state, index, command);
+  if ((outcome == StepOutcome::Quit) || (history.position >= history.entries.size())) {
+    return outcome;
+  }
+  int32_t landmark = (index.arrived_count != arrived_count) ? findLandmark(index, state.pos.x, state.pos.y) : -1;
+  history.entries[history.position++] = HistoryEntry {before, packState(state), landmark, command};
+  history.size = history.position;
+  return outcome;
+}
+
+// 直前の手を取り消す関数
+bool undoMove(MoveHistory& history, GameState& state, LandmarkIndex& index) {
+  if (history.position == 0) {
+    return false;
+  }
+  const HistoryEntry& entry = history.entries[--history.position];
+  state = unpackState(entry.before);
+  if (entry.arrived_landmark >= 0) {
+    index.arrived[entry.arrived_landmark / 64] &= ~(uint64_t {1} << (entry.arrived_landmark % 64));
+    index.arrived_count--;
+  }
+  return true;
+}
+
+// 取り消した手をやり直す関数
+bool redoMove(MoveHistory& history, GameState& state, LandmarkIndex& index) {
+  if (history.position == history.size) {
+    return false;
+  }
+  const HistoryEntry& entry = history.entries[history.position++];
+  state = unpackState(entry.after);
+  if (entry.arrived_landmark >= 0) {
+    index.arrived[entry.arrived_landmark / 64] |= uint64_t {1} << (entry.arrived_landmark % 64);
+    index.arrived_count++;
+  }
+  return true;
+}
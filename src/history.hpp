@@ -0,0 +1,80 @@
+#ifndef HISTORY_HPP
+#define HISTORY_HPP
+
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+#include "map.hpp"
+#include "game.hpp"
+
+// 位置・向き・速度・手数・燃料を詰めた状態（20バイト、ポインタや文字列を含まないのでそのままコピーできる）
+typedef struct {
+  uint32_t x;          // X座標
+  uint32_t y;          // Y座標
+  uint32_t steps;      // 手数
+  int32_t fuel;        // 残り燃料
+  uint8_t direction;   // 向き
+  uint8_t speed;       // 速度
+} PackedState;
+
+// スナップショットに持てるランドマーク数の上限（到達済みフラグを64ビット1つで持つため）
+constexpr unsigned int snapshot_max_landmarks = 64;
+
+// ゲーム全体の状態のスナップショット（32バイト）
+// ランドマークがsnapshot_max_landmarks個以下のマップで、到達状況を含めた状態を丸ごと保存・復元できる
+// 探索や分析のツールは、分岐ごとにこれをコピーするだけで状態を持てる
+typedef struct {
+  PackedState state;  // 位置・向き・速度・手数・燃料
+  uint64_t arrived;   // 到達済みフラグ（ランドマーク番号のビット）
+} GameSnapshot;
+
+static_assert(std::is_trivially_copyable<PackedState>::value, "PackedState must be trivially copyable.");
+static_assert(std::is_trivially_copyable<GameSnapshot>::value, "GameSnapshot must be trivially copyable.");
+static_assert(max_speed <= UINT8_MAX, "max_speed must fit in PackedState.");
+
+// 1手分の履歴
+// 到達済みフラグは1手で高々1つしか増えないので、丸ごとではなく増えたランドマークの番号だけを持つ
+typedef struct {
+  PackedState before;        // 手の前の状態
+  PackedState after;         // 手の後の状態
+  int32_t arrived_landmark;  // その手で到達したランドマークの番号（無い場合は-1）
+  Command command;           // その手のコマンド（やり直しをリプレイ記録に残す時に使う）
+} HistoryEntry;
+
+// 1手ごとに燃料を1以上消費し、燃料が無くなるとゲームが終わるので、1ゲームの手数はfuel_init以下になる
+constexpr size_t max_history_moves = fuel_init;
+
+// 手の取り消し・やり直しの履歴
+// 1ゲーム分の置き場を最初に確保しておくので、記録・取り消し・やり直しはどれもメモリ確保の無い定数時間で済む
+// ランドマーク数に上限は無い
+typedef struct {
+  std::vector<HistoryEntry> entries;  // 手ごとの履歴（max_history_moves個を確保済み）
+  size_t size;                        // 記録した手数（取り消した手を含む）
+  size_t position;                    // 取り消していない手数（これより後ろがやり直せる手）
+} MoveHistory;
+
+// 状態を詰める・戻す関数
+inline PackedState packState(const GameState& state) {
+  return PackedState {state.pos.x, state.pos.y, state.steps, state.fuel,
+                      static_cast<uint8_t>(state.pos.direction), static_cast<uint8_t>(state.speed)};
+}
+inline GameState unpackState(const PackedState& packed) {
+  return GameState {Position {packed.x, packed.y, static_cast<Direction>(packed.direction)}, packed.speed, packed.steps, packed.fuel};
+}
+
+// スナップショットを取る・戻す関数（ランドマークがsnapshot_max_landmarks個以下であること）
+GameSnapshot takeSnapshot(const GameState& state, const LandmarkIndex& index);
+void restoreSnapshot(const GameSnapshot& snapshot, GameState& state, LandmarkIndex& index);
+
+// 履歴を空にする関数（初回は置き場を確保する）
+void initMoveHistory(MoveHistory& history);
+
+// stepGameで1手進め、その手を履歴に記録する関数（取り消した手はやり直せなくなる）
+// 引数と戻り値はstepGameと同じ
+StepOutcome stepGameWithHistory(MoveHistory& history, GameState& state, LandmarkIndex& index, Command command);
+
+// 直前の手を取り消す・取り消した手をやり直す関数（できない場合はfalseを返す）
+bool undoMove(MoveHistory& history, GameState& state, LandmarkIndex& index);
+bool redoMove(MoveHistory& history, GameState& state, LandmarkIndex& index);
+
+#endif  // HISTORY_HPP
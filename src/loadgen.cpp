@@ -0,0 +1,234 @@
+// サーバ（./main serve）に多数の接続からコマンドを送り続け、処理量と応答時間を計測する負荷生成クライアント
+// 接続ごとに応答の入力欄 "Command: " を受け取ってから次のコマンドを送り、送ってから応答を受け取り終えるまでの時間を数える
+// ゲームが終わって接続が閉じられたら、つなぎ直して新しいゲームを始める
+//
+//   ./loadgen <待ち受け先> <接続数> <秒数> [スレッド数]
+//
+// 待ち受け先はサーバと同じ書式（数字だけならループバックのTCPポート、それ以外はUnixドメインソケットのパス）
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// 送るコマンドの並び（速度が1を超えないので、道路外に出ることは無い）
+const std::array<std::string, 7> command_cycle {"a\n", "c\n", "l\n", "c\n", "r\n", "c\n", "s\n"};
+// 応答の終わりを示す入力欄
+const std::string prompt {"Command: "};
+// 応答時間のヒストグラムの区間数（1マイクロ秒ごと、最後の区間はそれ以上すべて）
+constexpr unsigned int latency_buckets = 100000;
+// 1回のepoll_waitで受け取るイベントの最大数
+constexpr int max_events = 256;
+
+// 1つの接続の状態
+typedef struct {
+  int fd;                                               // 接続のファイルディスクリプタ
+  size_t next_command;                                  // 次に送るコマンドの位置
+  bool is_waiting;                                      // 応答を待っているか
+  std::string tail;                                     // 受け取ったバイト列の末尾（入力欄の検出用）
+  std::chrono::steady_clock::time_point sent;           // コマンドを送った時刻
+} Connection;
+
+// スレッドごとの集計
+typedef struct {
+  std::vector<uint64_t> latency;  // 応答時間のヒストグラム
+  uint64_t commands;              // 応答を受け取ったコマンド数
+  uint64_t games;                 // 終わったゲームの数
+  uint64_t max_us;                // 最大の応答時間(マイクロ秒)
+} LoadStats;
+
+// 待ち受け先に接続する関数（接続できない場合はruntime_errorをthrowする）
+static int connectServer(const std::string& address) {
+  bool is_tcp = !address.empty() && std::all_of(address.begin(), address.end(), [](char c) { return (c >= '0') && (c <= '9'); });
+  int fd {-1};
+  int result {-1};
+  if (is_tcp) {
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(std::stoul(address));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    result = connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    int no_delay {1};
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+  } else {
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, address.c_str(), sizeof(addr.sun_path) - 1);
+    result = connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+  }
+  if (result != 0) {
+    close(fd);
+    throw std::runtime_error("Can't connect to \"" + address + "\".");
+  }
+  return fd;
+}
+
+// 接続を開いてepollに登録する関数（最初の応答を待つ状態にする）
+static void openConnection(const std::string& address, int epoll_fd, Connection& connection) {
+  connection.fd = connectServer(address);
+  connection.next_command = 0;
+  connection.is_waiting = false;
+  connection.tail.clear();
+  epoll_event event {};
+  event.events = EPOLLIN;
+  event.data.ptr = &connection;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, connection.fd, &event);
+}
+
+// 次のコマンドを送る関数
+static void sendCommand(Connection& connection) {
+  const std::string& command = command_cycle[connection.next_command];
+  connection.next_command = (connection.next_command + 1) % command_cycle.size();
+  connection.sent = std::chrono::steady_clock::now();
+  connection.is_waiting = true;
+  send(connection.fd, command.data(), command.size(), MSG_NOSIGNAL);
+}
+
+// 応答時間を集計に加える関数
+static void recordLatency(LoadStats& stats, const Connection& connection) {
+  uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - connection.sent).count();
+  stats.latency[std::min<uint64_t>(us, latency_buckets - 1)]++;
+  stats.max_us = std::max(stats.max_us, us);
+  stats.commands++;
+}
+
+// 1つのスレッドで num_connections 個の接続を受け持ち、期限まで負荷をかける関数
+static void runLoad(const std::string& address, size_t num_connections, std::chrono::steady_clock::time_point deadline, LoadStats& stats) {
+  int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  std::vector<Connection> connections(num_connections);
+  for (Connection& connection : connections) {
+    openConnection(address, epoll_fd, connection);
+  }
+
+  std::array<epoll_event, max_events> events {};
+  std::array<char, 65536> buffer {};
+  while (std::chrono::steady_clock::now() < deadline) {
+    int count = epoll_wait(epoll_fd, events.data(), max_events, 100);
+    for (int i = 0; i < count; i++) {
+      Connection& connection = *static_cast<Connection*>(events[i].data.ptr);
+      ssize_t length = recv(connection.fd, buffer.data(), buffer.size(), 0);
+      if ((length < 0) && ((errno == EAGAIN) || (errno == EINTR))) {
+        continue;
+      }
+      if (length <= 0) {
+        // ゲームが終わって閉じられたので、つなぎ直す
+        if (connection.is_waiting) {
+          recordLatency(stats, connection);
+        }
+        stats.games++;
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, connection.fd, nullptr);
+        close(connection.fd);
+        openConnection(address, epoll_fd, connection);
+        continue;
+      }
+      connection.tail.append(buffer.data() + std::max<ssize_t>(0, length - static_cast<ssize_t>(prompt.size())),
+                             std::min<size_t>(length, prompt.size()));
+      if (connection.tail.size() > prompt.size()) {
+        connection.tail.erase(0, connection.tail.size() - prompt.size());
+      }
+      if (connection.tail == prompt) {
+        if (connection.is_waiting) {
+          recordLatency(stats, connection);
+        }
+        connection.tail.clear();
+        sendCommand(connection);
+      }
+    }
+  }
+  for (Connection& connection : connections) {
+    close(connection.fd);
+  }
+  close(epoll_fd);
+}
+
+// ヒストグラムからパーセンタイル（マイクロ秒）を求める関数
+static uint64_t latencyPercentile(const std::vector<uint64_t>& histogram, uint64_t total, double percentile) {
+  uint64_t rank = static_cast<uint64_t>(total * percentile);
+  uint64_t seen {0};
+  for (size_t us = 0; us < histogram.size(); us++) {
+    seen += histogram[us];
+    if (seen > rank) {
+      return us;
+    }
+  }
+  return histogram.size();
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 4) {
+    std::cerr << "Usage: " << argv[0] << " <address> <connections> <seconds> [threads]" << std::endl;
+    return 1;
+  }
+  std::string address {argv[1]};
+  size_t num_connections {};
+  double seconds {};
+  unsigned int num_threads {1};
+  try {
+    num_connections = std::stoul(argv[2]);
+    seconds = std::stod(argv[3]);
+    if (argc >= 5) {
+      num_threads = std::max(1ul, std::stoul(argv[4]));
+    }
+  } catch (const std::logic_error&) {
+    std::cerr << "Error: Invalid parameters." << std::endl;
+    return 1;
+  }
+  num_threads = std::min<size_t>(num_threads, std::max<size_t>(1, num_connections));
+
+  // 接続はスレッドに均等に分ける
+  auto start = std::chrono::steady_clock::now();
+  auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+  std::vector<LoadStats> stats(num_threads, LoadStats {std::vector<uint64_t>(latency_buckets, 0), 0, 0, 0});
+  std::vector<std::thread> threads;
+  std::vector<std::string> errors(num_threads);
+  for (unsigned int t = 0; t < num_threads; t++) {
+    size_t count = num_connections / num_threads + ((t < num_connections % num_threads) ? 1 : 0);
+    threads.emplace_back([&, t, count]() {
+      try {
+        runLoad(address, count, deadline, stats[t]);
+      } catch (const std::runtime_error& e) {
+        errors[t] = e.what();
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  for (const std::string& error : errors) {
+    if (!error.empty()) {
+      std::cerr << "Error: " << error << std::endl;
+      return 1;
+    }
+  }
+
+  LoadStats total {std::vector<uint64_t>(latency_buckets, 0), 0, 0, 0};
+  for (const LoadStats& s : stats) {
+    for (unsigned int us = 0; us < latency_buckets; us++) {
+      total.latency[us] += s.latency[us];
+    }
+    total.commands += s.commands;
+    total.games += s.games;
+    total.max_us = std::max(total.max_us, s.max_us);
+  }
+  std::cout << "Load: " << num_connections << " connections, " << total.commands << " commands in " << elapsed << " s ("
+            << (total.commands / std::max(elapsed, 1e-9)) << " commands/s), " << total.games << " games finished" << std::endl;
+  std::cout << "Latency: p50 " << latencyPercentile(total.latency, total.commands, 0.5) << " us, p99 "
+            << latencyPercentile(total.latency, total.commands, 0.99) << " us, max " << total.max_us << " us" << std::endl;
+  return 0;
+}
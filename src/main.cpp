@@ -1,309 +1,800 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <stdexcept>
 #include <string>
 #include <vector>
+#include <unistd.h>
 #include "map.hpp"
-
-// 設定値定義
-constexpr unsigned int max_speed = 3;
-constexpr unsigned int min_speed = 1;
-constexpr int fuel_init = 1000;
-std::array<int, (max_speed + 1)> fuel_consumption {1, 1, 3, 9};
-
-// コマンドのEnum定義
-typedef enum {
-  TurnLeft,          // 左折
-  TurnRight,         // 右折
-  ContinueStraight,  // 直進
-  Accelerate,        // 加速
-  Decelerate,        // 減速
-  Stop,              // 停止
-  GameEnd,           // ゲーム終了
-} Command;
+#include "game.hpp"
+#include "solver.hpp"
+#include "renderer.hpp"
+#include "mapfile.hpp"
+#include "graph.hpp"
+#include "tour.hpp"
+#include "traffic.hpp"
+#include "replay.hpp"
+#include "field.hpp"
+#include "mapgen.hpp"
+#include "server.hpp"
+#include "history.hpp"
+#include "playout.hpp"
+#include "trajectory.hpp"
+#include "cache.hpp"
+#include "realtime.hpp"
+#include "profile.hpp"
 
 // プロトタイプ宣言
 Command input_user_command(void);
 void setLandmerks(std::vector<LandMark>& landmarks);
-Position calcNextPositon(Position pos, Command user_command, unsigned int speed);
+int runSolver(const LandmarkIndex& landmarks);
+int runBatch(LandmarkIndex& landmarks, const std::string& script_path, unsigned long repeat);
+int runDistances(const LandmarkIndex& landmarks);
+int runRoute(const LandmarkIndex& landmarks, const std::vector<std::string>& args);
+int runTour(const LandmarkIndex& landmarks);
+int runTrafficMode(const std::vector<std::string>& args);
+int runReplay(LandmarkIndex& landmarks, const std::vector<std::string>& args);
+int runGenerate(const std::vector<std::string>& args);
+int runServe(const LandmarkIndex& landmarks, const std::vector<std::string>& args, const std::string& heatmap_path, const std::string& cache_path);
+int runPlayout(const LandmarkIndex& landmarks, const std::vector<std::string>& args, const std::string& heatmap_path);
+int reportTrajectories(const TrajectoryAnalytics& trajectories, const std::string& heatmap_path);
+int runRealtimeMode(LandmarkIndex& landmarks, const std::vector<std::string>& args, const std::string& record_path, const std::string& cache_path);
+std::string outcomeText(StepOutcome outcome);
+uint64_t parseCount(const std::string& text, uint64_t max_value);
+
+int main(int argc, char* argv[]) {
+  // "--map FILE" と "--record FILE"、"--heatmap FILE"、"--cache DIR" を取り除いた残りの引数をモードの指定とする
+  std::string map_path;
+  std::string record_path {"session.replay"};
+  std::string heatmap_path;
+  std::string cache_path;
+  std::vector<std::string> args;
+  for (int i = 1; i < argc; i++) {
+    if ((std::string(argv[i]) == "--map") && (i + 1 < argc)) {
+      map_path = argv[++i];
+    } else if ((std::string(argv[i]) == "--record") && (i + 1 < argc)) {
+      record_path = argv[++i];
+    } else if ((std::string(argv[i]) == "--heatmap") && (i + 1 < argc)) {
+      heatmap_path = argv[++i];
+    } else if ((std::string(argv[i]) == "--cache") && (i + 1 < argc)) {
+      cache_path = argv[++i];
+    } else {
+      args.push_back(argv[i]);
+    }
+  }
 
-int main() {
-  // ランドマークの設定
-  std::vector<LandMark> landmarks;
-  setLandmerks(landmarks);
+  // "generate" 指定時は地図を生成してマップファイルに書き出して終了（使用中のマップは読み込まない）
+  if ((args.size() >= 5) && (args[0] == "generate")) {
+    return runGenerate(args);
+  }
 
-  // マップ、ランドマーク設定を検証
+  // マップ、ランドマークを読み込んで検証（マップファイルの指定が無ければ標準マップ）
+  // 標準マップはコンパイル時に検証済みなので、実行時に検証するのはマップファイルの場合のみ
+  std::vector<LandMark> landmark_list;
+  LandmarkIndex landmarks {};
   try {
-    validateMap();
-    validateLandmarks(landmarks);
-    validateInitialPosition();
+    if (map_path.empty()) {
+      setLandmerks(landmark_list);
+      loadStockMap();
+      buildLandmarkIndex(landmarks, landmark_list);
+    } else {
+      loadMapFile(map_path, landmark_list);
+      buildLandmarkIndex(landmarks, landmark_list);
+      // キャッシュを指定した場合、同じマップ・ランドマーク・設定で検証に通っていれば検証を省く
+      const uint64_t fingerprint = cache_path.empty() ? 0 : gameFingerprint(landmarks);
+      if (cache_path.empty() || !is_validation_cached(cache_path, fingerprint)) {
+        validateLandmarks(landmarks);
+        validateInitialPosition();
+        validateReachability(landmarks);
+        if (!cache_path.empty()) {
+          storeValidation(cache_path, fingerprint);
+        }
+      }
+      // 燃料の検証はゲームを進める場合（対話・solve・batch・replay）のみ行う（道のりや交通の確認は燃料に関係なく行える）
+      bool is_analysis = (args.size() >= 1) && ((args[0] == "distances") || (args[0] == "route") || (args[0] == "tour")
+                                                || (args[0] == "traffic") || (args[0] == "export-map"));
+      if (!is_analysis) {
+        validateFuel(landmarks);
+      }
+    }
   } catch (const std::runtime_error& e) {
     std::cerr << "Error: " << e.what() << std::endl;
     return 1;
   }   
 
+  // "solve" 指定時は最短手数の探索のみ行って終了
+  if ((args.size() >= 1) && (args[0] == "solve")) {
+    return runSolver(landmarks);
+  }
+  // "batch" 指定時はコマンドスクリプトを実行して終了
+  if ((args.size() >= 2) && (args[0] == "batch")) {
+    unsigned long repeat {1};
+    try {
+      if (args.size() >= 3) {
+        repeat = parseCount(args[2], std::numeric_limits<unsigned long>::max());
+        if (repeat == 0) {
+          throw std::invalid_argument(args[2]);
+        }
+      }
+    } catch (const std::logic_error&) {
+      std::cerr << "Error: Invalid batch parameters." << std::endl;
+      return 1;
+    }
+    return runBatch(landmarks, args[1], repeat);
+  }
+  // "distances" 指定時は道路グラフを作り、ランドマーク間の距離表を表示して終了
+  if ((args.size() >= 1) && (args[0] == "distances")) {
+    return runDistances(landmarks);
+  }
+  // "route" 指定時は2つのマスの間の最短距離を表示して終了
+  if ((args.size() >= 5) && (args[0] == "route")) {
+    return runRoute(landmarks, args);
+  }
+  // "tour" 指定時は初期位置から全ランドマークを回る最短の順番を表示して終了
+  if ((args.size() >= 1) && (args[0] == "tour")) {
+    return runTour(landmarks);
+  }
+  // "traffic" 指定時は多数の車を同じマップで走らせ、処理速度と渋滞の度合いを表示して終了
+  if ((args.size() >= 3) && (args[0] == "traffic")) {
+    return runTrafficMode(args);
+  }
+  // "replay" 指定時はリプレイ記録を再実行して結果を確かめる（手数を指定した場合はその時点の状態を表示する）
+  if ((args.size() >= 2) && (args[0] == "replay")) {
+    return runReplay(landmarks, args);
+  }
+  // "playout" 指定時はランダムなプレイアウトを繰り返し、到達率や手数の分布から難しさを表示して終了
+  if ((args.size() >= 2) && (args[0] == "playout")) {
+    return runPlayout(landmarks, args, heatmap_path);
+  }
+  // "serve" 指定時は接続ごとにゲームを進めるサーバとして動き、終了時に集計を表示する
+  if ((args.size() >= 2) && (args[0] == "serve")) {
+    return runServe(landmarks, args, heatmap_path, cache_path);
+  }
+  // "realtime" 指定時は一定の間隔のティックでゲームを進め（入力と描画は別のスレッド）、終了時にティックの集計を表示する
+  if ((args.size() >= 1) && (args[0] == "realtime")) {
+    return runRealtimeMode(landmarks, args, record_path, cache_path);
+  }
+  // "export-map" 指定時は使用中のマップをマップファイルに書き出して終了
+  if ((args.size() >= 2) && (args[0] == "export-map")) {
+    try {
+      saveMapFile(args[1], landmark_list);
+    } catch (const std::runtime_error& e) {
+      std::cerr << "Error: " << e.what() << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+
   // コマンド受付→行動のルーチン開始
-  Position pos {initial_x, initial_y, initial_direction};
-  unsigned int speed {min_speed};
-  unsigned int steps {0};
-  int fuel {fuel_init};
+  GameState state = initialGameState();
+  FrameRenderer renderer {};
+  initRenderer(renderer, STDOUT_FILENO);
+  std::string message;
+  // ヒント用の道路グラフは初めてヒントを求められた時に作る（キャッシュがあれば読み込む）
+  RoadGraph graph {};
+  RouteWorkspace workspace {};
+  // ゲームを進めたコマンドはすべてリプレイ記録に残す（書き込めない場合は記録せずに続ける）
+  ReplayRecorder recorder {};
+  try {
+    startReplayRecord(recorder, record_path, landmarks);
+  } catch (const std::runtime_error& e) {
+    std::cerr << "Warning: " << e.what() << std::endl;
+  }
+  // 残りの燃料で回り切れるかを毎手確かめるため、ランドマークごとの距離場を作っておく
+  LandmarkFields fields {};
+  prepareLandmarkFields(fields, landmarks, cache_path);
+  message = finishWarning(fields, landmarks, state);
+  // 手の取り消し・やり直しの履歴
+  MoveHistory history {};
+  initMoveHistory(history);
+  StepOutcome outcome {StepOutcome::Continue};
   while (true) {
     // 情報提示
-    displayMap(landmarks, pos);
-    std::cout << "Step: " << steps << ", Fuel: " << fuel << ", Position: (" << pos.x << ", " << pos.y << "), "
-              << "Direction: " << direction2str(pos.direction) << ", Speed: " << speed << ", "
-              << lookforNearLandmark(landmarks, pos) << std::endl;
+    renderFrame(renderer, landmarks, state, message);
+    PROFILE_COUNT("main.frames", 1);
+    message.clear();
 
-    // ユーザのコマンドを受け付け
+    // ユーザのコマンドを受け付け、1手進める（表示の切替は手数を消費しない）
     Command user_command = input_user_command();
-
-    // コマンドに応じた処理
-    if (user_command == Command::TurnLeft) {
-      if (is_turn_left_enable(pos)) {
-        try {
-          pos = calcNextPositon(pos, user_command, speed);
-        } catch (const std::runtime_error& e) {
-          std::cerr << "Game Over: " << e.what() << std::endl;
-          break;
-        } catch (const std::logic_error& e) {
-          std::cerr << "Error: " << e.what() << std::endl;
-          return 1;
-        }
-      } else {
-        // 左折できない位置ならコマンド入力からやり直し
-        std::cout << "Can't turn left here." << std::endl;
-      }
-    } else if (user_command == Command::TurnRight) {
-      if (is_turn_right_enable(pos)) {
-        try {
-          pos = calcNextPositon(pos, user_command, speed);
-        } catch (const std::runtime_error& e) {
-          std::cerr << "Game Over: " << e.what() << std::endl;
-          break;
-        } catch (const std::logic_error& e) {
-          std::cerr << "Error: " << e.what() << std::endl;
-          return 1;
-        }
-      } else {
-        // 右折できない位置ならコマンド入力からやり直し
-        std::cout << "Can't turn right here." << std::endl;
-      }
-    } else if (user_command == Command::ContinueStraight) {
-      if (is_continue_straight_enable(pos)) {
-        try {
-          pos = calcNextPositon(pos, user_command, speed);
-        } catch (const std::runtime_error& e) {
-          std::cerr << "Game Over: " << e.what() << std::endl;
-          break;
-        } catch (const std::logic_error& e) {
-          std::cerr << "Error: " << e.what() << std::endl;
-          return 1;
-        }
-      } else {
-        // 直進できない位置ならコマンド入力からやり直し
-        std::cout << "Can't continue straight here." << std::endl;
+    PROFILE_SCOPE("main.command");
+    if (user_command == Command::ToggleOverview) {
+      toggleOverview(renderer);
+      continue;
+    }
+    if (user_command == Command::Hint) {
+      if (graph.nodes.empty()) {
+        prepareRoadGraph(graph, landmarks, cache_path);
+        initRouteWorkspace(workspace, graph);
       }
-    } else if (user_command == Command::Accelerate) {
-      if (is_continue_straight_enable(pos)) {
-        // 先にスピード設定値アップ
-        if (speed < max_speed) {
-          speed++;
-        }
-        // 直進する
+      message = tourHint(graph, workspace, landmarks, state.pos);
+      continue;
+    }
+    if (is_history_command(user_command)) {
+      // 取り消しは取り消しのコマンドとして、やり直しはやり直す手のコマンドとして記録する
+      // 取り消し・やり直しができない場合はゲームが進まないので記録しない
+      bool can_move = (user_command == Command::Undo) ? (history.position > 0) : (history.position < history.size);
+      if (can_move) {
         try {
-          pos = calcNextPositon(pos, Command::ContinueStraight, speed);
+          recordCommand(recorder, state, landmarks,
+                        (user_command == Command::Undo) ? Command::Undo : history.entries[history.position].command);
         } catch (const std::runtime_error& e) {
-          std::cerr << "Game Over: " << e.what() << std::endl;
-          break;
-        } catch (const std::logic_error& e) {
-          std::cerr << "Error: " << e.what() << std::endl;
-          return 1;
+          std::cerr << "Warning: " << e.what() << std::endl;
+          recorder.file.close();
         }
-      } else {
-        // 直進できない位置なら加速も不可、コマンド入力からやり直し
-        std::cout << "Can't accelerate here." << std::endl;
       }
-    } else if (user_command == Command::Decelerate) {
-      if (is_continue_straight_enable(pos)) {
-        // 先にスピード設定値ダウン
-        if (speed > min_speed) {
-          speed--;
-        }
-        // 直進する
-        try {
-          pos = calcNextPositon(pos, Command::ContinueStraight, speed);
-        } catch (const std::runtime_error& e) {
-          std::cerr << "Game Over: " << e.what() << std::endl;
-          break;
-        } catch (const std::logic_error& e) {
-          std::cerr << "Error: " << e.what() << std::endl;
-          return 1;
-        }
+      if (user_command == Command::Undo) {
+        message = undoMove(history, state, landmarks) ? "Undid the last move." : "Nothing to undo.";
       } else {
-        // 直進できない位置なら減速も不可、コマンド入力からやり直し
-        std::cout << "Can't decelerate here." << std::endl;
+        message = redoMove(history, state, landmarks) ? "Redid the move." : "Nothing to redo.";
       }
-    } else if (user_command == Command::Stop) {
-      speed = 0;
-    } else {
-      // ここに来るのは (user_command == Command::GameEnd) の時だけ
-      break;
+      continue;
     }
+    try {
+      recordCommand(recorder, state, landmarks, user_command);
+    } catch (const std::runtime_error& e) {
+      // 書き込めなくなった記録は閉じ、以降は記録せずにゲームを続ける
+      std::cerr << "Warning: " << e.what() << std::endl;
+      recorder.file.close();
+    }
+    outcome = stepGameWithHistory(history, state, landmarks, user_command);
 
-    // 燃料消費量の計算と反映
-    fuel -= fuel_consumption[speed];
-    if (fuel <= 0) {
+    // 結果に応じた表示
+    if (outcome == StepOutcome::CommandRejected) {
+      // 実行できない位置ならコマンド入力からやり直し（メッセージは次のフレームと一緒に表示）
+      message = rejectedMessage(user_command);
+    } else if (outcome == StepOutcome::OffRoad) {
+      std::cerr << "Game Over: Over speeding and went off the road." << std::endl;
+      break;
+    } else if (outcome == StepOutcome::FuelOut) {
       std::cout << "Game Over: Fuel has run out." << std::endl;
       break;
-    }
-
-    // step数をインクリメント
-    steps++;
-
-    // ランドマークに到達したかのチェック
-    if (judgeArriveLandmarks(landmarks, pos)) {
+    } else if (outcome == StepOutcome::AllArrived) {
       std::cout << "All landmerks reached. Congratulations!" << std::endl;
-      std::cout << "Your score: " << steps << " steps, " << fuel << " remaining fuel." << std::endl; 
+      std::cout << "Your score: " << state.steps << " steps, " << state.fuel << " remaining fuel." << std::endl; 
+      break;
+    } else if (outcome == StepOutcome::Quit) {
       break;
     }
+
+    // 回り切れなくなっていれば警告する（燃料は減る一方なので、以降は毎手表示される）
+    std::string warning = finishWarning(fields, landmarks, state);
+    if (!warning.empty()) {
+      message += (message.empty() ? "" : " ") + warning;
+    }
   }
 
+  try {
+    finishReplayRecord(recorder, state, outcome);
+  } catch (const std::runtime_error& e) {
+    std::cerr << "Warning: " << e.what() << std::endl;
+  }
   std::cout << "bye!" << std::endl;
   return 0;
 }
 
 
-// ランドマークを設定する関数
+// ランドマークを設定する関数（標準マップのランドマークはmap.hppのstock_landmarksで変更する）
 void setLandmerks(std::vector<LandMark>& landmarks) {
-  // 初期化は 名称, X座標, Y座標, false の順
-  LandMark lm1 {"tokyo tower", 7, 19, false};
-  landmarks.push_back(lm1);
-  LandMark lm2 {"tokyo sky tree", 6, 40, false};
-  landmarks.push_back(lm2);
-  LandMark lm3 {"shiba-koen", 19, 12, false};
-  landmarks.push_back(lm3);
-  LandMark lm4 {"nihon-bashi", 57, 12, false};
-  landmarks.push_back(lm4);
-  LandMark lm5 {"bay bridge", 97, 49, false};
-  landmarks.push_back(lm5);
-  LandMark lm6 {"kawasaki-daishi", 44, 41, false};
-  landmarks.push_back(lm6);
-  LandMark lm7 {"tokyo dome", 76, 22, false};
-  landmarks.push_back(lm7);
+  for (const StockLandmark& lm : stock_landmarks) {
+    landmarks.push_back(LandMark {lm.name, lm.x, lm.y});
+  }
 }
 
 
 // ユーザの入力を受け付けて左折, 右折, 直進, 加速, 減速, 停止, ゲーム終了のいずれのコマンドかを解釈する関数
 Command input_user_command(void) {
+  PROFILE_SCOPE("main.input");
   Command user_command {};
   std::string user_input {};
 
   // 正常なコマンドを受け付けるまで繰り返す
   while (true) {
     std::cout << "Command: ";
-    std::getline(std::cin, user_input);  // 空白含めて入力を受け付ける
-  
-    if ((user_input == "turn left") || (user_input == "l") ) {
-      user_command = Command::TurnLeft;
-      break;
-    } else if ((user_input == "turn right") || (user_input == "r") ) {
-      user_command = Command::TurnRight;
-      break;
-    } else if ((user_input == "continue straight") || (user_input == "c") ) {
-      user_command = Command::ContinueStraight;
-      break;
-    } else if ((user_input == "accelerate") || (user_input == "a") ) {
-      user_command = Command::Accelerate;
-      break;
-    } else if ((user_input == "decelerate") || (user_input == "d") ) {
-      user_command = Command::Decelerate;
-      break;
-    } else if ((user_input == "stop") || (user_input == "s") ) {
-      user_command = Command::Stop;
-      break;
-    } else if (user_input == "game end") {
+    if (!std::getline(std::cin, user_input)) {  // 空白含めて入力を受け付ける
+      // 入力が終了した場合はゲーム終了として扱う
       user_command = Command::GameEnd;
       break;
-    } else {
-      // 不正な入力の場合は再入力を促す
-      std::cout << "Invalid command is input. Please retry." << std::endl;
     }
+
+    if (str2command(user_input, user_command)) {
+      break;
+    }
+    // 不正な入力の場合は再入力を促す
+    PROFILE_COUNT("input.invalid", 1);
+    std::cout << "Invalid command is input. Please retry." << std::endl;
   }
   return user_command;
 }
 
-// コマンドに応じて次の自己位置を計算する関数
-// スピード出しすぎで道路外に出た場合はruntime_errorを返す
-Position calcNextPositon(Position pos, Command user_command, unsigned int speed) {
-  Position next_pos {pos};
-
-  // speedの数ぶん進めるが、路外逸脱判定のために処理は1マスずつ行う
-  // TurnLeft, Rightはすでに進む先があることを確認してからここに来るので、再度の確認は不要
-  // Straightの2マス目以降のみ、進めるかの確認をしながらposを動かしていく
-  for (int i = 0; i < speed; i++) {
-    if (user_command == Command::TurnLeft) {
-      if (pos.direction == Direction::North) {
-        next_pos.direction = Direction::West;
-        next_pos.x = pos.x - 1;
-        next_pos.y = pos.y;
-      } else if (pos.direction == Direction::South) {
-        next_pos.direction = Direction::East;
-        next_pos.x = pos.x + 1;
-        next_pos.y = pos.y;
-      } else if (pos.direction == Direction::East) {
-        next_pos.direction = Direction::North;
-        next_pos.x = pos.x;
-        next_pos.y = pos.y - 1;
-      } else {  //  == Direction::West
-        next_pos.direction = Direction::South;
-        next_pos.x = pos.x;
-        next_pos.y = pos.y + 1;
+// 最短手数とそのコマンド列を探索して表示する関数
+int runSolver(const LandmarkIndex& landmarks) {
+  SolveResult result {};
+  try {
+    result = solveOptimalRoute(landmarks, 0);
+  } catch (const std::runtime_error& e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+
+  if (!result.is_solved) {
+    std::cout << "No route can reach all landmarks." << std::endl;
+    return 0;
+  }
+  std::cout << "Minimum steps: " << result.steps << ", Remaining fuel: " << result.fuel << std::endl;
+  std::cout << "Commands:";
+  for (Command command : result.commands) {
+    std::cout << " " << command2str(command);
+  }
+  std::cout << std::endl;
+  return 0;
+}
+
+// コマンドスクリプト（1行1コマンド、入力と同じ書式）を画面表示なしで実行する関数
+// repeat回繰り返して実行し、最後の結果とシミュレーション速度を表示する
+int runBatch(LandmarkIndex& landmarks, const std::string& script_path, unsigned long repeat) {
+  // スクリプトは事前にすべてCommandへ変換しておく（空行と#から始まる行、表示のみのコマンドは無視）
+  std::ifstream script(script_path);
+  if (!script) {
+    std::cerr << "Error: Can't open script \"" << script_path << "\"." << std::endl;
+    return 1;
+  }
+  std::vector<Command> commands;
+  std::string line;
+  for (unsigned int line_no = 1; std::getline(script, line); line_no++) {
+    if (line.empty() || (line[0] == '#')) {
+      continue;
+    }
+    Command command {};
+    if (!str2command(line, command)) {
+      std::cerr << "Error: Invalid command \"" << line << "\" at line " << line_no << "." << std::endl;
+      return 1;
+    }
+    // 表示のみのコマンドは無視する
+    if (!is_display_command(command)) {
+      commands.push_back(command);
+    }
+  }
+
+  GameState state {};
+  StepOutcome outcome {StepOutcome::Continue};
+  MoveHistory history {};
+  unsigned long long total_steps {0};
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned long r = 0; r < repeat; r++) {
+    // 1回ごとに初期状態へ戻す
+    state = initialGameState();
+    resetArrived(landmarks);
+    initMoveHistory(history);
+    outcome = StepOutcome::Continue;
+    for (Command command : commands) {
+      if (command == Command::Undo) {
+        undoMove(history, state, landmarks);
+        continue;
+      } else if (command == Command::Redo) {
+        redoMove(history, state, landmarks);
+        continue;
       }
-    } else if (user_command == Command::TurnRight) {
-      if (pos.direction == Direction::North) {
-        next_pos.direction = Direction::East;
-        next_pos.x = pos.x + 1;
-        next_pos.y = pos.y;
-      } else if (pos.direction == Direction::South) {
-        next_pos.direction = Direction::West;
-        next_pos.x = pos.x - 1;
-        next_pos.y = pos.y;
-      } else if (pos.direction == Direction::East) {
-        next_pos.direction = Direction::South;
-        next_pos.x = pos.x;
-        next_pos.y = pos.y + 1;
-      } else {  //  == Direction::West
-        next_pos.direction = Direction::North;
-        next_pos.x = pos.x;
-        next_pos.y = pos.y - 1;
+      outcome = stepGameWithHistory(history, state, landmarks, command);
+      total_steps++;
+      if ((outcome != StepOutcome::Continue) && (outcome != StepOutcome::CommandRejected)) {
+        break;
       }
-    } else if (user_command == Command::ContinueStraight) {
-      if (is_continue_straight_enable(pos)) {
-        next_pos.direction = pos.direction;
-        if (pos.direction == Direction::North) {
-          next_pos.x = pos.x;
-          next_pos.y = pos.y - 1;
-        } else if (pos.direction == Direction::South) {
-          next_pos.x = pos.x;
-          next_pos.y = pos.y + 1;
-        } else if (pos.direction == Direction::East) {
-          next_pos.x = pos.x + 1;
-          next_pos.y = pos.y;
-        } else {  //  == Direction::West
-          next_pos.x = pos.x - 1;
-          next_pos.y = pos.y;
-        }
-      } else {
-        // speedが2以上であることによって、道路外へ出るとここに来る
-        throw std::runtime_error("Over speeding and went off the road.");
+    }
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  // 結果の表示
+  std::cout << "Result: " << outcomeText(outcome) << ", Steps: " << state.steps << ", Fuel: " << state.fuel << std::endl;
+  std::cout << "Simulated " << total_steps << " commands in " << elapsed.count() << " s ("
+            << (total_steps / std::max(elapsed.count(), 1e-9) / 1e6) << " M commands/s)" << std::endl;
+  return 0;
+}
+
+// ゲームの結果の表示用の文字列を返す関数
+std::string outcomeText(StepOutcome outcome) {
+  std::string str;
+
+  if (outcome == StepOutcome::AllArrived) {
+    str = "All landmarks reached";
+  } else if (outcome == StepOutcome::OffRoad) {
+    str = "Over speeding and went off the road";
+  } else if (outcome == StepOutcome::FuelOut) {
+    str = "Fuel has run out";
+  } else if (outcome == StepOutcome::Quit) {
+    str = "Game ended by command";
+  } else {
+    str = "Script finished before the goal";
+  }
+  return str;
+}
+
+// 道路グラフの大きさと作成時間、初期位置・ランドマーク間の距離表を表示する関数
+int runDistances(const LandmarkIndex& landmarks) {
+  RoadGraph graph {};
+  auto start = std::chrono::steady_clock::now();
+  buildRoadGraph(graph, landmarks);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << "Road graph: " << graph.nodes.size() << " nodes, " << graph.num_edges << " edges, "
+            << graph.num_shortcuts << " shortcuts (built in " << elapsed.count() << " s)" << std::endl;
+
+  // 経路の無い組は - で表示する
+  auto print_row = [&](const std::string& name, const uint32_t* row) {
+    std::cout << name << ":";
+    for (unsigned int j = 0; j < graph.num_landmarks; j++) {
+      std::cout << " " << ((row[j] == no_route) ? std::string("-") : std::to_string(row[j]));
+    }
+    std::cout << std::endl;
+  };
+  print_row("start", graph.start_distances.data());
+  for (unsigned int i = 0; i < graph.num_landmarks; i++) {
+    print_row(landmarks.landmarks[i].name, &graph.landmark_distances[static_cast<size_t>(i) * graph.num_landmarks]);
+  }
+  return 0;
+}
+
+// 2つのマスの間の最短距離と問い合わせ時間を表示する関数
+int runRoute(const LandmarkIndex& landmarks, const std::vector<std::string>& args) {
+  GraphNode from {};
+  GraphNode to {};
+  try {
+    from = GraphNode {static_cast<unsigned int>(parseCount(args[1], std::numeric_limits<unsigned int>::max())), static_cast<unsigned int>(parseCount(args[2], std::numeric_limits<unsigned int>::max()))};
+    to = GraphNode {static_cast<unsigned int>(parseCount(args[3], std::numeric_limits<unsigned int>::max())), static_cast<unsigned int>(parseCount(args[4], std::numeric_limits<unsigned int>::max()))};
+  } catch (const std::logic_error&) {
+    std::cerr << "Error: Invalid coordinates." << std::endl;
+    return 1;
+  }
+
+  RoadGraph graph {};
+  buildRoadGraph(graph, landmarks);
+  RouteWorkspace workspace {};
+  initRouteWorkspace(workspace, graph);
+  auto start = std::chrono::steady_clock::now();
+  uint32_t distance = routeDistance(graph, workspace, from, to);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  if (distance == no_route) {
+    std::cout << "No route";
+  } else {
+    std::cout << "Distance: " << distance << " cells";
+  }
+  std::cout << " (query " << (elapsed.count() * 1e6) << " us)" << std::endl;
+  return 0;
+}
+
+// 初期位置から全ランドマークを回る最短の順番と道のり、計算時間を表示する関数
+int runTour(const LandmarkIndex& landmarks) {
+  RoadGraph graph {};
+  buildRoadGraph(graph, landmarks);
+  std::vector<uint32_t> start_distances = graph.start_distances;
+  auto start = std::chrono::steady_clock::now();
+  TourResult tour = optimizeTour(start_distances, graph.landmark_distances, exact_tour_limit, 0);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  if (tour.distance == no_route) {
+    std::cout << "No route can reach all landmarks." << std::endl;
+    return 0;
+  }
+  std::cout << "Tour: " << tour.distance << " cells (" << (tour.is_exact ? "exact" : "heuristic")
+            << ", solved in " << elapsed.count() << " s)" << std::endl;
+  uint32_t total {0};
+  for (size_t k = 0; k < tour.order.size(); k++) {
+    unsigned int i = tour.order[k];
+    total += (k == 0) ? graph.start_distances[i] : landmarkDistance(graph, tour.order[k - 1], i);
+    std::cout << (k + 1) << ". " << landmarks.landmarks[i].name << " (" << total << " cells)" << std::endl;
+  }
+  return 0;
+}
+
+// 交通シミュレーションを実行し、ティックの処理速度と車が待った割合を表示する関数
+int runTrafficMode(const std::vector<std::string>& args) {
+  size_t num_cars {};
+  unsigned int ticks {};
+  unsigned int num_threads {0};
+  try {
+    num_cars = parseCount(args[1], std::numeric_limits<size_t>::max());
+    ticks = parseCount(args[2], std::numeric_limits<unsigned int>::max());
+    if (args.size() >= 4) {
+      num_threads = parseCount(args[3], std::numeric_limits<unsigned int>::max());
+    }
+  } catch (const std::logic_error&) {
+    std::cerr << "Error: Invalid traffic parameters." << std::endl;
+    return 1;
+  }
+
+  TrafficSim sim {};
+  try {
+    initTraffic(sim, num_cars, 1);
+  } catch (const std::runtime_error& e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+  auto start = std::chrono::steady_clock::now();
+  runTraffic(sim, ticks, num_threads);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  unsigned long long moves {0};
+  unsigned long long waits {0};
+  for (size_t b = 0; b < sim.band_moves.size(); b++) {
+    moves += sim.band_moves[b];
+    waits += sim.band_waits[b];
+  }
+  double seconds = std::max(elapsed.count(), 1e-9);
+  std::cout << "Traffic: " << num_cars << " cars, " << ticks << " ticks in " << elapsed.count() << " s ("
+            << (ticks / seconds) << " ticks/s, " << (num_cars * static_cast<double>(ticks) / seconds / 1e6) << " M car-moves/s)" << std::endl;
+  std::cout << "Waited: " << (100.0 * waits / std::max(moves + waits, 1ull)) << " % of car-moves" << std::endl;
+  return 0;
+}
+
+// リプレイ記録を再実行する関数
+// 手数の指定が無ければ最後まで再実行して記録された結果と照合し、指定があればその手数の後の状態を表示する
+int runReplay(LandmarkIndex& landmarks, const std::vector<std::string>& args) {
+  ReplayLog log {};
+  GameState state {};
+  try {
+    openReplayLog(log, args[1], landmarks);
+    std::cout << "Replay: " << log.total << " commands, " << log.num_blocks << " checkpoints" << std::endl;
+
+    if (args.size() >= 3) {
+      uint64_t commands = parseCount(args[2], std::numeric_limits<uint64_t>::max());
+      if (commands > log.total) {
+        std::cerr << "Error: The replay log has only " << log.total << " commands." << std::endl;
+        return 1;
       }
-    } else {
-      // 左折、右折、直進以外でここに来ることは無いので、来た場合はlogic_errorを返す。
-      throw std::logic_error("calcNextPositon() was called with unexpected Command.");
+      auto start = std::chrono::steady_clock::now();
+      replayTo(log, landmarks, commands, state);
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      std::cout << "After " << commands << " commands: X=" << state.pos.x << ", Y=" << state.pos.y
+                << ", Direction: " << direction2str(state.pos.direction) << ", Speed: " << state.speed
+                << ", Steps: " << state.steps << ", Fuel: " << state.fuel
+                << ", Landmarks: " << landmarks.arrived_count << "/" << landmarks.landmarks.size()
+                << " (" << (elapsed.count() * 1e6) << " us)" << std::endl;
+      return 0;
     }
 
-    // speedが2以上の時は、ContinueStraightの処理を繰り返すことで1マスずつ進める
-    // 1マスずつ進めることで、道路外へ出た場合の検出を容易にする
-    user_command = Command::ContinueStraight;
-    pos = next_pos;
+    StepOutcome outcome {};
+    auto start = std::chrono::steady_clock::now();
+    replayAll(log, landmarks, state, outcome);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Result: " << outcomeText(outcome) << ", Steps: " << state.steps << ", Fuel: " << state.fuel << std::endl;
+    std::cout << "Replayed " << log.total << " commands in " << elapsed.count() << " s ("
+              << (log.total / std::max(elapsed.count(), 1e-9) / 1e6) << " M commands/s)" << std::endl;
+    if ((outcome != log.outcome) || (state.steps != log.steps) || (state.fuel != log.fuel)) {
+      std::cout << "Mismatch: recorded " << outcomeText(log.outcome) << ", Steps: " << log.steps << ", Fuel: " << log.fuel << std::endl;
+      return 1;
+    }
+    std::cout << "Verified: the replayed score matches the record." << std::endl;
+  } catch (const std::logic_error&) {
+    std::cerr << "Error: Invalid command count." << std::endl;
+    return 1;
+  } catch (const std::runtime_error& e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+// 地図を生成して検証し、マップファイルに書き出す関数
+// 生成条件（サイズ・ランドマーク数・種）とスレッド数は引数で指定し、間隔などは既定値を使う
+int runGenerate(const std::vector<std::string>& args) {
+  MapGenConfig config {0, 0, 0, 1, default_min_gap, default_max_gap, default_removal_percent};
+  unsigned int num_threads {0};
+  try {
+    config.size_x = parseCount(args[2], std::numeric_limits<unsigned int>::max());
+    config.size_y = parseCount(args[3], std::numeric_limits<unsigned int>::max());
+    config.num_landmarks = parseCount(args[4], std::numeric_limits<unsigned int>::max());
+    if (args.size() >= 6) {
+      config.seed = parseCount(args[5], std::numeric_limits<uint64_t>::max());
+    }
+    if (args.size() >= 7) {
+      num_threads = parseCount(args[6], std::numeric_limits<unsigned int>::max());
+    }
+  } catch (const std::logic_error&) {
+    std::cerr << "Error: Invalid generate parameters." << std::endl;
+    return 1;
+  }
+
+  std::vector<LandMark> landmark_list;
+  LandmarkIndex landmarks {};
+  try {
+    auto start = std::chrono::steady_clock::now();
+    generateMap(config, landmark_list, num_threads);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Generated " << config.size_x << "x" << config.size_y << " map with " << landmark_list.size()
+              << " landmarks (seed " << config.seed << ") in " << elapsed.count() << " s" << std::endl;
+
+    // 生成した地図も読み込む時と同じ検証を通す
+    buildLandmarkIndex(landmarks, landmark_list);
+    validateMap();
+    validateLandmarks(landmarks);
+    validateInitialPosition();
+    validateReachability(landmarks);
+    saveMapFile(args[1], landmark_list);
+  } catch (const std::runtime_error& e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+
+  // 燃料が足りない地図は、ゲームを進めるモードでは読み込めないので知らせておく
+  int bound = fuelLowerBound(landmarks);
+  if (bound >= fuel_init) {
+    std::cout << "Note: At least " << bound << " fuel is needed to visit all landmarks (fuel_init is " << fuel_init
+              << "), so the map can only be used by distances, route, tour, traffic and export-map." << std::endl;
+  }
+  return 0;
+}
+
+// サーバを実行し、SIGINTかSIGTERMで終了した後に集計を表示する関数
+// heatmap_pathを指定した場合は、全セッションの軌跡も集計して書き出す
+int runServe(const LandmarkIndex& landmarks, const std::vector<std::string>& args, const std::string& heatmap_path, const std::string& cache_path) {
+  TrajectoryAnalytics trajectories {};
+  ServerConfig config {args[1], 0, heatmap_path.empty() ? nullptr : &trajectories, cache_path};
+  ServerStats stats {};
+  try {
+    if (args.size() >= 3) {
+      config.num_threads = parseCount(args[2], std::numeric_limits<unsigned int>::max());
+    }
+    std::cout << "Serving on " << config.address << " (stop with Ctrl+C)" << std::endl;
+    runServer(config, landmarks, stats);
+  } catch (const std::logic_error&) {
+    std::cerr << "Error: Invalid serve parameters." << std::endl;
+    return 1;
+  } catch (const std::runtime_error& e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+
+  std::cout << "Sessions: " << stats.sessions << " (peak " << stats.peak_sessions << " concurrent), Commands: " << stats.commands
+            << " in " << stats.seconds << " s" << std::endl;
+  std::cout << "Command latency: p50 " << stats.p50_us << " us, p99 " << stats.p99_us << " us (in server)" << std::endl;
+  return heatmap_path.empty() ? 0 : reportTrajectories(trajectories, heatmap_path);
+}
+
+// ランダムなプレイアウトを繰り返し、結果の割合と全ランドマークに到達した時の手数の分布、処理速度を表示する関数
+// heatmap_pathを指定した場合は、全プレイアウトの軌跡も集計して書き出す
+int runPlayout(const LandmarkIndex& landmarks, const std::vector<std::string>& args, const std::string& heatmap_path) {
+  TrajectoryAnalytics trajectories {};
+  PlayoutConfig config {0, PlayoutPolicy::Safe, 1, 0, heatmap_path.empty() ? nullptr : &trajectories};
+  try {
+    config.num_playouts = parseCount(args[1], std::numeric_limits<uint64_t>::max());
+    if (args.size() >= 3) {
+      if (args[2] == "uniform") {
+        config.policy = PlayoutPolicy::Uniform;
+      } else if (args[2] != "safe") {
+        throw std::invalid_argument(args[2]);
+      }
+    }
+    if (args.size() >= 4) {
+      config.seed = parseCount(args[3], std::numeric_limits<uint64_t>::max());
+    }
+    if (args.size() >= 5) {
+      config.num_threads = parseCount(args[4], std::numeric_limits<unsigned int>::max());
+    }
+  } catch (const std::logic_error&) {
+    std::cerr << "Error: Invalid playout parameters." << std::endl;
+    return 1;
+  }
+
+  PlayoutStats stats {};
+  auto start = std::chrono::steady_clock::now();
+  runPlayouts(config, landmarks, stats);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  auto percent = [&](uint64_t count) { return 100.0 * count / std::max<uint64_t>(stats.playouts, 1); };
+  std::cout << "Playouts: " << stats.playouts << " in " << elapsed.count() << " s ("
+            << (stats.playouts / std::max(elapsed.count(), 1e-9)) << " playouts/s, "
+            << (stats.total_steps / std::max(elapsed.count(), 1e-9) / 1e6) << " M steps/s)" << std::endl;
+  std::cout << "Completed: " << percent(stats.completed) << "%, Off road: " << percent(stats.off_road)
+            << "%, Fuel out: " << percent(stats.fuel_out) << "%" << std::endl;
+  std::cout << "Landmarks reached: " << (static_cast<double>(stats.total_arrived) / std::max<uint64_t>(stats.playouts, 1))
+            << " of " << landmarks.landmarks.size() << " on average" << std::endl;
+  if (stats.completed == 0) {
+    std::cout << "Steps to complete: no playout reached all landmarks" << std::endl;
+  } else {
+    std::cout << "Steps to complete: min " << playoutStepPercentile(stats, 0.0) << ", p10 " << playoutStepPercentile(stats, 0.1)
+              << ", p50 " << playoutStepPercentile(stats, 0.5) << ", p90 " << playoutStepPercentile(stats, 0.9)
+              << ", max " << playoutStepPercentile(stats, 1.0) << std::endl;
+  }
+  return heatmap_path.empty() ? 0 : reportTrajectories(trajectories, heatmap_path);
+}
+
+// 軌跡の集計から、道路外に出た・燃料を使い切った・よく通る場所の上位と、使われなかった道路の数を表示し、
+// 通過数のヒートマップを書き出す関数
+int reportTrajectories(const TrajectoryAnalytics& trajectories, const std::string& heatmap_path) {
+  TrajectoryHeatmap heatmap {};
+  mergeTrajectories(trajectories, heatmap);
+  const unsigned int block = 1u << heatmap.shift;
+  auto print_hotspots = [&](const std::string& title, HotspotKind kind) {
+    std::cout << title << ":";
+    std::vector<TrajectoryHotspot> hotspots = findTrajectoryHotspots(heatmap, kind, trajectory_hotspots);
+    if (hotspots.empty()) {
+      std::cout << " none";
+    }
+    for (const TrajectoryHotspot& hotspot : hotspots) {
+      std::cout << " (" << hotspot.x << ", " << hotspot.y << ") " << hotspot.count;
+    }
+    std::cout << std::endl;
+  };
+  print_hotspots("Off-road hotspots", HotspotKind::OffRoads);
+  print_hotspots("Fuel-out hotspots", HotspotKind::FuelOuts);
+  print_hotspots("Busiest", HotspotKind::Passes);
+  std::cout << "Unused road blocks: " << countUnusedRoadBlocks(heatmap) << " (" << block << "x" << block << " cells each)" << std::endl;
+  try {
+    saveTrajectoryHeatmap(heatmap_path, heatmap);
+  } catch (const std::runtime_error& e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+  std::cout << "Heatmap: " << heatmap_path << " (" << heatmap.width << "x" << heatmap.height << ")" << std::endl;
+  return 0;
+}
+
+// 一定の間隔のティックでゲームを進め、結果とティックの揺らぎ・描画のフレーム数を表示する関数
+int runRealtimeMode(LandmarkIndex& landmarks, const std::vector<std::string>& args, const std::string& record_path, const std::string& cache_path) {
+  RealtimeConfig config {default_tick_hz, default_ticks_per_step, STDIN_FILENO, STDOUT_FILENO};
+  try {
+    if (args.size() >= 2) {
+      config.tick_hz = parseCount(args[1], std::numeric_limits<unsigned int>::max());
+    }
+    if (args.size() >= 3) {
+      config.ticks_per_step = parseCount(args[2], std::numeric_limits<unsigned int>::max());
+    }
+    if ((config.tick_hz == 0) || (config.ticks_per_step == 0)) {
+      throw std::invalid_argument("zero");
+    }
+  } catch (const std::logic_error&) {
+    std::cerr << "Error: Invalid realtime parameters." << std::endl;
+    return 1;
+  }
+
+  // ゲームを進めたコマンドはすべてリプレイ記録に残す（書き込めない場合は記録せずに続ける）
+  ReplayRecorder recorder {};
+  try {
+    startReplayRecord(recorder, record_path, landmarks);
+  } catch (const std::runtime_error& e) {
+    std::cerr << "Warning: " << e.what() << std::endl;
+  }
+  LandmarkFields fields {};
+  prepareLandmarkFields(fields, landmarks, cache_path);
+
+  RealtimeStats stats {};
+  runRealtime(config, landmarks, fields, recorder, stats);
+  try {
+    finishReplayRecord(recorder, stats.state, stats.outcome);
+  } catch (const std::runtime_error& e) {
+    std::cerr << "Warning: " << e.what() << std::endl;
+  }
+
+  if (stats.outcome == StepOutcome::OffRoad) {
+    std::cerr << "Game Over: Over speeding and went off the road." << std::endl;
+  } else if (stats.outcome == StepOutcome::FuelOut) {
+    std::cout << "Game Over: Fuel has run out." << std::endl;
+  } else if (stats.outcome == StepOutcome::AllArrived) {
+    std::cout << "All landmerks reached. Congratulations!" << std::endl;
+    std::cout << "Your score: " << stats.state.steps << " steps, " << stats.state.fuel << " remaining fuel." << std::endl;
+  }
+  std::cout << "Ticks: " << stats.ticks << " in " << stats.elapsed << " s ("
+            << (stats.ticks / std::max(stats.elapsed, 1e-9)) << " Hz, target " << config.tick_hz << " Hz), Steps: "
+            << stats.state.steps << std::endl;
+  std::cout << "Tick jitter: mean " << (stats.total_jitter_us / std::max<uint64_t>(stats.ticks, 1)) << " us, max "
+            << stats.max_jitter_us << " us, late ticks: " << stats.late_ticks << std::endl;
+  std::cout << "Frames: " << stats.frames_rendered << " rendered, " << stats.frames_dropped << " dropped" << std::endl;
+  std::cout << "bye!" << std::endl;
+  return 0;
+}
+
+// コマンドライン引数の回数や大きさを読む関数
+// 符号・空白・余分な文字を含むものやmax_valueを超えるものは、stoulと同じくlogic_errorの派生例外をthrowする
+uint64_t parseCount(const std::string& text, uint64_t max_value) {
+  uint64_t value {};
+  auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+  if ((error == std::errc::result_out_of_range) || ((error == std::errc {}) && (value > max_value))) {
+    throw std::out_of_range(text);
+  }
+  if ((error != std::errc {}) || (end != text.data() + text.size())) {
+    throw std::invalid_argument(text);
   }
-  return next_pos;
+  return value;
 }
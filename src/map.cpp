@@ -1,11 +1,16 @@
+#include <algorithm>
 #include <array>
+#include <cstring>
+#include <stdexcept>
 #include <vector>
 #include "map.hpp"
+#include "mapcheck.hpp"
+#include "profile.hpp"
 
 // マップの定義
 // 横軸をX, 縦軸をYとして使用する（つまりmap[1][2]はX:2,Y:1）
 // また上を北、右を東、下を北、左を西として使用する
-const std::array<std::array<unsigned int, map_size_x>, map_size_y> map { {
+constexpr std::array<std::array<unsigned int, map_size_x>, map_size_y> map { {
   {1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
   {1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
   {1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0},
@@ -58,238 +63,623 @@ const std::array<std::array<unsigned int, map_size_x>, map_size_y> map { {
   {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1}
 }};
 
-// マップを検証する関数
-void validateMap(void) {
-  for (int i = 0; i < map_size_y; i++) {
-    for (int j = 0; j < map_size_x; j++) {
-      // mapに不正な値(0,1以外)が含まれないかのチェック
-      if ((map[i][j] != 0) && (map[i][j] != 1)) {
-        throw std::runtime_error("Invalid value is included in map X:" + std::to_string(j) + " Y:" + std::to_string(i) + ".");
-      }
+// 標準マップ・初期位置・ランドマーク・燃料の設定をコンパイル時に検証する
+// 失敗した場合は、比較の左辺に問題のあるマスの番号（Y座標 * map_size_x + X座標）またはランドマークの番号が表示される
+static_assert(findInvalidStockValue(map) < 0, "Invalid value (other than 0, 1) is included in map.");
+static_assert(findStockDeadEnd(map) < 0, "Dead end road is included in map.");
+static_assert(is_stock_initial_position_valid(map, initial_x, initial_y, initial_direction),
+              "Initial position must be on the road and face a road cell.");
+static_assert(findInvalidStockLandmark(map, stock_landmarks) < 0, "Landmark is not on the road or shares a cell with another landmark.");
+static_assert(findUnreachableStockRoad(map, initial_x, initial_y, initial_direction) < 0,
+              "Road that can't be reached from the initial position is included in map.");
+static_assert(stockFuelLowerBound(initial_x, initial_y, stock_landmarks) < fuel_init, "fuel_init is not enough to visit all landmarks.");
 
-      // 袋小路が無いかのチェック
-      if (map[i][j] == 1) {
-        // ある道路マスに縦横隣り合う4マス（端の場合2,3マス）の和をとった時、2未満だったら袋小路になっているのでエラーを返す
-        int sum {};
-        if (j == 0) {
-          if (i == 0) {
-            sum = map[i+1][j] + map[i][j+1];
-          } else if (i == (map_size_y - 1)) {
-            sum = map[i-1][j] + map[i][j+1];
-          } else {
-            sum = map[i-1][j] + map[i+1][j] + map[i][j+1];
-          }
-        } else if (j == (map_size_x - 1)) {
-          if (i == 0) {
-            sum = map[i+1][j] + map[i][j-1];
-          } else if (i == (map_size_y - 1)) {
-            sum = map[i-1][j] + map[i][j-1];
-          } else {
-            sum = map[i-1][j] + map[i+1][j] + map[i][j-1];
-          }
-        } else {
-          if (i == 0) {
-            sum = map[i][j-1] + map[i][j+1] + map[i+1][j];
-          } else if (i == (map_size_y - 1)) {
-            sum = map[i][j-1] + map[i][j+1] + map[i-1][j];
-          } else {
-            sum = map[i][j-1] + map[i][j+1] + map[i-1][j] + map[i+1][j];
-          }
+// ゲームで使用する道路ビットマップと初期位置
+BitGrid road_map {};
+StraightRuns straight_runs {};
+Position initial_position {initial_x, initial_y, initial_direction};
+
+// ビットマップを全マス0（全タイルが空タイル）で初期化する関数
+void initBitGrid(BitGrid& grid, unsigned int size_x, unsigned int size_y) {
+  grid.size_x = size_x;
+  grid.size_y = size_y;
+  grid.words_per_row = (size_x + tile_size - 1) / tile_size;
+  grid.tile_rows = (size_y + tile_size - 1) / tile_size;
+  grid.tiles.assign(static_cast<size_t>(grid.words_per_row) * grid.tile_rows, 0);
+  // 本体0番は空タイル
+  grid.owned = std::make_shared<std::vector<uint64_t>>(tile_size, 0);
+  grid.pool = grid.owned->data();
+  grid.mapping.reset();
+}
+
+// ビットマップのワードを設定する関数（空タイルに0以外を書き込む時だけタイル本体を確保する）
+void setGridWord(BitGrid& grid, unsigned int word_x, unsigned int y, uint64_t word) {
+  uint32_t& tile = grid.tiles[static_cast<size_t>(y / tile_size) * grid.words_per_row + word_x];
+  if (tile == 0) {
+    if (word == 0) {
+      return;
+    }
+    tile = grid.owned->size() / tile_size;
+    grid.owned->resize(grid.owned->size() + tile_size, 0);
+    grid.pool = grid.owned->data();
+  }
+  (*grid.owned)[static_cast<size_t>(tile) * tile_size + y % tile_size] = word;
+}
+
+// 道路のあるタイルすべてに本体を確保した、全マス0のビットマップを作る関数
+void initRoadShapedGrid(BitGrid& grid) {
+  initBitGrid(grid, road_map.size_x, road_map.size_y);
+  size_t num_bodies {1};
+  for (size_t i = 0; i < grid.tiles.size(); i++) {
+    if (road_map.tiles[i] != 0) {
+      grid.tiles[i] = num_bodies++;
+    }
+  }
+  grid.owned->resize(num_bodies * tile_size, 0);
+  grid.pool = grid.owned->data();
+}
+
+// 標準マップを道路ビットマップに読み込み、初期位置を設定する関数
+void loadStockMap(void) {
+  initial_position = Position {initial_x, initial_y, initial_direction};
+  initBitGrid(road_map, map_size_x, map_size_y);
+  for (unsigned int i = 0; i < map_size_y; i++) {
+    for (unsigned int j = 0; j < map_size_x; j++) {
+      setGridBit(road_map, j, i, map[i][j] == 1);
+    }
+  }
+  buildStraightRuns();
+}
+
+// 直線の長さの表を作る関数
+// 1つ手前のマスが道路なら、そのマスの長さに1を足して求める
+// 道路マスの番号は行優先の順なので、西隣（東隣）の道路マスの番号は1つ前（後）で、上下の行の同じ列の道路マスの番号はその行のワードの順位から求まる
+// 西と北は上の行から左へ、東と南は下の行から右へ順に求め、道路マスを1回ずつ見るだけで済ませる
+void buildStraightRuns(void) {
+  PROFILE_SCOPE("map.buildStraightRuns");
+  const unsigned int words = road_map.words_per_row;
+  straight_runs.num_road = 0;
+  straight_runs.word_rank.resize(static_cast<size_t>(words) * road_map.size_y);
+  for (unsigned int y = 0; y < road_map.size_y; y++) {
+    for (unsigned int w = 0; w < words; w++) {
+      straight_runs.word_rank[static_cast<size_t>(y) * words + w] = straight_runs.num_road;
+      straight_runs.num_road += __builtin_popcountll(gridWord(road_map, w, y));
+    }
+  }
+  straight_runs.runs.assign(straight_runs.num_road, std::array<uint8_t, 4> {});
+  std::vector<std::array<uint8_t, 4>>& runs = straight_runs.runs;
+  const std::vector<uint32_t>& rank = straight_runs.word_rank;
+  auto extend = [](uint8_t run) { return static_cast<uint8_t>((run < max_straight_run) ? run + 1 : run); };
+
+  for (unsigned int y = 0; y < road_map.size_y; y++) {
+    uint64_t carry {0};  // 西隣のワードの最上位のマス
+    for (unsigned int w = 0; w < words; w++) {
+      const uint64_t bits = gridWord(road_map, w, y);
+      const uint64_t above = (y > 0) ? gridWord(road_map, w, y - 1) : 0;
+      const uint64_t west = bits & ((bits << 1) | carry);
+      const uint64_t north = bits & above;
+      size_t road = rank[static_cast<size_t>(y) * words + w];
+      for (uint64_t rest = bits; rest != 0; rest &= rest - 1, road++) {
+        const uint64_t mask = rest & (~rest + 1);
+        if (west & mask) {
+          runs[road][Direction::West] = extend(runs[road - 1][Direction::West]);
+        }
+        if (north & mask) {
+          const size_t upper = rank[static_cast<size_t>(y - 1) * words + w] + __builtin_popcountll(above & (mask - 1));
+          runs[road][Direction::North] = extend(runs[upper][Direction::North]);
+        }
+      }
+      carry = bits >> 63;
+    }
+  }
+  for (unsigned int y = road_map.size_y; y-- > 0;) {
+    uint64_t carry {0};  // 東隣のワードの最下位のマス
+    for (unsigned int w = words; w-- > 0;) {
+      const uint64_t bits = gridWord(road_map, w, y);
+      const uint64_t below = (y + 1 < road_map.size_y) ? gridWord(road_map, w, y + 1) : 0;
+      const uint64_t east = bits & ((bits >> 1) | (carry << 63));
+      const uint64_t south = bits & below;
+      size_t road = rank[static_cast<size_t>(y) * words + w] + __builtin_popcountll(bits);
+      for (uint64_t rest = bits; rest != 0; ) {
+        const uint64_t mask = uint64_t {1} << (63 - __builtin_clzll(rest));
+        rest &= ~mask;
+        road--;
+        if (east & mask) {
+          runs[road][Direction::East] = extend(runs[road + 1][Direction::East]);
         }
-        if (sum < 2) {
-          throw std::runtime_error("Dead end road included in map X:" + std::to_string(j) + " Y:" + std::to_string(i) + ".");
+        if (south & mask) {
+          const size_t lower = rank[static_cast<size_t>(y + 1) * words + w] + __builtin_popcountll(below & (mask - 1));
+          runs[road][Direction::South] = extend(runs[lower][Direction::South]);
         }
       }
+      carry = bits & 1;
+    }
+  }
+}
+
+// マップを検証する関数
+void validateMap(void) {
+  PROFILE_SCOPE("map.validateMap");
+  for (unsigned int i = 0; i < road_map.size_y; i++) {
+    validateMapRow(i);
+  }
+}
+
+// マップの1行を検証する関数（上下の行も参照するので、その行まで読み込み済みであること）
+// 袋小路（縦横に隣り合う道路マスが2未満の道路マス）が無いかを、64マスずつまとめてビット演算でチェックする
+void validateMapRow(unsigned int y) {
+  const unsigned int words = road_map.words_per_row;
+  for (unsigned int w = 0; w < words; w++) {
+    uint64_t road = gridWord(road_map, w, y);
+    if (road == 0) {
+      continue;
+    }
+
+    // 各マスの上下左右の道路ビット（マップ外は0）
+    uint64_t prev = (w > 0) ? gridWord(road_map, w - 1, y) : 0;
+    uint64_t next = (w + 1 < words) ? gridWord(road_map, w + 1, y) : 0;
+    uint64_t west = (road << 1) | (prev >> 63);
+    uint64_t east = (road >> 1) | (next << 63);
+    uint64_t north = (y > 0) ? gridWord(road_map, w, y - 1) : 0;
+    uint64_t south = (y + 1 < road_map.size_y) ? gridWord(road_map, w, y + 1) : 0;
+
+    // 4ビットのうち2つ以上立っているかを半加算器の要領で求める
+    uint64_t has_two = (west & east) | (north & south) | ((west ^ east) & (north ^ south));
+    uint64_t dead_end = road & ~has_two;
+    if (dead_end != 0) {
+      unsigned int x = w * 64 + __builtin_ctzll(dead_end);
+      throw std::runtime_error("Dead end road included in map X:" + std::to_string(x) + " Y:" + std::to_string(y) + ".");
     }
   }
 }
 
 // ランドマークを検証する関数
-void validateLandmarks(const std::vector<LandMark>& landmarks) {
-  for (int i = 0; i < map_size_y; i++) {
-    for (int j = 0; j < map_size_x; j++) {
-      // ランドマークが道路上にあるかのチェック
-      for (LandMark lm : landmarks) {
-        if ((lm.x == j) && (lm.y == i) && (map[i][j] == 0)) {
-          throw std::runtime_error("Landmark \"" + lm.name + "\" is not on the road.");
-        }
-      }
+void validateLandmarks(const LandmarkIndex& index) {
+  PROFILE_SCOPE("map.validateLandmarks");
+  for (size_t i = 0; i < index.landmarks.size(); i++) {
+    const LandMark& lm = index.landmarks[i];
+    // ランドマークが道路上にあるかのチェック
+    if (!is_road(lm.x, lm.y)) {
+      throw std::runtime_error("Landmark \"" + lm.name + "\" is not on the road.");
+    }
+    // 同じマスに別のランドマークが無いかのチェック
+    int other = findLandmark(index, lm.x, lm.y);
+    if (other != static_cast<int>(i)) {
+      throw std::runtime_error("Landmark \"" + lm.name + "\" is on the same position as \"" + index.landmarks[other].name + "\".");
     }
   }
 }
 
 // 初期位置を検証する関数
 void validateInitialPosition(void) {
-  if ((initial_x >= map_size_x) || (initial_y >= map_size_y)) {
+  if ((initial_position.x >= road_map.size_x) || (initial_position.y >= road_map.size_y)) {
     // 初期位置がマップ範囲外の時
     throw std::runtime_error("Initial position is out of map array.");
   }
-  if (map[initial_y][initial_x] == 0) {
+  if (!is_road(initial_position.x, initial_position.y)) {
     // 初期位置が道路ではないとき
     throw std::runtime_error("Initial position is not on the road.");
   }
-  if (((initial_direction == Direction::North)
-    && ((initial_y == 0) || (map[initial_y - 1][initial_x] == 0)))
-   || ((initial_direction == Direction::South)
-    && ((initial_y == (map_size_y - 1)) || (map[initial_y + 1][initial_x] == 0)))
-   || ((initial_direction == Direction::East)
-    && ((initial_x == (map_size_x - 1)) || (map[initial_y][initial_x + 1] == 0)))
-   || ((initial_direction == Direction::West)
-    && ((initial_x == 0) || (map[initial_y][initial_x - 1] == 0)))) {
+  if (!is_continue_straight_enable(initial_position)) {
     // 初期位置の進行方向が道路ではないとき
     throw std::runtime_error("There is no road in the initial position and direction.");
   }
 }
 
-// マップとランドマーク、自己位置を表示する関数
-// 通れる場所を+、通れない場所を空白で表示する
-// ランドマークはOで表示する
-// 自己位置は向きに応じて記号を変えて表示
-void displayMap(const std::vector<LandMark>& landmarks, const Position& pos) {
-  char disp_char {};
-  for (int i = 0; i < map_size_y; i++) {
-    for (int j = 0; j < map_size_x; j++) {
-      // 表示優先度低：マップ
-      if (map[i][j] == 0) {
-        disp_char = ' ';
-      } else {
-        // validateMapで0,1以外含まれないことを確認済みなので、ここに来るのは1のときのみ
-        disp_char = '+';
-      }
+// genの各ビットから、proのビットが続く限り東（上位ビット）へ塗り広げる関数
+static uint64_t fillEast(uint64_t gen, uint64_t pro) {
+  gen |= pro & (gen << 1);
+  pro &= pro << 1;
+  gen |= pro & (gen << 2);
+  pro &= pro << 2;
+  gen |= pro & (gen << 4);
+  pro &= pro << 4;
+  gen |= pro & (gen << 8);
+  pro &= pro << 8;
+  gen |= pro & (gen << 16);
+  pro &= pro << 16;
+  return gen | (pro & (gen << 32));
+}
 
-      // 表示優先度中：ランドマーク
-      for (LandMark lm : landmarks) {
-        if ((lm.x == j) && (lm.y == i)) {
-          if (lm.is_arrived == false) {
-            disp_char = 'O';
-          } else {
-            disp_char = '@';
-          }
-          break;
-        }
+// genの各ビットから、proのビットが続く限り西（下位ビット）へ塗り広げる関数
+static uint64_t fillWest(uint64_t gen, uint64_t pro) {
+  gen |= pro & (gen >> 1);
+  pro &= pro >> 1;
+  gen |= pro & (gen >> 2);
+  pro &= pro >> 2;
+  gen |= pro & (gen >> 4);
+  pro &= pro >> 4;
+  gen |= pro & (gen >> 8);
+  pro &= pro >> 8;
+  gen |= pro & (gen >> 16);
+  pro &= pro >> 16;
+  return gen | (pro & (gen >> 32));
+}
+
+// 到達可能性を検証する関数
+// 向きごとに「その向きで到達できるマス」のビットマップを持ち、変化が無くなるまで次を繰り返す
+//   上から下へ1行ずつ：北の行から南向きに入れるマス（南向きの直進、東向きの右折、西向きの左折）を加え、行内を塗る
+//   下から上へ1行ずつ：南の行から北向きに入れるマスを加え、行内を塗る
+// 行内では、南北向きのマスから東西へ曲がって入れるマスを加え、東向き・西向きのマスを道路が続く限り塗り広げる
+// 速度を上げると1手で進むマスが増えるだけで行き先は増えないので、1マスずつ進む場合の到達範囲を求めれば足りる
+void validateReachability(const LandmarkIndex& index) {
+  PROFILE_SCOPE("map.validateReachability");
+  const unsigned int words = road_map.words_per_row;
+  const size_t total = static_cast<size_t>(words) * road_map.size_y;
+  std::array<std::vector<uint64_t>, 4> reached;
+  for (std::vector<uint64_t>& grid : reached) {
+    grid.assign(total, 0);
+  }
+  std::vector<uint64_t>& north = reached[Direction::North];
+  std::vector<uint64_t>& south = reached[Direction::South];
+  std::vector<uint64_t>& east = reached[Direction::East];
+  std::vector<uint64_t>& west = reached[Direction::West];
+  reached[initial_position.direction][static_cast<size_t>(initial_position.y) * words + initial_position.x / 64]
+    |= uint64_t {1} << (initial_position.x % 64);
+
+  // 1行の東西向きのマスを塗り広げ、増えたかを返す
+  auto fill_row = [&](unsigned int y) {
+    const size_t row = static_cast<size_t>(y) * words;
+    uint64_t added {0};
+    uint64_t carry_turn {0};
+    uint64_t carry_fill {0};
+    for (unsigned int w = 0; w < words; w++) {
+      uint64_t road = gridWord(road_map, w, y);
+      uint64_t turning = north[row + w] | south[row + w];
+      uint64_t seeds = east[row + w] | (((turning << 1) | carry_turn | carry_fill) & road);
+      carry_turn = turning >> 63;
+      uint64_t filled = fillEast(seeds, road);
+      carry_fill = filled >> 63;
+      added |= filled & ~east[row + w];
+      east[row + w] = filled;
+    }
+    carry_turn = 0;
+    carry_fill = 0;
+    for (unsigned int w = words; w-- > 0;) {
+      uint64_t road = gridWord(road_map, w, y);
+      uint64_t turning = north[row + w] | south[row + w];
+      uint64_t seeds = west[row + w] | (((turning >> 1) | carry_turn | carry_fill) & road);
+      carry_turn = turning << 63;
+      uint64_t filled = fillWest(seeds, road);
+      carry_fill = filled << 63;
+      added |= filled & ~west[row + w];
+      west[row + w] = filled;
+    }
+    return added != 0;
+  };
+  // 隣の行から南北向きに入れるマスを加え、増えたかを返す
+  auto enter_row = [&](std::vector<uint64_t>& grid, unsigned int y, unsigned int from) {
+    uint64_t added {0};
+    for (unsigned int w = 0; w < words; w++) {
+      size_t i = static_cast<size_t>(y) * words + w;
+      size_t j = static_cast<size_t>(from) * words + w;
+      uint64_t entered = (grid[j] | east[j] | west[j]) & gridWord(road_map, w, y) & ~grid[i];
+      added |= entered;
+      grid[i] |= entered;
+    }
+    return added != 0;
+  };
+
+  bool changed {true};
+  while (changed) {
+    changed = false;
+    for (unsigned int y = 0; y < road_map.size_y; y++) {
+      if (y > 0) {
+        changed |= enter_row(south, y, y - 1);
       }
+      changed |= fill_row(y);
+    }
+    for (unsigned int y = road_map.size_y; y-- > 0;) {
+      if (y + 1 < road_map.size_y) {
+        changed |= enter_row(north, y, y + 1);
+      }
+      changed |= fill_row(y);
+    }
+  }
 
-      // 表示優先度高：自己位置
-      if ((pos.x == j) && (pos.y == i)) {
-        if (pos.direction == Direction::North) {
-          disp_char = '^';
-        } else if (pos.direction == Direction::South) {
-          disp_char = 'v';
-        } else if (pos.direction == Direction::East) {
-          disp_char = '>';
-        } else {  // (direction == Direction::West)
-          disp_char = '<';
-        }
+  // どの向きでも到達できないランドマーク・道路マスが無いかを確かめる
+  auto is_reached = [&](unsigned int x, unsigned int y) {
+    size_t i = static_cast<size_t>(y) * words + x / 64;
+    return (((north[i] | south[i] | east[i] | west[i]) >> (x % 64)) & 1) != 0;
+  };
+  for (const LandMark& lm : index.landmarks) {
+    if (!is_reached(lm.x, lm.y)) {
+      throw std::runtime_error("Landmark \"" + lm.name + "\" can't be reached from the initial position.");
+    }
+  }
+  for (unsigned int y = 0; y < road_map.size_y; y++) {
+    for (unsigned int w = 0; w < words; w++) {
+      size_t i = static_cast<size_t>(y) * words + w;
+      uint64_t unreached = gridWord(road_map, w, y) & ~(north[i] | south[i] | east[i] | west[i]);
+      if (unreached != 0) {
+        unsigned int x = w * 64 + __builtin_ctzll(unreached);
+        throw std::runtime_error("Road X:" + std::to_string(x) + " Y:" + std::to_string(y) + " can't be reached from the initial position.");
       }
-      std::cout << disp_char;
     }
+  }
+}
 
-    // マップ横に凡例を表示
-    if (i == 2) {
-      std::cout << "  legend";
-    } else if (i == 3) {
-      std::cout << "  + : Road you can drive";
-    } else if (i == 4) {
-      std::cout << "  O : Landmark (Unreached)";
-    } else if (i == 5) {
-      std::cout << "  @ : Landmark (Reached)";
-    } else if (i == 6) {
-      std::cout << "  ^,>,v,<: Your position and direction";
+// 8マス分の道路ビットを表示文字に変換する表
+static const std::array<std::array<char, 8>, 256> road_chars_table = [] {
+  std::array<std::array<char, 8>, 256> table {};
+  for (unsigned int bits = 0; bits < 256; bits++) {
+    for (unsigned int k = 0; k < 8; k++) {
+      table[bits][k] = ((bits >> k) & 1) ? '+' : ' ';
     }
-    std::cout << std::endl;
+  }
+  return table;
+}();
+
+// 自己位置の向きを表す記号を返す関数
+static char directionMark(Direction direction) {
+  char mark;
+  if (direction == Direction::North) {
+    mark = '^';
+  } else if (direction == Direction::South) {
+    mark = 'v';
+  } else if (direction == Direction::East) {
+    mark = '>';
+  } else {  // (direction == Direction::West)
+    mark = '<';
+  }
+  return mark;
+}
+
+// マップ1行のうち表示範囲分の表示文字を組み立てる関数
+// 通れる場所を+、通れない場所を空白で表示する
+// ランドマークはOで表示する
+// 自己位置は向きに応じて記号を変えて表示
+void composeMapRow(const LandmarkIndex& index, const Position& pos, unsigned int y, unsigned int x, unsigned int width, char* row) {
+  PROFILE_SCOPE("map.composeMapRow");
+  // 表示優先度低：マップ（道路ビットを8マスずつ表に引いて組み立てる）
+  for (unsigned int j = 0; j < width; j += 8) {
+    std::memcpy(&row[j], road_chars_table[gridByte(road_map, x + j, y)].data(), std::min(8u, width - j));
+  }
+
+  // 表示優先度中：ランドマーク（表示範囲のワードのうち、ランドマークのあるマスのビットだけをたどる）
+  for (unsigned int w = x / 64; w <= (x + width - 1) / 64; w++) {
+    for (uint64_t bits = gridWord(index.occupied, w, y); bits != 0; bits &= bits - 1) {
+      unsigned int j = w * 64 + __builtin_ctzll(bits);
+      if ((j >= x) && (j < x + width)) {
+        row[j - x] = is_arrived(index, findLandmark(index, j, y)) ? '@' : 'O';
+      }
+    }
+  }
+
+  // 表示優先度高：自己位置
+  if ((pos.y == y) && (pos.x >= x) && (pos.x < x + width)) {
+    row[pos.x - x] = directionMark(pos.direction);
+  }
+}
+
+// マップ横に表示する凡例を返す関数
+const char* mapLegend(unsigned int y) {
+  const char* str {""};
+
+  if (y == 2) {
+    str = "  legend";
+  } else if (y == 3) {
+    str = "  + : Road you can drive";
+  } else if (y == 4) {
+    str = "  O : Landmark (Unreached)";
+  } else if (y == 5) {
+    str = "  @ : Landmark (Reached)";
+  } else if (y == 6) {
+    str = "  ^,>,v,<: Your position and direction";
+  }
+  return str;
+}
+
+// マップとランドマーク、自己位置を凡例付きで表示する関数
+void displayMap(const LandmarkIndex& index, const Position& pos) {
+  PROFILE_SCOPE("map.displayMap");
+  std::string row(road_map.size_x, ' ');
+  for (unsigned int i = 0; i < road_map.size_y; i++) {
+    composeMapRow(index, pos, i, 0, road_map.size_x, &row[0]);
+    std::cout.write(row.data(), row.size());
+    std::cout << mapLegend(i) << std::endl;
   }
 }
 
 // 進行方向所定マス(look_ahead_blocks)以内にランドマークがある場合は情報を返す関数
-std::string lookforNearLandmark(const std::vector<LandMark>& landmarks, const Position& pos) {
-  std::string str {"Near landmark: None"};
+std::string lookforNearLandmark(const LandmarkIndex& index, const Position& pos) {
+  PROFILE_SCOPE("map.lookforNearLandmark");
+  // その場所の検索：表示優先度高
+  int here = findLandmark(index, pos.x, pos.y);
+  if (here >= 0) {
+    return "Arrive at \"" + index.landmarks[here].name + "\"";
+  }
 
   // 近くの検索：表示優先度低
-  for (LandMark lm : landmarks) {
-    for (int i = 1; i <= look_ahead_blocks; i++) {
-      if (pos.direction == Direction::North) {
-        if (((pos.y - i) >= 0) && (lm.x == pos.x) && (lm.y == (pos.y - i))) {
-          str = "Near landmark: \"" + lm.name + "\"";
-          break;
-        }
-      } else if (pos.direction == Direction::South) {
-        if (((pos.y + i) < map_size_y) && (lm.x == pos.x) && (lm.y == (pos.y + i))) {
-          str = "Near landmark: \"" + lm.name + "\"";
-          break;
-        }
-      } else if (pos.direction == Direction::East) {
-        if (((pos.x + i) < map_size_x) && (lm.x == (pos.x + i)) && (lm.y == pos.y)) {
-          str = "Near landmark: \"" + lm.name + "\"";
-          break;
+  // 進行方向のマスを順にたどり、複数ある場合は後に登録されたものを表示する
+  int near {-1};
+  Position ahead {pos};
+  for (unsigned int i = 1; i <= look_ahead_blocks; i++) {
+    if (ahead.direction == Direction::North) {
+      ahead.y--;
+    } else if (ahead.direction == Direction::South) {
+      ahead.y++;
+    } else if (ahead.direction == Direction::East) {
+      ahead.x++;
+    } else {  // == Direction::West
+      ahead.x--;
+    }
+    near = std::max(near, findLandmark(index, ahead.x, ahead.y));
+  }
+  if (near < 0) {
+    return "Near landmark: None";
+  }
+  return "Near landmark: \"" + index.landmarks[near].name + "\"";
+}
+
+// 道路ビットマップから縮小図を作る関数
+void buildRoadMipmap(RoadMipmap& mipmap) {
+  mipmap.widths.clear();
+  mipmap.heights.clear();
+  mipmap.levels.clear();
+
+  // 最も細かい段：タイルの各行のワードを1バイト（8マス）ずつ数える
+  unsigned int width = (road_map.size_x + mipmap_block - 1) / mipmap_block;
+  unsigned int height = (road_map.size_y + mipmap_block - 1) / mipmap_block;
+  std::vector<uint8_t> level(static_cast<size_t>(width) * height);
+  std::vector<unsigned int> counts(width);
+  for (unsigned int by = 0; by < height; by++) {
+    std::fill(counts.begin(), counts.end(), 0);
+    unsigned int y_end = std::min(road_map.size_y, (by + 1) * mipmap_block);
+    for (unsigned int y = by * mipmap_block; y < y_end; y++) {
+      for (unsigned int w = 0; w < road_map.words_per_row; w++) {
+        uint64_t word = gridWord(road_map, w, y);
+        for (unsigned int k = 0; word != 0; k++, word >>= 8) {
+          counts[w * 8 + k] += __builtin_popcountll(word & 0xff);
         }
-      } else {  // == Direction::West
-        if (((pos.x - i) >= 0) && (lm.x == (pos.x - i)) && (lm.y == pos.y)) {
-          str = "Near landmark: \"" + lm.name + "\"";
-          break;
+      }
+    }
+    // マップ端のブロックは、マップ内のマス数に対する割合とする（道路が1マスでもあれば0にはしない）
+    for (unsigned int bx = 0; bx < width; bx++) {
+      unsigned int cells = std::min(mipmap_block, road_map.size_x - bx * mipmap_block) * (y_end - by * mipmap_block);
+      level[static_cast<size_t>(by) * width + bx] = (counts[bx] * 255 + cells - 1) / cells;
+    }
+  }
+  mipmap.widths.push_back(width);
+  mipmap.heights.push_back(height);
+  mipmap.levels.push_back(std::move(level));
+
+  // 上の段：下の段の2x2ブロック（マップ内のもの）の平均
+  while ((width > 1) || (height > 1)) {
+    const std::vector<uint8_t>& lower = mipmap.levels.back();
+    unsigned int upper_width = (width + 1) / 2;
+    unsigned int upper_height = (height + 1) / 2;
+    std::vector<uint8_t> upper(static_cast<size_t>(upper_width) * upper_height);
+    for (unsigned int by = 0; by < upper_height; by++) {
+      for (unsigned int bx = 0; bx < upper_width; bx++) {
+        unsigned int sum {0};
+        unsigned int num {0};
+        for (unsigned int y = by * 2; y < std::min(height, by * 2 + 2); y++) {
+          for (unsigned int x = bx * 2; x < std::min(width, bx * 2 + 2); x++) {
+            sum += lower[static_cast<size_t>(y) * width + x];
+            num++;
+          }
         }
+        upper[static_cast<size_t>(by) * upper_width + bx] = (sum + num - 1) / num;
       }
     }
+    width = upper_width;
+    height = upper_height;
+    mipmap.widths.push_back(width);
+    mipmap.heights.push_back(height);
+    mipmap.levels.push_back(std::move(upper));
   }
+}
 
-  // その場所の検索：表示優先度高
-  for (LandMark lm : landmarks) {
-    if ((lm.x == pos.x) && (lm.y == pos.y)) {
-      str = "Arrive at \"" + lm.name + "\"";
+// 幅 width、高さ height の表示に全体が収まる最も細かい段を返す関数
+unsigned int selectMipmapLevel(const RoadMipmap& mipmap, unsigned int width, unsigned int height) {
+  unsigned int level {0};
+  while ((level + 1 < mipmap.levels.size()) && ((mipmap.widths[level] > width) || (mipmap.heights[level] > height))) {
+    level++;
+  }
+  return level;
+}
+
+// 縮小図の1行の表示文字を組み立てる関数
+// 道路密度を 空白(0) . : * # の順に濃く表示する
+void composeOverviewRow(const RoadMipmap& mipmap, unsigned int level, const LandmarkIndex& index, const Position& pos, unsigned int y, unsigned int width, char* row) {
+  static const char density_chars[] = ".:*#";
+  const unsigned int block = mipmap_block << level;
+  const unsigned int columns = std::min(width, mipmap.widths[level]);
+  if (y >= mipmap.heights[level]) {
+    return;
+  }
+
+  // 表示優先度低：道路密度
+  const uint8_t* density = &mipmap.levels[level][static_cast<size_t>(y) * mipmap.widths[level]];
+  for (unsigned int x = 0; x < columns; x++) {
+    row[x] = (density[x] == 0) ? ' ' : density_chars[density[x] / 64];
+  }
+
+  // 表示優先度中：ランドマーク（同じブロックに未到達のものがあれば未到達として表示）
+  for (size_t i = 0; i < index.landmarks.size(); i++) {
+    const LandMark& lm = index.landmarks[i];
+    if ((lm.y / block == y) && (lm.x / block < columns)) {
+      char& mark = row[lm.x / block];
+      if (!is_arrived(index, i)) {
+        mark = 'O';
+      } else if (mark != 'O') {
+        mark = '@';
+      }
     }
   }
-  return str;
+
+  // 表示優先度高：自己位置
+  if ((pos.y / block == y) && (pos.x / block < columns)) {
+    row[pos.x / block] = directionMark(pos.direction);
+  }
 }
 
-bool is_turn_left_enable(const Position& pos) {
-  // 今の位置から左折が可能かを判断する
+// 指定した向きの隣のマスが道路かを判断する関数（マップ外は道路外）
+// 符号なしの座標は0から1を引くと最大値になり範囲外として扱われる
+static bool is_road_toward(const Position& pos, Direction direction) {
   bool ret {false};
-  if (((pos.direction == Direction::North) && (pos.x > 0) && map[pos.y][pos.x - 1] != 0)
-   || ((pos.direction == Direction::South) && (pos.x < (map_size_x - 1)) && map[pos.y][pos.x + 1] != 0)
-   || ((pos.direction == Direction::East) && (pos.y > 0) && map[pos.y - 1][pos.x] != 0)
-   || ((pos.direction == Direction::West) && (pos.y < (map_size_y - 1)) && map[pos.y + 1][pos.x] != 0)) {
-    ret = true;
+  if (direction == Direction::North) {
+    ret = is_road(pos.x, pos.y - 1);
+  } else if (direction == Direction::South) {
+    ret = is_road(pos.x, pos.y + 1);
+  } else if (direction == Direction::East) {
+    ret = is_road(pos.x + 1, pos.y);
+  } else {  // (direction == Direction::West)
+    ret = is_road(pos.x - 1, pos.y);
   }
   return ret;
 }
 
+bool is_turn_left_enable(const Position& pos) {
+  // 今の位置から左折が可能かを判断する
+  return is_road_toward(pos, rotateDirection(pos.direction, true));
+}
+
 bool is_turn_right_enable(const Position& pos) {
   // 今の位置から右折が可能かを判断する
-  bool ret {false};
-  if (((pos.direction == Direction::North) && (pos.x < (map_size_x - 1)) && map[pos.y][pos.x + 1] != 0)
-   || ((pos.direction == Direction::South) && (pos.x > 0) && map[pos.y][pos.x - 1] != 0)
-   || ((pos.direction == Direction::East) && (pos.y < (map_size_y - 1)) && map[pos.y + 1][pos.x] != 0)
-   || ((pos.direction == Direction::West) && (pos.y > 0) && map[pos.y - 1][pos.x] != 0)) {
-    ret = true;
-  }
-  return ret;
+  return is_road_toward(pos, rotateDirection(pos.direction, false));
 }
 
 bool is_continue_straight_enable(const Position& pos) {
-  bool ret {false};
-  if (((pos.direction == Direction::North) && (pos.y > 0) && map[pos.y - 1][pos.x] != 0)
-   || ((pos.direction == Direction::South) && (pos.y < (map_size_y - 1)) && map[pos.y + 1][pos.x] != 0)
-   || ((pos.direction == Direction::East) && (pos.x < (map_size_x - 1)) && map[pos.y][pos.x + 1] != 0)
-   || ((pos.direction == Direction::West) && (pos.x > 0) && map[pos.y][pos.x - 1] != 0)) {
-    ret = true;
+  return is_road_toward(pos, pos.direction);
+}
+
+// ランドマークの索引を作る関数
+void buildLandmarkIndex(LandmarkIndex& index, const std::vector<LandMark>& landmarks) {
+  PROFILE_SCOPE("map.buildLandmarkIndex");
+  index.landmarks = landmarks;
+  initBitGrid(index.occupied, road_map.size_x, road_map.size_y);
+  index.cell_index.clear();
+  index.cell_index.reserve(landmarks.size());
+  for (size_t i = 0; i < landmarks.size(); i++) {
+    // マップ範囲外のランドマークは索引に載せない（validateLandmarksでエラーになる）
+    if ((landmarks[i].x < road_map.size_x) && (landmarks[i].y < road_map.size_y)) {
+      setGridBit(index.occupied, landmarks[i].x, landmarks[i].y, true);
+      index.cell_index.emplace(cellKey(landmarks[i].x, landmarks[i].y), i);
+    }
   }
-  return ret;
+  resetArrived(index);
+}
+
+// ランドマークの到達状況を全て未到達に戻す関数
+void resetArrived(LandmarkIndex& index) {
+  index.arrived.assign((index.landmarks.size() + 63) / 64, 0);
+  index.arrived_count = 0;
 }
 
 // ランドマーク到達判断と到達状況を更新する関数
-bool judgeArriveLandmarks(std::vector<LandMark>& landmarks, const Position& pos) {
+bool judgeArriveLandmarks(LandmarkIndex& index, const Position& pos) {
+  PROFILE_SCOPE("map.judgeArriveLandmarks");
   // 現在位置からランドマーク到達を判断し、フラグを更新する
-  for (int i = 0; i < landmarks.size(); i++) {
-    if ((landmarks[i].x == pos.x) && (landmarks[i].y == pos.y)) {
-      landmarks[i].is_arrived = true;
-    }
+  int landmark = findLandmark(index, pos.x, pos.y);
+  if ((landmark >= 0) && !is_arrived(index, landmark)) {
+    index.arrived[landmark / 64] |= uint64_t {1} << (landmark % 64);
+    index.arrived_count++;
   }
 
   // 全てのランドマークに到達したかを判断して返す
-  bool is_arrive_all_landmerks {true};
-  for (LandMark lm : landmarks) {
-    is_arrive_all_landmerks &= lm.is_arrived;
-  }
-  return is_arrive_all_landmerks;
+  return index.arrived_count == index.landmarks.size();
 }
 
 
@@ -3,6 +3,10 @@
 
 #include <iostream>
 #include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 // 方角のEnum定義
@@ -18,7 +22,6 @@ typedef struct {     // ランドマーク構造体
   std::string name;  // 名称
   unsigned int x;    // X座標
   unsigned int y;    // Y座標
-  bool is_arrived;   // 到達したか否か
 } LandMark;
 
 typedef struct {        // 自己位置構造体
@@ -27,28 +30,210 @@ typedef struct {        // 自己位置構造体
   Direction direction;  // 向き
 } Position;
 
-// マップ変数の宣言
+// ビットマップを分割するタイルの一辺のマス数（1タイル = 64ビットのワード × 64行）
+constexpr unsigned int tile_size = 64;
+
+// 1マス1ビットのビットマップ構造体
+// マップを64x64マスのタイルに分けて格納し、タイル本体はタイル内の行ごとに1ワードを持つ
+// X座標 x のマスは、X方向 x / 64 番目のタイルの該当行のワードの x % 64 ビット目に置くので、
+// 「行内の x / 64 ワード目」を参照する処理はタイル分割を意識せずに書ける
+// 道路の無いタイルはすべて本体0番（全マス0の空タイル）を共有し、本体を持たない
+// マップファイル（書式2）から読み込んだ場合、タイル本体はメモリマップしたファイルを直接指し、
+// ヒープには確保しない（ファイルのどの部分をメモリに置くかはOSに任せる）
+// マップ外にはみ出した余りビットは常に0にしておく（ワード単位の処理で範囲外を道路外として扱えるようにするため）
+typedef struct {
+  unsigned int size_x;                           // X方向のマス数
+  unsigned int size_y;                           // Y方向のマス数
+  unsigned int words_per_row;                    // 1行あたりのワード数（X方向のタイル数）
+  unsigned int tile_rows;                        // Y方向のタイル数
+  std::vector<uint32_t> tiles;                   // タイル(Y方向の番号 * words_per_row + X方向の番号)→本体番号
+  const uint64_t* pool;                          // タイル本体の並び（本体 k は pool + k * tile_size から）
+  std::shared_ptr<std::vector<uint64_t>> owned;  // 書き込んで作ったタイル本体（poolが指す）
+  std::shared_ptr<const void> mapping;           // poolが指すメモリマップしたファイル（保持用）
+} BitGrid;
+
+// 標準マップ（ソースに記述した地図）の宣言（定義はmap.cppにあり、コンパイル時に検証する）
 constexpr unsigned int map_size_x = 100;
 constexpr unsigned int map_size_y = 50;
 extern const std::array<std::array<unsigned int, map_size_x>, map_size_y> map;
 
-// マップ上の初期位置
+// ゲームで使用する道路ビットマップ（1:道路, 0:道路外）
+extern BitGrid road_map;
+
+// ビットマップを全マス0（全タイルが空タイル）で初期化する関数
+void initBitGrid(BitGrid& grid, unsigned int size_x, unsigned int size_y);
+
+// 道路ビットマップと同じ大きさの全マス0のビットマップを作り、道路のあるタイルすべてに本体を確保しておく関数
+// 道路マスへの書き込みでタイル本体を確保し直すことが無いので、異なる行への書き込みは複数スレッドから同時に行える
+void initRoadShapedGrid(BitGrid& grid);
+
+// ビットマップのワード・マスを参照、設定する関数
+// 設定はinitBitGridで初期化したビットマップにのみ行うこと（ファイルを指すビットマップは読み取り専用）
+inline uint64_t gridWord(const BitGrid& grid, unsigned int word_x, unsigned int y) {
+  uint32_t tile = grid.tiles[static_cast<size_t>(y / tile_size) * grid.words_per_row + word_x];
+  return grid.pool[static_cast<size_t>(tile) * tile_size + y % tile_size];
+}
+inline bool gridBit(const BitGrid& grid, unsigned int x, unsigned int y) {
+  return (gridWord(grid, x / 64, y) >> (x % 64)) & 1;
+}
+void setGridWord(BitGrid& grid, unsigned int word_x, unsigned int y, uint64_t word);
+inline void setGridBit(BitGrid& grid, unsigned int x, unsigned int y, bool value) {
+  uint64_t word = gridWord(grid, x / 64, y);
+  setGridWord(grid, x / 64, y, value ? (word | (uint64_t {1} << (x % 64))) : (word & ~(uint64_t {1} << (x % 64))));
+}
+
+// X座標 x から8マス分のビットを返す関数（マップ外は0）
+inline unsigned int gridByte(const BitGrid& grid, unsigned int x, unsigned int y) {
+  uint64_t bits = gridWord(grid, x / 64, y) >> (x % 64);
+  if ((x % 64 > 56) && (x / 64 + 1 < grid.words_per_row)) {
+    bits |= gridWord(grid, x / 64 + 1, y) << (64 - x % 64);
+  }
+  return bits & 0xff;
+}
+
+// マップ上のランドマークの索引構造体
+// マスからランドマークを引く処理と到達判定を、ランドマーク数によらず定数時間で行うためのもの
+typedef struct {
+  std::vector<LandMark> landmarks;                     // 登録順のランドマーク（番号は登録順）
+  BitGrid occupied;                                    // ランドマークのあるマスのビットマップ
+  std::unordered_map<uint64_t, uint32_t> cell_index;  // マス(cellKey)→ランドマーク番号
+  std::vector<uint64_t> arrived;                       // 到達済みフラグ（ランドマーク番号のビット）
+  unsigned int arrived_count;                          // 到達済みランドマーク数
+} LandmarkIndex;
+
+// マスの座標を1つのキーに詰める関数
+inline uint64_t cellKey(unsigned int x, unsigned int y) {
+  return (static_cast<uint64_t>(y) << 32) | x;
+}
+
+// 道路マスか否かを返す関数（範囲外は道路外として扱う）
+inline bool is_road(unsigned int x, unsigned int y) {
+  return (x < road_map.size_x) && (y < road_map.size_y) && gridBit(road_map, x, y);
+}
+
+// 直線の長さの表に持てる最大のマス数（これより長く道路が続く場合は、この値として持つ）
+constexpr unsigned int max_straight_run = UINT8_MAX;
+
+// 道路マスごと・向きごとの直線の長さの表構造体
+// 直線の長さは、そのマスから向きの方へ道路が途切れずに続くマス数（自分のマスは含まない）
+// 道路マスの番号は距離場と同じく行優先の順で、ワードごとの前までの道路マス数（word_rank）と、ワード内のビット数から求める
+// 表は道路マスの分だけ持つので、大きな地図でも道路の無いマスの分のメモリは要らない
+typedef struct {
+  size_t num_road;                                 // 道路マス数
+  std::vector<uint32_t> word_rank;                 // ワード（y * words_per_row + ワード番号）より前の道路マス数
+  std::vector<std::array<uint8_t, 4>> runs;        // 道路マスの番号→向きごとの直線の長さ（max_straight_runで頭打ち）
+} StraightRuns;
+
+// ゲームで使用する道路ビットマップの直線の長さの表（道路ビットマップを読み込む関数が作り直す）
+extern StraightRuns straight_runs;
+
+// 道路ビットマップから直線の長さの表を作る関数
+// 道路ビットマップを作る関数（loadStockMap、loadMapFile、generateMap）の最後で呼ぶ。道路ビットマップを自分で作った場合も呼ぶこと
+void buildStraightRuns(void);
+
+// マスから向きの方へ道路が途切れずに続くマス数を返す関数（max_straight_runで頭打ち、道路外のマスは0）
+// 速度分のマスがすべて道路かを、1マスずつ調べずに1回の参照で判定できる
+inline unsigned int straightRun(unsigned int x, unsigned int y, Direction direction) {
+  if ((x >= road_map.size_x) || (y >= road_map.size_y)) {
+    return 0;
+  }
+  const uint64_t word = gridWord(road_map, x / 64, y);
+  if (!((word >> (x % 64)) & 1)) {
+    return 0;
+  }
+  const uint64_t below = (uint64_t {1} << (x % 64)) - 1;
+  const size_t road = straight_runs.word_rank[static_cast<size_t>(y) * road_map.words_per_row + x / 64] + __builtin_popcountll(word & below);
+  return straight_runs.runs[road][direction];
+}
+
+// 標準マップ上の初期位置
 constexpr unsigned int initial_x = 5;
 constexpr unsigned int initial_y = 0;
 constexpr Direction initial_direction = Direction::East;
 
+// 標準マップ上のランドマーク構造体（コンパイル時に検証できるよう、名称は文字列リテラルで持つ）
+typedef struct {
+  const char* name;  // 名称
+  unsigned int x;    // X座標
+  unsigned int y;    // Y座標
+} StockLandmark;
+
+// 標準マップ上のランドマーク（初期化は 名称, X座標, Y座標 の順）
+constexpr std::array<StockLandmark, 7> stock_landmarks {{
+  {"tokyo tower", 7, 19},
+  {"tokyo sky tree", 6, 40},
+  {"shiba-koen", 19, 12},
+  {"nihon-bashi", 57, 12},
+  {"bay bridge", 97, 49},
+  {"kawasaki-daishi", 44, 41},
+  {"tokyo dome", 76, 22},
+}};
+
+// ゲームで使用する初期位置（標準マップでは上記の値、マップファイルではファイルに記述した値）
+extern Position initial_position;
+
 // ランドマークが近くにあると判定するマス数
 constexpr unsigned int look_ahead_blocks = 3;
 
+// 標準マップを道路ビットマップに読み込み、初期位置を設定する関数
+// 標準マップ・初期位置・ランドマークはコンパイル時に検証済み（mapcheck.hpp）なので、実行時の検証は不要
+void loadStockMap(void);
+
 // マップ・ランドマーク・初期位置を検証する関数
 // 不正な値が含まれる場合はruntime_errorをthrowする
 void validateMap(void);
-void validateLandmarks(const std::vector<LandMark>& landmarks);
+void validateMapRow(unsigned int y);
+void validateLandmarks(const LandmarkIndex& index);
 void validateInitialPosition(void);
+// 初期位置から、曲がり方の規則（Uターン不可）に従って到達できない道路・ランドマークが無いかを検証する関数
+// （マス, 向き）の状態を、向きごとのビットマップの行単位のビット演算で塗り広げて求める
+void validateReachability(const LandmarkIndex& index);
+
+// ランドマークの索引を作る関数（到達状況は全て未到達になる）
+// 同じマスに複数のランドマークがある場合、マスからは先に登録されたものが引かれる
+void buildLandmarkIndex(LandmarkIndex& index, const std::vector<LandMark>& landmarks);
+
+// 指定したマスにあるランドマークの番号を返す関数（無い場合は-1）
+inline int findLandmark(const LandmarkIndex& index, unsigned int x, unsigned int y) {
+  if ((x >= index.occupied.size_x) || (y >= index.occupied.size_y) || !gridBit(index.occupied, x, y)) {
+    return -1;
+  }
+  return index.cell_index.find(cellKey(x, y))->second;
+}
+
+// ランドマークの到達状況を参照、初期化する関数
+inline bool is_arrived(const LandmarkIndex& index, unsigned int landmark) {
+  return (index.arrived[landmark / 64] >> (landmark % 64)) & 1;
+}
+void resetArrived(LandmarkIndex& index);
 
 // マップを表示する関数
-void displayMap(const std::vector<LandMark>& landmarks, const Position& pos);
-std::string lookforNearLandmark(const std::vector<LandMark>& landmarks, const Position& pos);
+void displayMap(const LandmarkIndex& index, const Position& pos);
+// マップのY座標 y の行のうち、X座標 x から width マス分の表示文字をrowに書き込む関数
+void composeMapRow(const LandmarkIndex& index, const Position& pos, unsigned int y, unsigned int x, unsigned int width, char* row);
+// マップ横に表示する凡例を返す関数（凡例の無い行は空文字列）
+const char* mapLegend(unsigned int y);
+std::string lookforNearLandmark(const LandmarkIndex& index, const Position& pos);
+
+// 縮小図の最も細かい段の1ブロックの一辺のマス数
+constexpr unsigned int mipmap_block = 8;
+
+// 道路密度の縮小図（ミップマップ）構造体
+// 段 k は (mipmap_block << k) マス四方のブロックごとに、道路マスの割合を0〜255で持つ
+// 上の段は下の段の2x2ブロックの平均で、最上段は1ブロックになる
+typedef struct {
+  std::vector<unsigned int> widths;          // 各段のX方向のブロック数
+  std::vector<unsigned int> heights;         // 各段のY方向のブロック数
+  std::vector<std::vector<uint8_t>> levels;  // 各段の密度（Y方向の番号 * 幅 + X方向の番号）
+} RoadMipmap;
+
+// 道路ビットマップから縮小図を作る関数
+void buildRoadMipmap(RoadMipmap& mipmap);
+// 幅 width、高さ height の表示に全体が収まる最も細かい段を返す関数
+unsigned int selectMipmapLevel(const RoadMipmap& mipmap, unsigned int width, unsigned int height);
+// 縮小図の段 level の y 行目の表示文字を、最大 width 文字までrowに書き込む関数
+// 道路密度に応じた記号で表示し、ランドマークと自己位置は含まれるブロックに重ねて表示する
+void composeOverviewRow(const RoadMipmap& mipmap, unsigned int level, const LandmarkIndex& index, const Position& pos, unsigned int y, unsigned int width, char* row);
 
 // 位置に応じた行動可否を判断する関数
 bool is_turn_left_enable(const Position& pos);
@@ -56,7 +241,7 @@ bool is_turn_right_enable(const Position& pos);
 bool is_continue_straight_enable(const Position& pos);
 
 // ランドマーク到達判断と到達状況を更新する関数
-bool judgeArriveLandmarks(std::vector<LandMark>& landmarks, const Position& pos);
+bool judgeArriveLandmarks(LandmarkIndex& index, const Position& pos);
 
 // Directionの補助関数
 std::string direction2str(Direction direction);
@@ -0,0 +1,161 @@
+#ifndef MAPCHECK_HPP
+#define MAPCHECK_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "map.hpp"
+#include "game.hpp"
+
+// 標準マップ（ソースに記述した地図）をコンパイル時に検証する関数群
+// 実行時の検証（validateMapなど）と同じ内容を、static_assertから呼べるconstexpr関数で行う
+// 問題のあるマスを返す関数は、そのマスの番号（Y座標 * map_size_x + X座標）を、無い場合は-1を返すので、
+// 検証に失敗した場合はコンパイラのエラーメッセージに番号が表示される
+
+typedef std::array<std::array<unsigned int, map_size_x>, map_size_y> StockMap;
+
+// 標準マップ上の道路マスか否かを返す関数（範囲外は道路外）
+constexpr bool is_stock_road(const StockMap& grid, long x, long y) {
+  return (x >= 0) && (y >= 0) && (x < static_cast<long>(map_size_x)) && (y < static_cast<long>(map_size_y)) && (grid[y][x] == 1);
+}
+
+// 向きごとの1マスの移動量と、左折・右折後の向き
+constexpr std::array<int, 4> stock_dx {0, 0, 1, -1};
+constexpr std::array<int, 4> stock_dy {-1, 1, 0, 0};
+constexpr std::array<Direction, 4> stock_left {Direction::West, Direction::East, Direction::North, Direction::South};
+constexpr std::array<Direction, 4> stock_right {Direction::East, Direction::West, Direction::South, Direction::North};
+
+// 0,1以外の値を含むマスを返す関数
+constexpr long findInvalidStockValue(const StockMap& grid) {
+  for (unsigned int y = 0; y < map_size_y; y++) {
+    for (unsigned int x = 0; x < map_size_x; x++) {
+      if ((grid[y][x] != 0) && (grid[y][x] != 1)) {
+        return static_cast<long>(y) * map_size_x + x;
+      }
+    }
+  }
+  return -1;
+}
+
+// 袋小路（縦横に隣り合う道路マスが2未満の道路マス）を返す関数
+constexpr long findStockDeadEnd(const StockMap& grid) {
+  for (long y = 0; y < static_cast<long>(map_size_y); y++) {
+    for (long x = 0; x < static_cast<long>(map_size_x); x++) {
+      int neighbours = is_stock_road(grid, x, y - 1) + is_stock_road(grid, x, y + 1)
+                       + is_stock_road(grid, x + 1, y) + is_stock_road(grid, x - 1, y);
+      if (is_stock_road(grid, x, y) && (neighbours < 2)) {
+        return y * map_size_x + x;
+      }
+    }
+  }
+  return -1;
+}
+
+// 初期位置が道路上にあり、前が道路になっているかを返す関数
+constexpr bool is_stock_initial_position_valid(const StockMap& grid, unsigned int x, unsigned int y, Direction direction) {
+  return is_stock_road(grid, x, y) && is_stock_road(grid, static_cast<long>(x) + stock_dx[direction], static_cast<long>(y) + stock_dy[direction]);
+}
+
+// 道路外にある、または前のランドマークと同じマスにあるランドマークの番号を返す関数
+template <size_t N>
+constexpr long findInvalidStockLandmark(const StockMap& grid, const std::array<StockLandmark, N>& landmarks) {
+  for (size_t i = 0; i < N; i++) {
+    if (!is_stock_road(grid, landmarks[i].x, landmarks[i].y)) {
+      return i;
+    }
+    for (size_t j = 0; j < i; j++) {
+      if ((landmarks[j].x == landmarks[i].x) && (landmarks[j].y == landmarks[i].y)) {
+        return i;
+      }
+    }
+  }
+  return -1;
+}
+
+// 初期位置から、直進・左折・右折で1マスずつ進んで（Uターンせずに）たどり着けない道路マスを返す関数
+// （マス, 向き）の状態を待ち行列でたどる（validateReachabilityと同じ判定）
+// ランドマークは道路上にあるので、全道路マスにたどり着ければランドマークにもたどり着ける
+constexpr long findUnreachableStockRoad(const StockMap& grid, unsigned int x, unsigned int y, Direction direction) {
+  constexpr size_t num_states = static_cast<size_t>(map_size_x) * map_size_y * 4;
+  std::array<bool, num_states> visited {};
+  std::array<uint32_t, num_states> queue {};
+  size_t head {0};
+  size_t tail {0};
+  auto push = [&](long px, long py, Direction d) {
+    size_t state = (static_cast<size_t>(py) * map_size_x + px) * 4 + d;
+    if (!visited[state]) {
+      visited[state] = true;
+      queue[tail++] = state;
+    }
+  };
+  push(x, y, direction);
+  while (head < tail) {
+    const uint32_t state = queue[head++];
+    const long cx = (state / 4) % map_size_x;
+    const long cy = (state / 4) / map_size_x;
+    const Direction d = static_cast<Direction>(state % 4);
+    for (Direction next : {d, stock_left[d], stock_right[d]}) {
+      if (is_stock_road(grid, cx + stock_dx[next], cy + stock_dy[next])) {
+        push(cx + stock_dx[next], cy + stock_dy[next], next);
+      }
+    }
+  }
+
+  for (size_t cell = 0; cell < static_cast<size_t>(map_size_x) * map_size_y; cell++) {
+    if ((grid[cell / map_size_x][cell % map_size_x] == 1)
+        && !visited[cell * 4] && !visited[cell * 4 + 1] && !visited[cell * 4 + 2] && !visited[cell * 4 + 3]) {
+      return cell;
+    }
+  }
+  return -1;
+}
+
+// 初期位置から全ランドマークを回るのに必要な燃料の下限を返す関数（fuelLowerBoundと同じ求め方）
+template <size_t N>
+constexpr long stockFuelLowerBound(unsigned int x, unsigned int y, const std::array<StockLandmark, N>& landmarks) {
+  std::array<long, N + 1> px {};
+  std::array<long, N + 1> py {};
+  px[0] = x;
+  py[0] = y;
+  for (size_t i = 0; i < N; i++) {
+    px[i + 1] = landmarks[i].x;
+    py[i + 1] = landmarks[i].y;
+  }
+  std::array<long, N + 1> nearest {};
+  std::array<bool, N + 1> in_tree {};
+  for (size_t i = 1; i <= N; i++) {
+    nearest[i] = -1;
+  }
+  long total {0};
+  size_t next {0};
+  for (size_t added = 0; added <= N; added++) {
+    size_t u = next;
+    in_tree[u] = true;
+    total += nearest[u];
+    long best {-1};
+    for (size_t v = 0; v <= N; v++) {
+      if (in_tree[v]) {
+        continue;
+      }
+      long distance = ((px[u] > px[v]) ? px[u] - px[v] : px[v] - px[u]) + ((py[u] > py[v]) ? py[u] - py[v] : py[v] - py[u]);
+      if ((nearest[v] < 0) || (distance < nearest[v])) {
+        nearest[v] = distance;
+      }
+      if ((best < 0) || (nearest[v] < best)) {
+        best = nearest[v];
+        next = v;
+      }
+    }
+  }
+
+  long bound {-1};
+  for (unsigned int speed = (min_speed > 1) ? min_speed : 1; speed <= max_speed; speed++) {
+    long fuel = (total * fuel_consumption[speed] + speed - 1) / speed;
+    if ((bound < 0) || (fuel < bound)) {
+      bound = fuel;
+    }
+  }
+  return bound;
+}
+
+#endif  // MAPCHECK_HPP
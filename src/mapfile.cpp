@@ -0,0 +1,248 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include "mapfile.hpp"
+
+// マップファイルのマス数の上限（ランドマークの座標キーなどが32ビットに収まる範囲）
+constexpr unsigned int max_map_size = 1u << 20;
+// ランドマークの行の最小バイト数（"0 0\n"）
+constexpr size_t min_landmark_line_bytes = 4;
+
+// ヘッダの1行を読み、読み取り位置を次の行へ進める関数
+static std::string readHeaderLine(const MappedFile& file, size_t& offset) {
+  const char* begin = file.data() + offset;
+  const char* end = static_cast<const char*>(std::memchr(begin, '\n', file.size() - offset));
+  if (end == nullptr) {
+    throw std::runtime_error("Map file header is truncated.");
+  }
+  offset += (end - begin) + 1;
+  return std::string(begin, end);
+}
+
+// 方角を表す文字列をDirectionに変換する関数
+bool str2direction(const std::string& str, Direction& direction) {
+  bool ret {true};
+
+  if (str == "North") {
+    direction = Direction::North;
+  } else if (str == "South") {
+    direction = Direction::South;
+  } else if (str == "East") {
+    direction = Direction::East;
+  } else if (str == "West") {
+    direction = Direction::West;
+  } else {
+    ret = false;
+  }
+  return ret;
+}
+
+// 行ごとの道路データ（書式1）をビットマップに取り込む関数
+// 1行ずつタイルへ振り分け、上下の行がそろった行から袋小路を検証する
+static void loadRows(const MappedFile& file, size_t offset, unsigned int size_x, unsigned int size_y) {
+  const size_t row_bytes = (size_x + 7) / 8;
+  if (file.size() - offset < row_bytes * size_y) {
+    throw std::runtime_error("Road data is truncated in map file.");
+  }
+  file.advise(MADV_SEQUENTIAL);
+
+  initBitGrid(road_map, size_x, size_y);
+  const uint64_t last_word_mask = (size_x % 64 == 0) ? ~uint64_t {0} : ((uint64_t {1} << (size_x % 64)) - 1);
+  for (unsigned int y = 0; y < size_y; y++) {
+    const char* row = file.data() + offset + row_bytes * y;
+    for (unsigned int w = 0; w < road_map.words_per_row; w++) {
+      uint64_t word {0};
+      std::memcpy(&word, row + w * 8, std::min<size_t>(8, row_bytes - w * 8));
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+      word = __builtin_bswap64(word);
+#endif
+      // 行末の余りビットは道路外とする
+      if (w + 1 == road_map.words_per_row) {
+        word &= last_word_mask;
+      }
+      setGridWord(road_map, w, y, word);
+    }
+    if (y > 0) {
+      validateMapRow(y - 1);
+    }
+  }
+  validateMapRow(size_y - 1);
+}
+
+// タイルごとの道路データ（書式2）をビットマップに設定する関数
+// タイル本体はコピーせずファイルを直接指すので、読み込み時に読むのはタイル表だけで済む
+static void loadTiles(const std::shared_ptr<const MappedFile>& file, size_t offset, unsigned int size_x, unsigned int size_y, size_t num_tiles) {
+  // タイル表を確保する前に、タイル表と本体がファイルに収まっていることを確かめる
+  const size_t num_table = static_cast<size_t>((size_x + tile_size - 1) / tile_size) * ((size_y + tile_size - 1) / tile_size);
+  const size_t table_bytes = num_table * sizeof(uint32_t);
+  const size_t pool_offset = (offset + table_bytes + 7) / 8 * 8;
+  if ((num_tiles == 0) || (file->size() < pool_offset) || ((file->size() - pool_offset) / (tile_size * 8) < num_tiles)) {
+    throw std::runtime_error("Road data is truncated in map file.");
+  }
+  initBitGrid(road_map, size_x, size_y);
+  file->advise(MADV_RANDOM);
+
+  std::memcpy(road_map.tiles.data(), file->data() + offset, table_bytes);
+  for (uint32_t& tile : road_map.tiles) {
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+    tile = __builtin_bswap32(tile);
+#endif
+    if (tile >= num_tiles) {
+      throw std::runtime_error("Invalid tile number in map file.");
+    }
+  }
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  road_map.pool = reinterpret_cast<const uint64_t*>(file->data() + pool_offset);
+  road_map.owned.reset();
+  road_map.mapping = file;
+#else
+  // ビッグエンディアンではタイル本体を変換してコピーする
+  road_map.owned->resize(num_tiles * tile_size);
+  for (size_t i = 0; i < num_tiles * tile_size; i++) {
+    uint64_t word {};
+    std::memcpy(&word, file->data() + pool_offset + i * 8, 8);
+    (*road_map.owned)[i] = __builtin_bswap64(word);
+  }
+  road_map.pool = road_map.owned->data();
+#endif
+
+  // 空タイルとマップ外にはみ出した余りビットが0であることを確認する
+  const uint64_t last_word_mask = (size_x % 64 == 0) ? ~uint64_t {0} : ((uint64_t {1} << (size_x % 64)) - 1);
+  for (unsigned int i = 0; i < tile_size; i++) {
+    if (road_map.pool[i] != 0) {
+      throw std::runtime_error("Empty tile is not empty in map file.");
+    }
+  }
+  for (unsigned int y = 0; y < road_map.tile_rows * tile_size; y++) {
+    // マップの最終行より下の行は全ワード、それ以外の行は行末のワードの余りビットを調べる
+    uint64_t outside = (y < size_y) ? ~last_word_mask : ~uint64_t {0};
+    for (unsigned int w = ((y < size_y) ? road_map.words_per_row - 1 : 0); w < road_map.words_per_row; w++) {
+      if ((gridWord(road_map, w, y) & outside) != 0) {
+        throw std::runtime_error("Road data outside the map is included in map file.");
+      }
+    }
+  }
+  validateMap();
+}
+
+// マップファイルを読み込む関数
+void loadMapFile(const std::string& path, std::vector<LandMark>& landmarks) {
+  auto file = std::make_shared<const MappedFile>(path);
+  size_t offset {0};
+
+  // ヘッダの読み込み
+  std::string keyword;
+  unsigned int version {};
+  std::istringstream(readHeaderLine(*file, offset)) >> keyword >> version;
+  if ((keyword != "ROADMAP") || ((version != 1) && (version != 2))) {
+    throw std::runtime_error("\"" + path + "\" is not a map file.");
+  }
+
+  unsigned int size_x {};
+  unsigned int size_y {};
+  std::istringstream size_line(readHeaderLine(*file, offset));
+  if (!(size_line >> keyword >> size_x >> size_y) || (keyword != "size")
+   || (size_x == 0) || (size_y == 0) || (size_x > max_map_size) || (size_y > max_map_size)) {
+    throw std::runtime_error("Invalid map size in map file.");
+  }
+
+  std::string direction_str;
+  Position initial {};
+  std::istringstream initial_line(readHeaderLine(*file, offset));
+  if (!(initial_line >> keyword >> initial.x >> initial.y >> direction_str) || (keyword != "initial")
+   || !str2direction(direction_str, initial.direction)) {
+    throw std::runtime_error("Invalid initial position in map file.");
+  }
+
+  size_t num_landmarks {};
+  std::istringstream landmarks_line(readHeaderLine(*file, offset));
+  // 個数はファイルの残りに収まる行数までとし、壊れたヘッダで巨大な領域を確保しないようにする
+  if (!(landmarks_line >> keyword >> num_landmarks) || (keyword != "landmarks")
+   || (num_landmarks > (file->size() - offset) / min_landmark_line_bytes)) {
+    throw std::runtime_error("Invalid landmark count in map file.");
+  }
+  landmarks.clear();
+  landmarks.reserve(num_landmarks);
+  for (size_t i = 0; i < num_landmarks; i++) {
+    LandMark lm {};
+    std::istringstream landmark_line(readHeaderLine(*file, offset));
+    if (!(landmark_line >> lm.x >> lm.y)) {
+      throw std::runtime_error("Invalid landmark in map file (line " + std::to_string(i + 5) + ").");
+    }
+    // 座標の後の空白を除いた残りを名称とする
+    landmark_line >> std::ws;
+    std::getline(landmark_line, lm.name);
+    landmarks.push_back(lm);
+  }
+
+  // 道路データの読み込み
+  initial_position = initial;
+  std::istringstream data_line(readHeaderLine(*file, offset));
+  size_t num_tiles {};
+  if ((version == 1) && (data_line >> keyword) && (keyword == "rows")) {
+    loadRows(*file, offset, size_x, size_y);
+  } else if ((version == 2) && (data_line >> keyword >> num_tiles) && (keyword == "tiles")) {
+    loadTiles(file, offset, size_x, size_y, num_tiles);
+  } else {
+    throw std::runtime_error("Road data is missing in map file.");
+  }
+  buildStraightRuns();
+}
+
+// マップファイル（書式2）を書き出す関数
+// 道路の無いタイルは書き出さず、タイル表で本体0番（空タイル）を指す
+void saveMapFile(const std::string& path, const std::vector<LandMark>& landmarks) {
+  std::ofstream file(path, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("Can't write map file \"" + path + "\".");
+  }
+
+  // 書き出すタイルに本体番号を振り直す
+  std::vector<uint32_t> table(road_map.tiles.size(), 0);
+  std::vector<uint32_t> stored {0};
+  for (size_t i = 0; i < road_map.tiles.size(); i++) {
+    const uint64_t* tile = road_map.pool + static_cast<size_t>(road_map.tiles[i]) * tile_size;
+    if (std::any_of(tile, tile + tile_size, [](uint64_t word) { return word != 0; })) {
+      table[i] = stored.size();
+      stored.push_back(road_map.tiles[i]);
+    }
+  }
+
+  std::ostringstream header;
+  header << "ROADMAP 2\n";
+  header << "size " << road_map.size_x << " " << road_map.size_y << "\n";
+  header << "initial " << initial_position.x << " " << initial_position.y << " " << direction2str(initial_position.direction) << "\n";
+  header << "landmarks " << landmarks.size() << "\n";
+  for (const LandMark& lm : landmarks) {
+    header << lm.x << " " << lm.y << " " << lm.name << "\n";
+  }
+  header << "tiles " << stored.size() << "\n";
+  std::string bytes = header.str();
+
+  // タイル表（リトルエンディアンの32ビット）、8バイト境界までの詰め物、タイル本体（リトルエンディアンの64ビット）の順
+  for (uint32_t tile : table) {
+    for (unsigned int k = 0; k < 4; k++) {
+      bytes.push_back(static_cast<char>((tile >> (k * 8)) & 0xff));
+    }
+  }
+  bytes.resize((bytes.size() + 7) / 8 * 8, '\0');
+  file.write(bytes.data(), bytes.size());
+
+  std::array<char, tile_size * 8> tile_bytes {};
+  for (uint32_t tile : stored) {
+    for (unsigned int i = 0; i < tile_size; i++) {
+      uint64_t word = road_map.pool[static_cast<size_t>(tile) * tile_size + i];
+      for (unsigned int k = 0; k < 8; k++) {
+        tile_bytes[i * 8 + k] = static_cast<char>((word >> (k * 8)) & 0xff);
+      }
+    }
+    file.write(tile_bytes.data(), tile_bytes.size());
+  }
+  if (!file) {
+    throw std::runtime_error("Can't write map file \"" + path + "\".");
+  }
+}
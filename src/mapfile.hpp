@@ -0,0 +1,84 @@
+#ifndef MAPFILE_HPP
+#define MAPFILE_HPP
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "map.hpp"
+
+// マップファイルの書式
+// 先頭にテキストのヘッダ、続いて1マス1ビットに詰めた道路データを置く
+//
+//   ROADMAP <書式番号 1|2>
+//   size <X方向のマス数> <Y方向のマス数>
+//   initial <X座標> <Y座標> <North|South|East|West>
+//   landmarks <ランドマーク数>
+//   <X座標> <Y座標> <名称>        （ランドマーク数だけ繰り返す）
+//   rows                          （書式1の場合）
+//   tiles <タイル本体の数>        （書式2の場合）
+//   <道路データ>
+//
+// 書式1の道路データは行ごとに (X方向のマス数 + 7) / 8 バイトで、
+// X座標 x のマスは行内の x / 8 バイト目の下位から x % 8 ビット目（1:道路, 0:道路外）
+//
+// 書式2の道路データはBitGridのタイル分割そのままで、次の順に置く（数値はすべてリトルエンディアン）
+//   タイル表：X方向のタイル数 * Y方向のタイル数 個の32ビットの本体番号（行優先）
+//   詰め物：ファイル先頭から8バイト境界までの0
+//   タイル本体：64ビットのワード × 64行 を本体番号順に並べたもの（0番は全マス0の空タイル）
+// 書式2はタイル本体をコピーせずに使うので、巨大なマップでも読み込み時のメモリ確保がタイル表の分で済む
+
+// 読み込み専用でメモリマップしたファイル（スコープを抜けると解放する）
+// 開けない場合は、kind（ファイルの種類）を含むメッセージのruntime_errorをthrowする
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& path, const std::string& kind = "map file") {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("Can't open " + kind + " \"" + path + "\".");
+    }
+    struct stat st {};
+    if ((fstat(fd, &st) != 0) || (st.st_size == 0)) {
+      close(fd);
+      throw std::runtime_error("Can't read " + kind + " \"" + path + "\".");
+    }
+    size_ = st.st_size;
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+      throw std::runtime_error("Can't map " + kind + " \"" + path + "\".");
+    }
+    data_ = static_cast<const char*>(data);
+  }
+  ~MappedFile() {
+    munmap(const_cast<char*>(data_), size_);
+  }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+  // 読み方の見込みをカーネルに伝える関数（MADV_SEQUENTIALなど）
+  void advise(int advice) const { madvise(const_cast<char*>(data_), size_, advice); }
+
+ private:
+  const char* data_ {nullptr};
+  size_t size_ {0};
+};
+
+// マップファイルを読み込み、道路ビットマップと初期位置、ランドマーク一覧を設定する関数
+// ファイルはメモリマップし、書式1は1行ずつタイルへ取り込みながら、書式2はタイル表を読んだ後に袋小路を検証する
+// 書式の誤りや袋小路がある場合はruntime_errorをthrowする
+void loadMapFile(const std::string& path, std::vector<LandMark>& landmarks);
+
+// 現在の道路ビットマップと初期位置、ランドマーク一覧をマップファイル（書式2）に書き出す関数
+// 書き込めない場合はruntime_errorをthrowする
+void saveMapFile(const std::string& path, const std::vector<LandMark>& landmarks);
+
+// 方角を表す文字列をDirectionに変換する関数（不正な文字列の場合はfalseを返す）
+bool str2direction(const std::string& str, Direction& direction);
+
+#endif  // MAPFILE_HPP
@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <unordered_set>
+#include "mapgen.hpp"
+#include "profile.hpp"
+
+// 生成する地図のマス数の上限（マップファイルと同じ）
+constexpr unsigned int max_generated_size = 1u << 20;
+// ランドマークを置く場所を探す試行回数の上限（ランドマーク1つあたり）
+constexpr unsigned int place_attempts = 1000;
+
+// 乱数の用途ごとの識別子（同じ種でも用途ごとに異なる乱数列にする）
+constexpr uint64_t salt_row_gap = 1;
+constexpr uint64_t salt_column_gap = 2;
+constexpr uint64_t salt_segment = 3;
+constexpr uint64_t salt_initial = 4;
+constexpr uint64_t salt_landmark = 5;
+
+// 帯（タイルの1行分）の生成結果
+typedef struct {
+  std::vector<uint32_t> tiles;    // X方向のタイルごとの帯内の本体番号（0は空タイル、それ以外は1から）
+  std::vector<uint64_t> bodies;   // 帯内のタイル本体の並び
+} GeneratedBand;
+
+// splitmix64で64ビットの値をかき混ぜる関数
+static uint64_t mix64(uint64_t value) {
+  value += 0x9e3779b97f4a7c15ull;
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+  return value ^ (value >> 31);
+}
+
+// 種・用途・番号から乱数を返す関数
+// 順に引く乱数列ではなく番号から直接求めるので、どのスレッドがどの順で引いても同じ値になる
+static uint64_t hashRandom(uint64_t seed, uint64_t salt, uint64_t index) {
+  return mix64(mix64(seed ^ mix64(salt)) + index);
+}
+
+// 道路にする行（または列）の座標を、0 から size - 1 まで間隔 min_gap〜max_gap で選ぶ関数
+// 両端は必ず含み、最後の間隔だけは端に合わせるので max_gap + min_gap - 1 まで広がる
+static std::vector<unsigned int> chooseLines(unsigned int size, const MapGenConfig& config, uint64_t salt) {
+  std::vector<unsigned int> lines {0};
+  const unsigned int span = config.max_gap - config.min_gap + 1;
+  for (uint64_t k = 0;; k++) {
+    uint64_t next = lines.back() + config.min_gap + hashRandom(config.seed, salt, k) % span;
+    if (next + config.min_gap > size - 1) {
+      break;
+    }
+    lines.push_back(next);
+  }
+  lines.push_back(size - 1);
+  return lines;
+}
+
+// 行のビット列の X座標 from から to まで（toを含まない）を0にする関数
+static void clearBits(std::vector<uint64_t>& row, unsigned int from, unsigned int to) {
+  while (from < to) {
+    unsigned int count = std::min(to - from, 64 - from % 64);
+    uint64_t mask = (count == 64) ? ~uint64_t {0} : (((uint64_t {1} << count) - 1) << (from % 64));
+    row[from / 64] &= ~mask;
+    from += count;
+  }
+}
+
+// タイルの1行分（64行）の帯を生成する関数
+// row_line は行ごとの道路の行の番号（道路の行でなければ-1）、columns は道路の列のX座標
+static void generateBand(const MapGenConfig& config, unsigned int band, const std::vector<int>& row_line, unsigned int num_row_lines,
+                         const std::vector<unsigned int>& columns, const std::vector<uint64_t>& full_row,
+                         const std::vector<uint64_t>& column_row, GeneratedBand& out) {
+  const unsigned int words = full_row.size();
+  std::vector<uint64_t> rows(static_cast<size_t>(words) * tile_size, 0);
+  std::vector<uint64_t> row(words);
+  const unsigned int y_end = std::min(config.size_y, (band + 1) * tile_size);
+  for (unsigned int y = band * tile_size; y < y_end; y++) {
+    const int line = row_line[y];
+    if (line < 0) {
+      row = column_row;
+    } else {
+      row = full_row;
+      // 外周の行は途切れさせない
+      if ((line > 0) && (static_cast<unsigned int>(line) + 1 < num_row_lines)) {
+        for (size_t k = 0; k + 1 < columns.size(); k++) {
+          if (hashRandom(config.seed, salt_segment, (static_cast<uint64_t>(y) << 32) | k) % 100 < config.removal_percent) {
+            clearBits(row, columns[k] + 1, columns[k + 1]);
+          }
+        }
+      }
+    }
+    std::copy(row.begin(), row.end(), rows.begin() + static_cast<size_t>(y % tile_size) * words);
+  }
+
+  // 道路のあるタイルだけ本体を持つ
+  out.tiles.assign(words, 0);
+  out.bodies.clear();
+  for (unsigned int w = 0; w < words; w++) {
+    bool has_road {false};
+    for (unsigned int i = 0; i < tile_size; i++) {
+      has_road = has_road || (rows[static_cast<size_t>(i) * words + w] != 0);
+    }
+    if (!has_road) {
+      continue;
+    }
+    out.tiles[w] = out.bodies.size() / tile_size + 1;
+    for (unsigned int i = 0; i < tile_size; i++) {
+      out.bodies.push_back(rows[static_cast<size_t>(i) * words + w]);
+    }
+  }
+}
+
+// 生成条件に従って道路ビットマップと初期位置、ランドマーク一覧を作る関数
+// 帯ごとに独立に生成してから、帯の順にタイル本体をつなげる
+void generateMap(const MapGenConfig& config, std::vector<LandMark>& landmarks, unsigned int num_threads) {
+  PROFILE_SCOPE("mapgen.generateMap");
+  if ((config.size_x < 2) || (config.size_y < 2) || (config.size_x > max_generated_size) || (config.size_y > max_generated_size)) {
+    throw std::runtime_error("Map size must be between 2 and " + std::to_string(max_generated_size) + ".");
+  }
+  if ((config.min_gap < 2) || (config.max_gap < config.min_gap)) {
+    throw std::runtime_error("Road gaps must satisfy 2 <= min_gap <= max_gap.");
+  }
+  if (config.removal_percent > 100) {
+    throw std::runtime_error("Road removal percent must be 100 or less.");
+  }
+
+  // 道路の行・列を決め、道路の列だけの行と全マス道路の行のビット列を作っておく
+  const std::vector<unsigned int> row_lines = chooseLines(config.size_y, config, salt_row_gap);
+  const std::vector<unsigned int> columns = chooseLines(config.size_x, config, salt_column_gap);
+  std::vector<int> row_line(config.size_y, -1);
+  for (size_t i = 0; i < row_lines.size(); i++) {
+    row_line[row_lines[i]] = i;
+  }
+  initBitGrid(road_map, config.size_x, config.size_y);
+  const unsigned int words = road_map.words_per_row;
+  std::vector<uint64_t> full_row(words, 0);
+  std::vector<uint64_t> column_row(words, 0);
+  for (unsigned int x = 0; x < config.size_x; x++) {
+    full_row[x / 64] |= uint64_t {1} << (x % 64);
+  }
+  for (unsigned int x : columns) {
+    column_row[x / 64] |= uint64_t {1} << (x % 64);
+  }
+
+  // 帯をスレッドで分担して生成する
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  const unsigned int num_bands = road_map.tile_rows;
+  std::vector<GeneratedBand> bands(num_bands);
+  std::atomic<unsigned int> next_band {0};
+  auto worker = [&]() {
+    for (unsigned int band = next_band++; band < num_bands; band = next_band++) {
+      generateBand(config, band, row_line, row_lines.size(), columns, full_row, column_row, bands[band]);
+    }
+  };
+  std::vector<std::thread> workers;
+  for (unsigned int t = 1; t < std::min(num_threads, num_bands); t++) {
+    workers.emplace_back(worker);
+  }
+  worker();
+  for (std::thread& w : workers) {
+    w.join();
+  }
+
+  // 帯の順にタイル本体をつなげ、本体番号を振り直す
+  size_t num_bodies {1};
+  for (const GeneratedBand& band : bands) {
+    num_bodies += band.bodies.size() / tile_size;
+  }
+  road_map.owned->resize(num_bodies * tile_size, 0);
+  size_t base {0};
+  for (unsigned int b = 0; b < num_bands; b++) {
+    for (unsigned int w = 0; w < words; w++) {
+      if (bands[b].tiles[w] != 0) {
+        road_map.tiles[static_cast<size_t>(b) * words + w] = base + bands[b].tiles[w];
+      }
+    }
+    std::copy(bands[b].bodies.begin(), bands[b].bodies.end(), road_map.owned->begin() + (base + 1) * tile_size);
+    base += bands[b].bodies.size() / tile_size;
+  }
+  road_map.pool = road_map.owned->data();
+
+  // 初期位置は道路の列の上に、前が道路になる向きで置く（列は上端から下端まで途切れない）
+  const unsigned int initial_column = columns[hashRandom(config.seed, salt_initial, 0) % columns.size()];
+  const unsigned int start_y = hashRandom(config.seed, salt_initial, 1) % config.size_y;
+  initial_position = Position {initial_column, start_y, (start_y + 1 < config.size_y) ? Direction::South : Direction::North};
+
+  // ランドマークは初期位置以外の道路マスにランダムに置く
+  landmarks.clear();
+  std::unordered_set<uint64_t> used {cellKey(initial_position.x, initial_position.y)};
+  const uint64_t max_attempts = static_cast<uint64_t>(config.num_landmarks) * place_attempts;
+  for (uint64_t attempt = 0; landmarks.size() < config.num_landmarks; attempt++) {
+    if (attempt >= max_attempts) {
+      throw std::runtime_error("Can't place " + std::to_string(config.num_landmarks) + " landmarks on the road.");
+    }
+    const uint64_t value = hashRandom(config.seed, salt_landmark, attempt);
+    const unsigned int x = (value & 0xffffffff) % config.size_x;
+    const unsigned int y = (value >> 32) % config.size_y;
+    if (is_road(x, y) && used.insert(cellKey(x, y)).second) {
+      landmarks.push_back(LandMark {"landmark-" + std::to_string(landmarks.size() + 1), x, y});
+    }
+  }
+  buildStraightRuns();
+}
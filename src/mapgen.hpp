@@ -0,0 +1,31 @@
+#ifndef MAPGEN_HPP
+#define MAPGEN_HPP
+
+#include <cstdint>
+#include <vector>
+#include "map.hpp"
+
+// 地図の生成条件
+typedef struct {
+  unsigned int size_x;           // X方向のマス数（2以上）
+  unsigned int size_y;           // Y方向のマス数（2以上）
+  size_t num_landmarks;          // ランドマーク数
+  uint64_t seed;                 // 乱数の種
+  unsigned int min_gap;          // 隣り合う道路の行・列の間隔の最小値（2以上）
+  unsigned int max_gap;          // 隣り合う道路の行・列の間隔の最大値（min_gap以上）
+  unsigned int removal_percent;  // 内側の道路の行で、列の間の区間を取り除く割合（%）
+} MapGenConfig;
+
+// 生成条件の既定値（サイズ・ランドマーク数・種以外）
+constexpr unsigned int default_min_gap = 3;
+constexpr unsigned int default_max_gap = 12;
+constexpr unsigned int default_removal_percent = 25;
+
+// 生成条件に従って道路ビットマップと初期位置、ランドマーク一覧を作る関数
+// 道路は外周と、ランダムな間隔で選んだ行・列からなる碁盤の目で、内側の行からは列の間の区間をランダムに取り除く
+// 列と外周は途切れないので、袋小路が無く、すべての道路が（Uターンせずに）つながった地図になる
+// 結果は生成条件だけで決まり、スレッド数によらない（num_threadsが0の場合はハードウェアのスレッド数を使用する）
+// 生成条件が不正な場合や、ランドマークを置ききれない場合はruntime_errorをthrowする
+void generateMap(const MapGenConfig& config, std::vector<LandMark>& landmarks, unsigned int num_threads);
+
+#endif  // MAPGEN_HPP
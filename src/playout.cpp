@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <array>
+#include <thread>
+#include "playout.hpp"
+
+// splitmix64で乱数の状態を進め、次の乱数を返す関数
+static uint64_t nextRandom(uint64_t& state) {
+  state += 0x9e3779b97f4a7c15ull;
+  uint64_t value = state;
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+  return value ^ (value >> 31);
+}
+
+// その位置で実行できるコマンドを方針に従って並べ、数を返す関数
+static size_t listCommands(PlayoutPolicy policy, const GameState& state, std::array<Command, 6>& commands) {
+  size_t count {0};
+  if (is_continue_straight_enable(state.pos)) {
+    commands[count++] = Command::ContinueStraight;
+    commands[count++] = Command::Accelerate;
+    commands[count++] = Command::Decelerate;
+  }
+  if (is_turn_left_enable(state.pos)) {
+    commands[count++] = Command::TurnLeft;
+  }
+  if (is_turn_right_enable(state.pos)) {
+    commands[count++] = Command::TurnRight;
+  }
+  if (policy == PlayoutPolicy::Safe) {
+    // 道路外に出るコマンドを除く（位置と速度の写しで1手動かしてみる）
+    size_t kept {0};
+    for (size_t i = 0; i < count; i++) {
+      Position pos {state.pos};
+      unsigned int speed {state.speed};
+      if (moveCar(pos, speed, commands[i]) != MoveResult::WentOff) {
+        commands[kept++] = commands[i];
+      }
+    }
+    count = kept;
+  }
+  commands[count++] = Command::Stop;
+  return count;
+}
+
+// 1回のプレイアウトを最後まで進め、結果を集計に加える関数
+static void playOnce(const PlayoutConfig& config, uint64_t& rng, LandmarkIndex& index, PlayoutStats& stats, TrajectoryShard* shard) {
+  GameState state = initialGameState();
+  resetArrived(index);
+  std::array<Command, 6> commands {};
+  StepOutcome outcome {StepOutcome::Continue};
+  while ((outcome == StepOutcome::Continue) || (outcome == StepOutcome::CommandRejected)) {
+    size_t count = listCommands(config.policy, state, commands);
+    // 上位32ビットに候補数を掛けて、剰余を使わずに候補を選ぶ
+    size_t choice = static_cast<size_t>(((nextRandom(rng) >> 32) * count) >> 32);
+    outcome = stepGame(state, index, commands[choice]);
+    if (shard != nullptr) {
+      recordTrajectoryStep(*config.trajectories, *shard, state, outcome);
+    }
+  }
+
+  stats.playouts++;
+  stats.total_steps += state.steps;
+  stats.total_arrived += index.arrived_count;
+  if (outcome == StepOutcome::AllArrived) {
+    stats.completed++;
+    stats.step_counts[std::min<size_t>(state.steps, stats.step_counts.size() - 1)]++;
+  } else if (outcome == StepOutcome::OffRoad) {
+    stats.off_road++;
+  } else {
+    stats.fuel_out++;
+  }
+}
+
+// 初期位置からランダムにコマンドを選んでゲームを最後まで進めることを繰り返し、結果を集計する関数
+void runPlayouts(const PlayoutConfig& config, const LandmarkIndex& landmarks, PlayoutStats& stats) {
+  unsigned int num_threads = config.num_threads;
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  num_threads = static_cast<unsigned int>(std::max<uint64_t>(1, std::min<uint64_t>(num_threads, config.num_playouts)));
+
+  // スレッド t はプレイアウト [num_playouts * t / num_threads, num_playouts * (t + 1) / num_threads) を受け持つ
+  // 乱数の状態はプレイアウトの番号をかき混ぜて作るので、受け持ちの分け方は結果に影響しない
+  const PlayoutStats empty {0, 0, 0, 0, 0, 0, std::vector<uint64_t>(fuel_init + 1, 0)};
+  std::vector<PlayoutStats> thread_stats(num_threads, empty);
+  if (config.trajectories != nullptr) {
+    initTrajectoryAnalytics(*config.trajectories, num_threads);
+  }
+  auto worker = [&](unsigned int thread) {
+    LandmarkIndex index = landmarks;
+    PlayoutStats local = empty;
+    TrajectoryShard* shard = (config.trajectories != nullptr) ? &config.trajectories->shards[thread] : nullptr;
+    const uint64_t begin = config.num_playouts / num_threads * thread + config.num_playouts % num_threads * thread / num_threads;
+    const uint64_t end = config.num_playouts / num_threads * (thread + 1) + config.num_playouts % num_threads * (thread + 1) / num_threads;
+    for (uint64_t playout = begin; playout < end; playout++) {
+      uint64_t rng = config.seed ^ (playout * 0xd1b54a32d192ed03ull);
+      nextRandom(rng);
+      playOnce(config, rng, index, local, shard);
+    }
+    thread_stats[thread] = std::move(local);
+  };
+  std::vector<std::thread> workers;
+  for (unsigned int t = 1; t < num_threads; t++) {
+    workers.emplace_back(worker, t);
+  }
+  worker(0);
+  for (std::thread& w : workers) {
+    w.join();
+  }
+
+  stats = empty;
+  for (const PlayoutStats& s : thread_stats) {
+    stats.playouts += s.playouts;
+    stats.completed += s.completed;
+    stats.off_road += s.off_road;
+    stats.fuel_out += s.fuel_out;
+    stats.total_steps += s.total_steps;
+    stats.total_arrived += s.total_arrived;
+    for (size_t steps = 0; steps < stats.step_counts.size(); steps++) {
+      stats.step_counts[steps] += s.step_counts[steps];
+    }
+  }
+}
+
+// 集計した手数の分布のパーセンタイルを返す関数
+unsigned int playoutStepPercentile(const PlayoutStats& stats, double percentile) {
+  if (stats.completed == 0) {
+    return 0;
+  }
+  uint64_t rank = std::min(static_cast<uint64_t>(stats.completed * percentile), stats.completed - 1);
+  uint64_t seen {0};
+  for (size_t steps = 0; steps < stats.step_counts.size(); steps++) {
+    seen += stats.step_counts[steps];
+    if (seen > rank) {
+      return static_cast<unsigned int>(steps);
+    }
+  }
+  return 0;
+}
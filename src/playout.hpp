@@ -0,0 +1,45 @@
+#ifndef PLAYOUT_HPP
+#define PLAYOUT_HPP
+
+#include <cstdint>
+#include <vector>
+#include "map.hpp"
+#include "game.hpp"
+#include "trajectory.hpp"
+
+// プレイアウトで1手ごとのコマンドを選ぶ方針
+typedef enum {
+  Uniform,  // その位置で実行できるコマンド（is_turn_left_enable などで判定）から等確率で選ぶ
+  Safe,     // 実行できるコマンドのうち、道路外に出ないものから等確率で選ぶ（停止は常に選べる）
+} PlayoutPolicy;
+
+// プレイアウトの条件
+typedef struct {
+  uint64_t num_playouts;      // プレイアウトの回数
+  PlayoutPolicy policy;       // コマンドを選ぶ方針
+  uint64_t seed;              // 乱数の種
+  unsigned int num_threads;   // スレッド数（0の場合はハードウェアのスレッド数）
+  TrajectoryAnalytics* trajectories;  // 1手ごとの位置と結果を集計する場合の置き場（スレッドごとのシャードを用意する。nullptrの場合は集計しない）
+} PlayoutConfig;
+
+// プレイアウトの集計
+typedef struct {
+  uint64_t playouts;                  // 実行したプレイアウトの回数
+  uint64_t completed;                 // 全ランドマークに到達した回数
+  uint64_t off_road;                  // 道路外に出た回数
+  uint64_t fuel_out;                  // 燃料を使い切った回数
+  uint64_t total_steps;               // 全プレイアウトの手数の合計
+  uint64_t total_arrived;             // 全プレイアウトで到達したランドマーク数の合計
+  std::vector<uint64_t> step_counts;  // 全ランドマークに到達した時の手数ごとの回数（fuel_init + 1 個）
+} PlayoutStats;
+
+// 初期位置からランダムにコマンドを選んでゲームを最後まで進めることを繰り返し、結果を集計する関数
+// 1手ごとに燃料を1以上消費するので、どのプレイアウトも fuel_init 手以内に終わる
+// プレイアウトはスレッドごとに連続した範囲を受け持ち、索引のコピーと集計はスレッドごとに持つので、スレッド間で共有する書き込みは無い
+// 乱数はプレイアウトの番号と種から決まるので、結果はスレッド数によらず同じになる
+void runPlayouts(const PlayoutConfig& config, const LandmarkIndex& landmarks, PlayoutStats& stats);
+
+// 集計した手数の分布のパーセンタイルを返す関数（全ランドマークに到達したプレイアウトが無い場合は0）
+unsigned int playoutStepPercentile(const PlayoutStats& stats, double percentile);
+
+#endif  // PLAYOUT_HPP
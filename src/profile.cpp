@@ -0,0 +1,220 @@
+#include "profile.hpp"
+
+#ifdef ENABLE_PROFILE
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+// 時間のヒストグラムの区間数（2の累乗ごとの区間を8つに分ける）
+constexpr unsigned int profile_sub_buckets = 8;
+constexpr unsigned int profile_buckets = 64 * profile_sub_buckets;
+
+// 計測点ごとの集計
+typedef struct {
+  uint64_t count;                                     // 呼び出し回数
+  uint64_t total_ns;                                  // 合計時間(ns)
+  uint64_t max_ns;                                    // 最大時間(ns)
+  uint64_t allocations;                               // メモリ確保回数の合計（内側の計測点の分を含む）
+  std::array<uint64_t, profile_buckets> histogram;    // 時間のヒストグラム（パーセンタイルの計算用）
+} ProfileProbe;
+
+// スレッドごとの集計（そのスレッドだけが書き込み、書き出す時に足し合わせる）
+typedef struct {
+  std::vector<ProfileProbe> probes;   // 計測点の番号ごとの集計
+  std::vector<uint64_t> counters;     // カウンタの番号ごとの値
+  uint64_t allocations;               // スレッドが終わった時点のメモリ確保回数（終わっていなければ0）
+} ProfileShard;
+
+thread_local uint64_t profile_allocations {0};
+
+// メモリ確保回数を数えるため、operator newを置き換える（どのスレッドから呼ばれても、そのスレッドの回数だけを増やす）
+void* operator new(size_t size) {
+  profile_allocations++;
+  void* ptr = std::malloc((size == 0) ? 1 : size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+void operator delete(void* ptr, size_t) noexcept {
+  std::free(ptr);
+}
+
+// 登録した計測点とカウンタの名前（番号順）と、全スレッドの集計
+// 登録とスレッドの集計の追加だけをロックし、集計への書き込みはロックしない
+// 終わったスレッドの集計も書き出すまで残すので、集計はここで持つ
+static std::mutex registry_mutex;
+static std::vector<const char*> probe_names;
+static std::vector<const char*> counter_names;
+static std::vector<std::unique_ptr<ProfileShard>> shards;
+
+// 名前を登録して番号を返す関数（登録済みならその番号を返す）
+static unsigned int registerName(std::vector<const char*>& names, const char* name) {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  for (size_t i = 0; i < names.size(); i++) {
+    if (std::string(names[i]) == name) {
+      return i;
+    }
+  }
+  names.push_back(name);
+  return names.size() - 1;
+}
+
+// 名前の計測点を登録して番号を返す関数
+unsigned int profileProbe(const char* name) {
+  return registerName(probe_names, name);
+}
+
+// 名前のカウンタを登録して番号を返す関数
+unsigned int profileCounter(const char* name) {
+  return registerName(counter_names, name);
+}
+
+// スレッドの集計を初めて使う時に登録し、スレッドが終わる時にメモリ確保回数を残すオブジェクト
+class ShardHandle {
+ public:
+  ShardHandle() {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    shards.push_back(std::make_unique<ProfileShard>());
+    shard = shards.back().get();
+  }
+  ~ShardHandle() {
+    shard->allocations = profile_allocations;
+  }
+  ShardHandle(const ShardHandle&) = delete;
+  ShardHandle& operator=(const ShardHandle&) = delete;
+
+  ProfileShard* shard;
+};
+
+// 呼び出したスレッドの集計を返す関数
+static ProfileShard& localShard() {
+  thread_local ShardHandle handle;
+  return *handle.shard;
+}
+
+// 時間が入るヒストグラムの区間を返す関数（2の累乗ごとの区間を、上位ビットでさらに8つに分ける）
+static unsigned int bucketOf(uint64_t ns) {
+  if (ns < profile_sub_buckets) {
+    return ns;
+  }
+  unsigned int log2 = 63 - __builtin_clzll(ns);
+  unsigned int sub = (ns >> (log2 - 3)) & (profile_sub_buckets - 1);
+  return (log2 - 2) * profile_sub_buckets + sub;
+}
+
+// 区間の下端の時間を返す関数
+static uint64_t bucketFloor(unsigned int bucket) {
+  if (bucket < profile_sub_buckets) {
+    return bucket;
+  }
+  unsigned int log2 = bucket / profile_sub_buckets + 2;
+  return (uint64_t {1} << log2) | (static_cast<uint64_t>(bucket % profile_sub_buckets) << (log2 - 3));
+}
+
+// 呼び出したスレッドの集計で、計測点に1回分の時間とメモリ確保回数を加える関数
+void profileRecord(unsigned int id, uint64_t ns, uint64_t allocations) {
+  ProfileShard& shard = localShard();
+  if (id >= shard.probes.size()) {
+    shard.probes.resize(id + 1, ProfileProbe {0, 0, 0, 0, {}});
+  }
+  ProfileProbe& probe = shard.probes[id];
+  probe.count++;
+  probe.total_ns += ns;
+  probe.max_ns = std::max(probe.max_ns, ns);
+  probe.allocations += allocations;
+  probe.histogram[bucketOf(ns)]++;
+}
+
+// 呼び出したスレッドの集計で、カウンタに値を加える関数
+void profileCount(unsigned int id, uint64_t value) {
+  ProfileShard& shard = localShard();
+  if (id >= shard.counters.size()) {
+    shard.counters.resize(id + 1, 0);
+  }
+  shard.counters[id] += value;
+}
+
+// ヒストグラムからパーセンタイル（区間の下端、最大値を超えない）を求める関数
+static uint64_t percentile(const ProfileProbe& probe, double ratio) {
+  uint64_t rank = static_cast<uint64_t>(ratio * (probe.count - 1));
+  uint64_t seen {0};
+  for (unsigned int b = 0; b < profile_buckets; b++) {
+    seen += probe.histogram[b];
+    if (seen > rank) {
+      return std::min(bucketFloor(b), probe.max_ns);
+    }
+  }
+  return probe.max_ns;
+}
+
+// 終了時に全スレッドの集計を足し合わせ、JSONで書き出すオブジェクト（集計より後に定義し、先に破棄されるようにする）
+// 他のスレッドはすべて終わっているので、ロックせずに読む（メインスレッドの集計もthread_localの破棄で先に閉じている）
+class ProfileReporter {
+ public:
+  // メインスレッドの集計は、計測点を通らなくてもメモリ確保回数を書き出せるよう最初に登録しておく
+  ProfileReporter() {
+    localShard();
+  }
+  ~ProfileReporter() {
+    const char* path = std::getenv("PROFILE_OUTPUT");
+    std::ofstream file((path != nullptr) ? path : "profile.json");
+    if (!file) {
+      return;
+    }
+    std::vector<ProfileProbe> probes(probe_names.size(), ProfileProbe {0, 0, 0, 0, {}});
+    std::vector<uint64_t> counters(counter_names.size(), 0);
+    uint64_t allocations {0};
+    for (const std::unique_ptr<ProfileShard>& shard : shards) {
+      for (size_t i = 0; i < shard->probes.size(); i++) {
+        const ProfileProbe& part = shard->probes[i];
+        probes[i].count += part.count;
+        probes[i].total_ns += part.total_ns;
+        probes[i].max_ns = std::max(probes[i].max_ns, part.max_ns);
+        probes[i].allocations += part.allocations;
+        for (unsigned int b = 0; b < profile_buckets; b++) {
+          probes[i].histogram[b] += part.histogram[b];
+        }
+      }
+      for (size_t i = 0; i < shard->counters.size(); i++) {
+        counters[i] += shard->counters[i];
+      }
+      allocations += shard->allocations;
+    }
+
+    file << "{\n  \"probes\": [";
+    bool is_first {true};
+    for (size_t i = 0; i < probes.size(); i++) {
+      const ProfileProbe& probe = probes[i];
+      if (probe.count == 0) {
+        continue;
+      }
+      file << (is_first ? "\n" : ",\n");
+      is_first = false;
+      file << "    {\"name\": \"" << probe_names[i] << "\", \"count\": " << probe.count
+           << ", \"total_ns\": " << probe.total_ns << ", \"mean_ns\": " << (probe.total_ns / probe.count)
+           << ", \"p50_ns\": " << percentile(probe, 0.5) << ", \"p90_ns\": " << percentile(probe, 0.9)
+           << ", \"p99_ns\": " << percentile(probe, 0.99) << ", \"max_ns\": " << probe.max_ns
+           << ", \"allocations\": " << probe.allocations
+           << ", \"allocations_per_call\": " << (static_cast<double>(probe.allocations) / probe.count) << "}";
+    }
+    file << "\n  ],\n  \"counters\": [";
+    for (size_t i = 0; i < counters.size(); i++) {
+      file << ((i == 0) ? "\n" : ",\n") << "    {\"name\": \"" << counter_names[i] << "\", \"value\": " << counters[i] << "}";
+    }
+    file << "\n  ],\n  \"allocations\": " << allocations << "\n}\n";
+  }
+};
+static ProfileReporter reporter;
+
+#endif  // ENABLE_PROFILE
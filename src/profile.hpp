@@ -0,0 +1,68 @@
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+
+// 処理時間の計測（-DENABLE_PROFILE を付けてビルドした時だけ有効）
+//
+//   PROFILE_SCOPE("名前");          スコープの終わりまでの時間と、その間のメモリ確保回数を計測点「名前」に加える
+//   PROFILE_COUNT("名前", 値);      カウンタ「名前」に値を加える
+//
+// 計測点ごとに呼び出し回数・合計・平均・パーセンタイル・最大の時間とメモリ確保回数を集計し、
+// 終了時にJSONでファイル（環境変数 PROFILE_OUTPUT、無ければ profile.json）に書き出す
+// 集計はスレッドごとに別々に持ち（ロック無しで加える）、書き出す時に全スレッド分を足し合わせるので、どのスレッドから呼んでもよい
+// メモリ確保回数もスレッドごとに数え、計測点にはそのスレッドの分だけを加える（終了時の合計は、集計を持った全スレッドの合計）
+// 無効時はマクロが空になるので、引数の式も評価されず、処理時間は増えない
+
+#ifdef ENABLE_PROFILE
+
+#include <chrono>
+#include <cstdint>
+
+// スレッド開始からのメモリ確保回数（スレッドごと）
+extern thread_local uint64_t profile_allocations;
+
+// 名前の計測点・カウンタを登録して番号を返す関数（呼び出し箇所ごとに1度だけ呼ばれる）
+unsigned int profileProbe(const char* name);
+unsigned int profileCounter(const char* name);
+
+// 呼び出したスレッドの集計で、計測点に1回分の時間とメモリ確保回数を加える関数
+void profileRecord(unsigned int probe, uint64_t ns, uint64_t allocations);
+// 呼び出したスレッドの集計で、カウンタに値を加える関数
+void profileCount(unsigned int counter, uint64_t value);
+
+// スコープの開始から終了までを計測するクラス
+class ProfileScope {
+ public:
+  explicit ProfileScope(unsigned int probe)
+    : probe_(probe), allocations_(profile_allocations), start_(std::chrono::steady_clock::now()) {}
+  ~ProfileScope() {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count();
+    profileRecord(probe_, ns, profile_allocations - allocations_);
+  }
+  ProfileScope(const ProfileScope&) = delete;
+  ProfileScope& operator=(const ProfileScope&) = delete;
+
+ private:
+  unsigned int probe_;
+  uint64_t allocations_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name)                                                                  \
+  static const unsigned int PROFILE_CONCAT(profile_probe_, __LINE__) = profileProbe(name);   \
+  ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(PROFILE_CONCAT(profile_probe_, __LINE__))
+#define PROFILE_COUNT(name, value)                                        \
+  do {                                                                    \
+    static const unsigned int profile_counter = profileCounter(name);     \
+    profileCount(profile_counter, (value));                               \
+  } while (0)
+
+#else
+
+#define PROFILE_SCOPE(name)
+#define PROFILE_COUNT(name, value)
+
+#endif  // ENABLE_PROFILE
+
+#endif  // PROFILE_HPP
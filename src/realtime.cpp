@@ -0,0 +1,305 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include "realtime.hpp"
+#include "renderer.hpp"
+#include "profile.hpp"
+
+// 入力の終わりと割り込み（Ctrl-C）を表すキー（端末の設定を変えた後は、Ctrl-Cもキーとして読める）
+constexpr char key_end = '\x04';
+constexpr char key_interrupt = '\x03';
+// ゲームを終えるキー
+constexpr char key_quit = 'q';
+// 入力スレッドが終了の指示を確かめる間隔（ミリ秒）
+constexpr int input_poll_ms = 20;
+// 描画スレッドが次の写しを待つ間隔（マイクロ秒）
+constexpr unsigned int render_idle_us = 1000;
+
+// 端末を1キーずつ読む設定（行の編集・エコー・シグナル無し）にし、破棄する時に元に戻すクラス
+// 端末でない場合は何もしない
+class RawTerminal {
+ public:
+  explicit RawTerminal(int fd) : fd_(fd) {
+    if (isatty(fd) && (tcgetattr(fd, &original_) == 0)) {
+      termios raw = original_;
+      raw.c_lflag &= ~(ICANON | ECHO | ISIG);
+      raw.c_cc[VMIN] = 1;
+      raw.c_cc[VTIME] = 0;
+      is_raw_ = (tcsetattr(fd, TCSANOW, &raw) == 0);
+    }
+  }
+  ~RawTerminal() {
+    if (is_raw_) {
+      tcsetattr(fd_, TCSANOW, &original_);
+    }
+  }
+  RawTerminal(const RawTerminal&) = delete;
+  RawTerminal& operator=(const RawTerminal&) = delete;
+
+ private:
+  int fd_;
+  bool is_raw_ {false};
+  termios original_ {};
+};
+
+// 入力の待ち行列
+typedef SpscQueue<char, realtime_input_capacity> InputQueue;
+
+// 描画スレッドとの写しの受け渡し
+// 置き場は2つで、シミュレーション側は空いている置き場（free_slots）に書いて描画待ち（ready_slots）に積み、
+// 描画側は描画待ちから取り出して描画した後に空きへ戻す。置き場が空いていなければシミュレーション側は待たずにその回の受け渡しを諦める
+typedef struct {
+  std::array<RealtimeSnapshot, 2> slots;  // 写しの置き場
+  SpscQueue<unsigned int, 2> free_slots;  // 書き込める置き場の番号
+  SpscQueue<unsigned int, 2> ready_slots; // 描画を待つ置き場の番号
+  std::atomic<bool> is_finished;          // 最後の写しを積み終えたか
+} FrameExchange;
+
+// 描画側の状態（描画するスレッドだけが触る）
+typedef struct {
+  FrameRenderer renderer;  // 描画器
+  LandmarkIndex view;      // 描画に使うランドマークの索引（到達済みフラグを写しから書き写す）
+  uint64_t rendered;       // 描画したフレーム数
+  uint64_t dropped;        // 描画待ちのうち、より新しい写しがあったので描画しなかったフレーム数
+} FramePainter;
+
+// 入力を読んで待ち行列に積む関数（入力スレッドで動かす）
+// 終了の指示を確かめられるよう、読めるまで一定の間隔で待つ。入力が終わったら終わりのキーを積んで戻る
+// 待ち行列が満杯の時はこのスレッドだけが空くのを待つので、入力を捨てることもシミュレーションを止めることも無い
+static void readInput(int fd, InputQueue& input, const std::atomic<bool>& is_stopping) {
+  auto pushKey = [&](char key) {
+    while (!input.push(key)) {
+      if (is_stopping.load(std::memory_order_relaxed)) {
+        return;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(input_poll_ms));
+    }
+  };
+  char buffer[64];
+  while (!is_stopping.load(std::memory_order_relaxed)) {
+    pollfd target {fd, POLLIN, 0};
+    int ready = poll(&target, 1, input_poll_ms);
+    if (ready == 0) {
+      continue;
+    }
+    ssize_t length = (ready > 0) ? read(fd, buffer, sizeof(buffer)) : -1;
+    if ((length < 0) && ((errno == EINTR) || (errno == EAGAIN))) {
+      continue;
+    }
+    if (length <= 0) {
+      pushKey(key_end);
+      return;
+    }
+    for (ssize_t i = 0; i < length; i++) {
+      pushKey(buffer[i]);
+    }
+  }
+}
+
+// 描画待ちの写しのうち最も新しいものを描画する関数（描画するスレッドだけが呼ぶ）
+static void paintNewestFrame(FrameExchange& exchange, FramePainter& painter) {
+  unsigned int slot {};
+  unsigned int newest {};
+  bool has_frame {false};
+  while (exchange.ready_slots.pop(slot)) {
+    if (has_frame) {
+      exchange.free_slots.push(newest);
+      painter.dropped++;
+    }
+    newest = slot;
+    has_frame = true;
+  }
+  if (!has_frame) {
+    return;
+  }
+  const RealtimeSnapshot& snapshot = exchange.slots[newest];
+  painter.view.arrived = snapshot.arrived;
+  painter.view.arrived_count = snapshot.arrived_count;
+  if (snapshot.show_overview != painter.renderer.show_overview) {
+    toggleOverview(painter.renderer);
+  }
+  renderFrame(painter.renderer, painter.view, snapshot.state, snapshot.message);
+  exchange.free_slots.push(newest);
+  painter.rendered++;
+}
+
+// 最後の写しが積まれるまで描画を続ける関数（描画スレッドで動かす）
+static void paintFrames(FrameExchange& exchange, FramePainter& painter) {
+  while (true) {
+    // 終了を先に確かめてから描画するので、終了の前に積まれた最後の写しも描画される
+    const bool is_finished = exchange.is_finished.load(std::memory_order_acquire);
+    paintNewestFrame(exchange, painter);
+    if (is_finished) {
+      return;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(render_idle_us));
+  }
+}
+
+// 写しを描画スレッドに渡す関数（置き場が空いていなければ待たずにfalseを返す）
+static bool publishSnapshot(FrameExchange& exchange, const GameState& state, const LandmarkIndex& landmarks,
+                            bool show_overview, const std::string& message) {
+  unsigned int slot {};
+  if (!exchange.free_slots.pop(slot)) {
+    return false;
+  }
+  RealtimeSnapshot& snapshot = exchange.slots[slot];
+  snapshot.state = state;
+  snapshot.arrived = landmarks.arrived;
+  snapshot.arrived_count = landmarks.arrived_count;
+  snapshot.show_overview = show_overview;
+  snapshot.message = message;
+  exchange.ready_slots.push(slot);
+  return true;
+}
+
+// 予定の時刻まで待つ関数
+// 直前までは眠り、残りのtick_spin_usは時刻を見ながら待つので、眠りから起きる遅れがティックの揺らぎにならない
+static void waitUntil(std::chrono::steady_clock::time_point deadline) {
+  const auto wake = deadline - std::chrono::microseconds(tick_spin_us);
+  if (std::chrono::steady_clock::now() < wake) {
+    std::this_thread::sleep_until(wake);
+  }
+  while (std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::yield();
+  }
+}
+
+// ゲームが終わった結果か否かを返す関数
+static bool is_game_finished(StepOutcome outcome) {
+  return (outcome != StepOutcome::Continue) && (outcome != StepOutcome::CommandRejected);
+}
+
+// 一定の間隔のティックでゲームを進める関数
+void runRealtime(const RealtimeConfig& config, LandmarkIndex& landmarks, const LandmarkFields& fields,
+                 ReplayRecorder& recorder, RealtimeStats& stats) {
+  stats = RealtimeStats {};
+  RawTerminal terminal(config.input_fd);
+
+  // 入力スレッドを始める
+  InputQueue input;
+  std::atomic<bool> is_stopping {false};
+  std::thread reader(readInput, config.input_fd, std::ref(input), std::cref(is_stopping));
+
+  // 描画スレッドを始める（写しの置き場は2つとも空きにしておく）
+  FrameExchange exchange {};
+  exchange.free_slots.push(0);
+  exchange.free_slots.push(1);
+  FramePainter painter {};
+  initRenderer(painter.renderer, config.output_fd);
+  painter.view = landmarks;
+  std::thread painter_thread(paintFrames, std::ref(exchange), std::ref(painter));
+
+  GameState state = initialGameState();
+  StepOutcome outcome {StepOutcome::Continue};
+  std::deque<Command> pending;  // 次の手以降に実行するコマンド
+  std::string message = finishWarning(fields, landmarks, state);
+  bool show_overview {false};
+  uint64_t unpublished {1};  // 描画スレッドに渡していない状態の変化の数
+
+  // 1手進める関数（ゲームを進めたコマンドはすべてリプレイ記録に残す）
+  // 記録を書き込めなくなった場合は、端末を描画スレッドが使っているので警告はメッセージ欄に出し、記録を閉じて続ける
+  auto step = [&](Command command) {
+    std::string notice;
+    try {
+      recordCommand(recorder, state, landmarks, command);
+    } catch (const std::runtime_error& e) {
+      recorder.file.close();
+      notice = std::string("Replay recording stopped: ") + e.what();
+    }
+    outcome = stepGame(state, landmarks, command);
+    message = (outcome == StepOutcome::CommandRejected) ? rejectedMessage(command) : "";
+    if (!notice.empty()) {
+      message = notice + (message.empty() ? "" : " ") + message;
+    }
+    std::string warning = finishWarning(fields, landmarks, state);
+    if (!warning.empty()) {
+      message += (message.empty() ? "" : " ") + warning;
+    }
+    unpublished++;
+  };
+
+  const auto period = std::chrono::nanoseconds(1000000000ull / config.tick_hz);
+  const auto start = std::chrono::steady_clock::now();
+  auto deadline = start;
+  while (!is_game_finished(outcome)) {
+    waitUntil(deadline);
+    const auto now = std::chrono::steady_clock::now();
+    const double jitter_us = std::chrono::duration<double, std::micro>(now - deadline).count();
+    stats.total_jitter_us += jitter_us;
+    stats.max_jitter_us = std::max(stats.max_jitter_us, jitter_us);
+    if (now - deadline >= period) {
+      // 遅れを取り戻そうとティックを詰めて進めることはせず、今から予定を取り直す
+      stats.late_ticks++;
+      deadline = now;
+    }
+    deadline += period;
+    stats.ticks++;
+
+    // 積まれたキーを取り出す（表示の切替と終了はすぐに反映し、ゲームを進めるコマンドは次の手以降に回す）
+    char key {};
+    while (!is_game_finished(outcome) && input.pop(key)) {
+      Command command {};
+      if ((key == ' ') || (key == '\n') || (key == '\r')) {
+        continue;
+      } else if ((key == key_quit) || (key == key_interrupt)) {
+        step(Command::GameEnd);
+      } else if (key == key_end) {
+        // 入力の終わりは、それまでに積まれたコマンドを実行し終えてから終了する
+        pending.push_back(Command::GameEnd);
+      } else if (!str2command(std::string(1, key), command)) {
+        message = "Invalid key '" + std::string(1, key) + "'.";
+        unpublished++;
+      } else if (command == Command::ToggleOverview) {
+        show_overview = !show_overview;
+        unpublished++;
+      } else if ((command == Command::Hint) || is_history_command(command)) {
+        message = "Hint, undo and redo are not available in real-time mode.";
+        unpublished++;
+      } else {
+        pending.push_back(command);
+      }
+    }
+
+    // 一定のティックごとに1手進める（コマンドが無ければ直進し、今の速度で進み続ける）
+    if (!is_game_finished(outcome) && (stats.ticks % config.ticks_per_step == 0)) {
+      Command command {Command::ContinueStraight};
+      if (!pending.empty()) {
+        command = pending.front();
+        pending.pop_front();
+      }
+      step(command);
+    }
+
+    // 変化があれば描画スレッドに渡す（描画が追いついていなければ渡さずに進み、間に合わなかった分をフレーム落ちとして数える）
+    if ((unpublished > 0) && !is_game_finished(outcome)
+     && publishSnapshot(exchange, state, landmarks, show_overview, message)) {
+      stats.frames_dropped += unpublished - 1;
+      unpublished = 0;
+    }
+  }
+  stats.elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  // 最後の状態は必ず描画する（ゲームは終わっているので、置き場が空くのを待ってよい）
+  while (!publishSnapshot(exchange, state, landmarks, show_overview, message)) {
+    std::this_thread::sleep_for(std::chrono::microseconds(render_idle_us));
+  }
+  stats.frames_dropped += unpublished - 1;
+  exchange.is_finished.store(true, std::memory_order_release);
+  painter_thread.join();
+  is_stopping.store(true, std::memory_order_relaxed);
+  reader.join();
+
+  stats.state = state;
+  stats.outcome = outcome;
+  stats.frames_rendered = painter.rendered;
+  stats.frames_dropped += painter.dropped;
+}
@@ -0,0 +1,100 @@
+#ifndef REALTIME_HPP
+#define REALTIME_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "map.hpp"
+#include "game.hpp"
+#include "field.hpp"
+#include "replay.hpp"
+
+// 既定の1秒あたりのティック数と、1手を進めるティック数（60Hzで1秒に4手）
+constexpr unsigned int default_tick_hz = 60;
+constexpr unsigned int default_ticks_per_step = 15;
+// 入力の待ち行列の大きさ（キー1つで1要素。満杯の間は入力スレッドだけが空くのを待つ）
+constexpr size_t realtime_input_capacity = 256;
+// ティックの予定の時刻の手前で、眠るのをやめて待ち続ける時間（マイクロ秒）
+// OSの眠りから起きる遅れを、この時間の空回りで吸収してティックの揺らぎを小さくする
+constexpr unsigned int tick_spin_us = 500;
+
+// 単一の生産者・単一の消費者の待ち行列（ロック無し）
+// 読み出す位置は消費者だけが、書き込む位置は生産者だけが進めるので、ロックもread-modify-writeの命令も要らない
+// 満杯の時は待たずにpushがfalseを返すので、生産者が止まることは無い
+template <typename T, size_t Capacity>
+class SpscQueue {
+  static_assert((Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two.");
+
+ public:
+  // 末尾に積む関数（生産者だけが呼ぶ。満杯の場合はfalseを返す）
+  bool push(const T& value) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == Capacity) {
+      return false;
+    }
+    items_[tail % Capacity] = value;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // 先頭から取り出す関数（消費者だけが呼ぶ。空の場合はfalseを返す）
+  bool pop(T& value) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    value = items_[head % Capacity];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+ private:
+  std::array<T, Capacity> items_ {};
+  alignas(64) std::atomic<size_t> head_ {0};  // 次に読み出す位置
+  alignas(64) std::atomic<size_t> tail_ {0};  // 次に書き込む位置
+};
+
+// 描画スレッドに渡すゲーム状態の写し
+typedef struct {
+  GameState state;                // ゲーム状態
+  std::vector<uint64_t> arrived;  // 到達済みフラグ
+  unsigned int arrived_count;     // 到達済みランドマーク数
+  bool show_overview;             // 縮小図を表示するか
+  std::string message;            // 表示するメッセージ
+} RealtimeSnapshot;
+
+// リアルタイムモードの設定
+typedef struct {
+  unsigned int tick_hz;         // 1秒あたりのティック数
+  unsigned int ticks_per_step;  // 1手を進めるティック数
+  int input_fd;                 // 入力を読むファイルディスクリプタ
+  int output_fd;                // 画面を出力するファイルディスクリプタ
+} RealtimeConfig;
+
+// リアルタイムモードの結果と集計
+typedef struct {
+  GameState state;            // 終了時のゲーム状態
+  StepOutcome outcome;        // ゲームの結果
+  uint64_t ticks;             // 進めたティック数
+  double elapsed;             // 経過時間（秒）
+  double total_jitter_us;     // ティックの開始の、予定の時刻からの遅れの合計（マイクロ秒）
+  double max_jitter_us;       // ティックの開始の遅れの最大（マイクロ秒）
+  uint64_t late_ticks;        // 1ティック分以上遅れて始まったティック数（予定を取り直して追いつこうとはしない）
+  uint64_t frames_rendered;   // 描画したフレーム数
+  uint64_t frames_dropped;    // 描画が追いつかず、描画されずに次の状態に置き換わったフレーム数
+} RealtimeStats;
+
+// 一定の間隔のティックでゲームを進める関数
+// 入力スレッドがキーを読んで待ち行列に積み、この関数を呼んだスレッドがティックごとに待たずにそれを取り出してゲームを進め、
+// 描画スレッドが2つの写しを交互に受け取って描画する（写しの受け渡しもロック無しの待ち行列で行う）
+// ticks_per_stepティックごとに、積まれたコマンドを1つ実行して1手進める（積まれていなければ直進し、今の速度で進み続ける）
+// 表示の切替はすぐに反映し、終了（q、Ctrl-C、入力の終わり）はすぐにゲームを終える。ヒントと手の取り消し・やり直しは使えない
+// 描画が追いつかない場合もシミュレーションは待たず、描画されなかったフレームを数える
+// 入力が端末の場合は、1キーずつ読めるよう端末の設定を変え、終了時に戻す
+void runRealtime(const RealtimeConfig& config, LandmarkIndex& landmarks, const LandmarkFields& fields,
+                 ReplayRecorder& recorder, RealtimeStats& stats);
+
+#endif  // REALTIME_HPP
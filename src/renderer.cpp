@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include "renderer.hpp"
+#include "profile.hpp"
+
+// マップ横の凡例に確保する幅
+constexpr unsigned int legend_width = 40;
+// 差分出力で、この文字数以下の変化していない隙間は1つの書き込みにまとめる
+constexpr unsigned int diff_merge_gap = 4;
+// 表示範囲の既定の大きさ（標準マップ全体が収まる大きさ）
+constexpr unsigned int default_view_width = 100;
+constexpr unsigned int default_view_height = 50;
+// 端末の大きさに合わせる時の表示範囲の最小の大きさ（凡例が収まる大きさ）
+constexpr unsigned int min_view_width = 16;
+constexpr unsigned int min_view_height = 8;
+// 凡例の下に表示範囲または縮小図の説明を表示する行
+constexpr unsigned int view_legend_row = 8;
+
+// 描画器を初期化する関数
+void initRenderer(FrameRenderer& renderer, int fd) {
+  renderer.fd = fd;
+  renderer.is_tty = isatty(fd);
+  renderer.has_front = false;
+  renderer.show_overview = false;
+
+  // 端末では、凡例・状態表示・メッセージ・入力欄と、入力の改行で進む1行を除いた大きさを表示範囲にする
+  unsigned int view_width = default_view_width;
+  unsigned int view_height = default_view_height;
+  winsize size {};
+  if (renderer.is_tty && (ioctl(fd, TIOCGWINSZ, &size) == 0) && (size.ws_col > 0) && (size.ws_row > 0)) {
+    view_width = std::max(min_view_width, (size.ws_col > legend_width) ? size.ws_col - legend_width : 0u);
+    view_height = std::max(min_view_height, (size.ws_row > 4u) ? size.ws_row - 4u : 0u);
+  }
+  renderer.view_width = std::min(road_map.size_x, view_width);
+  renderer.view_height = std::min(road_map.size_y, view_height);
+  renderer.view_x = 0;
+  renderer.view_y = 0;
+
+  // 表示範囲の各行 + 状態表示 + メッセージ
+  renderer.width = renderer.view_width + legend_width;
+  renderer.height = renderer.view_height + 2;
+  renderer.front.assign(static_cast<size_t>(renderer.width) * renderer.height, ' ');
+  renderer.back.assign(static_cast<size_t>(renderer.width) * renderer.height, ' ');
+  renderer.out.reserve(renderer.back.size() * 2);
+}
+
+// 状態表示の1行を返す関数
+std::string statusLine(const LandmarkIndex& index, const GameState& state) {
+  PROFILE_SCOPE("render.statusLine");
+  return "Step: " + std::to_string(state.steps) + ", Fuel: " + std::to_string(state.fuel)
+       + ", Position: (" + std::to_string(state.pos.x) + ", " + std::to_string(state.pos.y) + "), "
+       + "Direction: " + direction2str(state.pos.direction) + ", Speed: " + std::to_string(state.speed) + ", "
+       + lookforNearLandmark(index, state.pos);
+}
+
+// 表示範囲とマップ全体の縮小図の表示を切り替える関数
+void toggleOverview(FrameRenderer& renderer) {
+  if (renderer.mipmap.levels.empty()) {
+    buildRoadMipmap(renderer.mipmap);
+  }
+  renderer.show_overview = !renderer.show_overview;
+}
+
+// 表示範囲の1軸分の左上の座標を返す関数
+// 自己位置が表示範囲の端（長さの1/4以内）に来たら、自己位置が中央になるよう動かす
+// 毎手動かさないことで、端末への差分出力を小さく保つ
+static unsigned int followAxis(unsigned int view, unsigned int length, unsigned int world, unsigned int pos) {
+  unsigned int margin = length / 4;
+  bool near_begin = (view > 0) && (pos < view + margin);
+  bool near_end = (view + length < world) && (pos + margin >= view + length);
+  if (near_begin || near_end) {
+    view = std::min(std::max(pos, length / 2) - length / 2, world - length);
+  }
+  return view;
+}
+
+// 文字列をフレームの1行に書き込む関数（幅を超える部分は切り捨てる）
+static void putText(FrameRenderer& renderer, unsigned int row, unsigned int column, const char* text, size_t length) {
+  if (column < renderer.width) {
+    std::memcpy(&renderer.back[static_cast<size_t>(row) * renderer.width + column], text, std::min<size_t>(length, renderer.width - column));
+  }
+}
+
+// 端末がフレーム全体を表示できる大きさかを判断する関数
+static bool is_frame_fit(const FrameRenderer& renderer) {
+  winsize size {};
+  if (ioctl(renderer.fd, TIOCGWINSZ, &size) != 0) {
+    return false;
+  }
+  // 入力欄の1行と、入力の改行やメッセージで次に進む1行を含めて収まる必要がある
+  // 入力欄が最終行にあると、改行で画面がスクロールし、以降の差分が古い位置に描かれるため
+  return (size.ws_col >= renderer.width) && (size.ws_row > renderer.height + 1);
+}
+
+// フレーム全体を改行区切りで出力用バッファに積む関数（凡例・状態表示の後ろの空白は省く）
+static void appendFullFrame(FrameRenderer& renderer) {
+  for (unsigned int i = 0; i < renderer.height; i++) {
+    const char* row = &renderer.back[static_cast<size_t>(i) * renderer.width];
+    size_t min_length = (i < renderer.view_height) ? renderer.view_width : 0;
+    size_t length = renderer.width;
+    while ((length > min_length) && (row[length - 1] == ' ')) {
+      length--;
+    }
+    // 端末以外への出力では、空のメッセージ行は出力しない
+    if ((i == renderer.height - 1) && (length == 0) && !renderer.is_tty) {
+      continue;
+    }
+    renderer.out.append(row, length);
+    renderer.out.append("\n");
+  }
+}
+
+// カーソルを指定の行・列（0始まり）へ移動するエスケープシーケンスを出力用バッファに積む関数
+static void appendCursorMove(FrameRenderer& renderer, unsigned int row, unsigned int column) {
+  char sequence[32];
+  int length = std::snprintf(sequence, sizeof(sequence), "\x1b[%u;%uH", row + 1, column + 1);
+  renderer.out.append(sequence, length);
+}
+
+// 前回のフレームと異なる部分だけをカーソル移動付きで出力用バッファに積む関数
+static void appendDiffFrame(FrameRenderer& renderer) {
+  for (unsigned int i = 0; i < renderer.height; i++) {
+    const char* back = &renderer.back[static_cast<size_t>(i) * renderer.width];
+    const char* front = &renderer.front[static_cast<size_t>(i) * renderer.width];
+    unsigned int j = 0;
+    while (j < renderer.width) {
+      if (back[j] == front[j]) {
+        j++;
+        continue;
+      }
+      // 変化した区間の終わりを探す（短い隙間は区間に含める）
+      unsigned int begin = j;
+      unsigned int end = j + 1;
+      for (unsigned int k = end; (k < renderer.width) && (k <= end + diff_merge_gap); k++) {
+        if (back[k] != front[k]) {
+          end = k + 1;
+        }
+      }
+      appendCursorMove(renderer, i, begin);
+      renderer.out.append(back + begin, end - begin);
+      j = end;
+    }
+  }
+}
+
+// 出力用バッファをまとめて書き込む関数
+static void flushOutput(FrameRenderer& renderer) {
+  PROFILE_SCOPE("render.flushOutput");
+  PROFILE_COUNT("render.bytes", renderer.out.size());
+  const char* data = renderer.out.data();
+  size_t remaining = renderer.out.size();
+  while (remaining > 0) {
+    ssize_t written = write(renderer.fd, data, remaining);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    data += written;
+    remaining -= written;
+  }
+}
+
+// フレームを組み立てて、出力するバイト列をrenderer.outに積む関数
+void composeFrame(FrameRenderer& renderer, const LandmarkIndex& index, const GameState& state, const std::string& message) {
+  // 裏側のバッファにフレームを組み立てる
+  std::fill(renderer.back.begin(), renderer.back.end(), ' ');
+  std::string view_legend;
+  if (renderer.show_overview) {
+    unsigned int level = selectMipmapLevel(renderer.mipmap, renderer.view_width, renderer.view_height);
+    for (unsigned int i = 0; i < renderer.view_height; i++) {
+      composeOverviewRow(renderer.mipmap, level, index, state.pos, i, renderer.view_width, &renderer.back[static_cast<size_t>(i) * renderer.width]);
+    }
+    unsigned int block = mipmap_block << level;
+    view_legend = "  Overview: 1 char = " + std::to_string(block) + "x" + std::to_string(block) + " cells";
+  } else {
+    renderer.view_x = followAxis(renderer.view_x, renderer.view_width, road_map.size_x, state.pos.x);
+    renderer.view_y = followAxis(renderer.view_y, renderer.view_height, road_map.size_y, state.pos.y);
+    for (unsigned int i = 0; i < renderer.view_height; i++) {
+      composeMapRow(index, state.pos, renderer.view_y + i, renderer.view_x, renderer.view_width, &renderer.back[static_cast<size_t>(i) * renderer.width]);
+    }
+    // マップの一部だけを表示している時は表示範囲を示す
+    if ((renderer.view_width < road_map.size_x) || (renderer.view_height < road_map.size_y)) {
+      view_legend = "  View: X " + std::to_string(renderer.view_x) + "-" + std::to_string(renderer.view_x + renderer.view_width - 1)
+                  + ", Y " + std::to_string(renderer.view_y) + "-" + std::to_string(renderer.view_y + renderer.view_height - 1);
+    }
+  }
+  for (unsigned int i = 0; i < renderer.view_height; i++) {
+    const char* legend = mapLegend(i);
+    putText(renderer, i, renderer.view_width, legend, std::strlen(legend));
+  }
+  if (view_legend_row < renderer.view_height) {
+    putText(renderer, view_legend_row, renderer.view_width, view_legend.data(), view_legend.size());
+  }
+  std::string status = statusLine(index, state);
+  putText(renderer, renderer.view_height, 0, status.data(), status.size());
+
+  renderer.out.clear();
+  if (!renderer.is_tty || !is_frame_fit(renderer)) {
+    // 端末以外は、メッセージに続けてフレーム全体を出力する
+    if (!message.empty()) {
+      renderer.out.append(message).append("\n");
+    }
+    appendFullFrame(renderer);
+    renderer.has_front = false;
+  } else {
+    // 端末ではメッセージもフレームの最終行に含め、初回は画面を消して全体を、以降は差分を出力する
+    putText(renderer, renderer.height - 1, 0, message.data(), message.size());
+    if (renderer.has_front) {
+      appendDiffFrame(renderer);
+    } else {
+      renderer.out.append("\x1b[H\x1b[2J");
+      appendFullFrame(renderer);
+    }
+    // 入力欄へカーソルを移し、前回の入力を消す
+    appendCursorMove(renderer, renderer.height, 0);
+    renderer.out.append("\x1b[J");
+    renderer.front.swap(renderer.back);
+    renderer.has_front = true;
+  }
+}
+
+// フレームを組み立てて1回のwriteで出力する関数
+void renderFrame(FrameRenderer& renderer, const LandmarkIndex& index, const GameState& state, const std::string& message) {
+  PROFILE_SCOPE("render.renderFrame");
+  composeFrame(renderer, index, state, message);
+  // std::coutに溜まっている出力を先に出してから書き込む
+  std::cout.flush();
+  flushOutput(renderer);
+}
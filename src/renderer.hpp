@@ -0,0 +1,48 @@
+#ifndef RENDERER_HPP
+#define RENDERER_HPP
+
+#include <string>
+#include <vector>
+#include "map.hpp"
+#include "game.hpp"
+
+// 画面1枚分（マップ、凡例、状態表示、メッセージ）を組み立てて出力する描画器
+// マップは自己位置を追う表示範囲（ビューポート）の分だけを組み立てるので、
+// 1フレームの手間はマップ全体ではなく表示範囲の大きさで決まる
+// 端末への出力時は前回のフレームとの差分だけをカーソル移動付きで送り、
+// 端末以外（パイプやファイル）への出力時はフレーム全体を送る
+typedef struct {
+  int fd;                    // 出力先のファイルディスクリプタ
+  bool is_tty;               // 出力先が端末か
+  bool has_front;            // frontに前回出力したフレームが入っているか
+  bool show_overview;        // 表示範囲の代わりにマップ全体の縮小図を表示するか
+  unsigned int view_x;       // 表示範囲の左上のX座標
+  unsigned int view_y;       // 表示範囲の左上のY座標
+  unsigned int view_width;   // 表示範囲の幅（マス数）
+  unsigned int view_height;  // 表示範囲の高さ（マス数）
+  unsigned int width;        // フレームの幅（文字数）
+  unsigned int height;       // フレームの高さ（行数）
+  std::vector<char> front;   // 前回出力したフレーム
+  std::vector<char> back;    // 今回組み立てるフレーム
+  std::string out;           // 出力するバイト列（確保済みの領域を使い回す）
+  RoadMipmap mipmap;         // 縮小図（初めて表示する時に作る）
+} FrameRenderer;
+
+// 描画器を初期化する関数
+// 表示範囲は、端末へ出力する場合は端末の大きさに、それ以外は既定の大きさに合わせる（マップより大きくはしない）
+void initRenderer(FrameRenderer& renderer, int fd);
+
+// 表示範囲とマップ全体の縮小図の表示を切り替える関数
+void toggleOverview(FrameRenderer& renderer);
+
+// 状態表示の1行を返す関数
+std::string statusLine(const LandmarkIndex& index, const GameState& state);
+
+// フレームを組み立てて、出力するバイト列をrenderer.outに積む関数（書き込みは行わない）
+// messageは直前のコマンドに対するメッセージ（無ければ空文字列）
+void composeFrame(FrameRenderer& renderer, const LandmarkIndex& index, const GameState& state, const std::string& message);
+
+// フレームを組み立てて1回のwriteで出力する関数
+void renderFrame(FrameRenderer& renderer, const LandmarkIndex& index, const GameState& state, const std::string& message);
+
+#endif  // RENDERER_HPP
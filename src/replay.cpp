@@ -0,0 +1,289 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include "replay.hpp"
+#include "history.hpp"
+
+// ヘッダと末尾の大きさ（バイト）
+constexpr size_t replay_header_size = 24;
+constexpr size_t replay_trailer_size = 24;
+
+// 取り消しは空いている符号7で記録する（やり直しは、やり直した手のコマンドをそのまま記録する）
+constexpr unsigned int replay_undo_code = 7;
+
+static_assert(static_cast<unsigned int>(Command::GameEnd) < replay_undo_code, "Command must fit in 3 bits.");
+
+// 数値をリトルエンディアンで書き込む・読み出す関数
+static void putValue(std::string& bytes, uint64_t value, unsigned int size) {
+  for (unsigned int k = 0; k < size; k++) {
+    bytes.push_back(static_cast<char>((value >> (k * 8)) & 0xff));
+  }
+}
+static uint64_t getValue(const char* bytes, unsigned int size) {
+  uint64_t value {0};
+  for (unsigned int k = 0; k < size; k++) {
+    value |= static_cast<uint64_t>(static_cast<unsigned char>(bytes[k])) << (k * 8);
+  }
+  return value;
+}
+
+// 区切り1つの大きさ（バイト）
+static size_t blockSize(uint32_t num_landmarks, uint32_t interval) {
+  return 4 + 18 + static_cast<size_t>((num_landmarks + 63) / 64) * 8 + (static_cast<size_t>(interval) * 3 + 7) / 8;
+}
+
+// 書き込み中の区切りをファイルに書き出す関数
+static void writeBlock(ReplayRecorder& recorder) {
+  std::string bytes;
+  putValue(bytes, recorder.count, 4);
+  putValue(bytes, recorder.checkpoint.pos.x, 4);
+  putValue(bytes, recorder.checkpoint.pos.y, 4);
+  putValue(bytes, static_cast<uint64_t>(recorder.checkpoint.pos.direction), 1);
+  putValue(bytes, recorder.checkpoint.speed, 1);
+  putValue(bytes, recorder.checkpoint.steps, 4);
+  putValue(bytes, static_cast<uint32_t>(recorder.checkpoint.fuel), 4);
+  for (uint64_t word : recorder.checkpoint_arrived) {
+    putValue(bytes, word, 8);
+  }
+  bytes.append(recorder.packed.begin(), recorder.packed.end());
+  recorder.file.write(bytes.data(), bytes.size());
+  if (!recorder.file) {
+    throw std::runtime_error("Can't write replay log.");
+  }
+  std::fill(recorder.packed.begin(), recorder.packed.end(), 0);
+  recorder.count = 0;
+}
+
+// リプレイ記録の書き込みを始める関数
+void startReplayRecord(ReplayRecorder& recorder, const std::string& path, const LandmarkIndex& index) {
+  recorder.file.open(path, std::ios::binary | std::ios::trunc);
+  if (!recorder.file) {
+    throw std::runtime_error("Can't write replay log \"" + path + "\".");
+  }
+  recorder.num_landmarks = index.landmarks.size();
+  recorder.packed.assign((static_cast<size_t>(replay_interval) * 3 + 7) / 8, 0);
+  recorder.count = 0;
+  recorder.total = 0;
+
+  std::string header("ROADLOG1");
+  putValue(header, gameFingerprint(index), 8);
+  putValue(header, recorder.num_landmarks, 4);
+  putValue(header, replay_interval, 4);
+  recorder.file.write(header.data(), header.size());
+}
+
+// コマンドを1つ記録する関数
+void recordCommand(ReplayRecorder& recorder, const GameState& state, const LandmarkIndex& index, Command command) {
+  if (!recorder.file.is_open()) {
+    return;
+  }
+  // 区切りの最初のコマンドの前に状態を控えておく
+  if (recorder.count == 0) {
+    recorder.checkpoint = state;
+    recorder.checkpoint_arrived = index.arrived;
+  }
+  size_t bit = static_cast<size_t>(recorder.count) * 3;
+  unsigned int code = (command == Command::Undo) ? replay_undo_code : static_cast<unsigned int>(command);
+  recorder.packed[bit / 8] |= static_cast<uint8_t>(code << (bit % 8));
+  if (bit % 8 > 5) {
+    recorder.packed[bit / 8 + 1] |= static_cast<uint8_t>(code >> (8 - bit % 8));
+  }
+  recorder.count++;
+  recorder.total++;
+  if (recorder.count == replay_interval) {
+    writeBlock(recorder);
+  }
+}
+
+// 書き込み中の区切りと末尾を書き出して記録を終える関数
+void finishReplayRecord(ReplayRecorder& recorder, const GameState& state, StepOutcome outcome) {
+  if (!recorder.file.is_open()) {
+    return;
+  }
+  if (recorder.count > 0) {
+    writeBlock(recorder);
+  }
+  std::string trailer("REND");
+  putValue(trailer, static_cast<uint64_t>(outcome), 4);
+  putValue(trailer, state.steps, 4);
+  putValue(trailer, static_cast<uint32_t>(state.fuel), 4);
+  putValue(trailer, recorder.total, 8);
+  recorder.file.write(trailer.data(), trailer.size());
+  if (!recorder.file) {
+    recorder.file.close();
+    throw std::runtime_error("Can't write replay log.");
+  }
+  // バッファに残った分は閉じる時に書き出されるので、閉じた後にも失敗していないか確かめる
+  recorder.file.close();
+  if (!recorder.file) {
+    throw std::runtime_error("Can't write replay log.");
+  }
+}
+
+// リプレイ記録のヘッダと末尾を読む関数
+void openReplayLog(ReplayLog& log, const std::string& path, const LandmarkIndex& index) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file) {
+    throw std::runtime_error("Can't open replay log \"" + path + "\".");
+  }
+  const size_t file_size = file.tellg();
+  char header[replay_header_size] {};
+  char trailer[replay_trailer_size] {};
+  file.seekg(0);
+  file.read(header, replay_header_size);
+  if (!file || (std::memcmp(header, "ROADLOG1", 8) != 0)) {
+    throw std::runtime_error("\"" + path + "\" is not a replay log.");
+  }
+  if (getValue(header + 8, 8) != gameFingerprint(index)) {
+    throw std::runtime_error("Replay log was recorded with a different map or game settings.");
+  }
+  log.path = path;
+  log.num_landmarks = getValue(header + 16, 4);
+  log.interval = getValue(header + 20, 4);
+  const size_t block_size = blockSize(log.num_landmarks, log.interval);
+  if ((log.interval == 0) || (file_size < replay_header_size + replay_trailer_size)
+   || ((file_size - replay_header_size - replay_trailer_size) % block_size != 0)) {
+    throw std::runtime_error("Replay log is truncated.");
+  }
+  log.num_blocks = (file_size - replay_header_size - replay_trailer_size) / block_size;
+
+  file.seekg(file_size - replay_trailer_size);
+  file.read(trailer, replay_trailer_size);
+  if (!file || (std::memcmp(trailer, "REND", 4) != 0)) {
+    throw std::runtime_error("Replay log is truncated.");
+  }
+  log.outcome = static_cast<StepOutcome>(getValue(trailer + 4, 4));
+  log.steps = getValue(trailer + 8, 4);
+  log.fuel = static_cast<int32_t>(getValue(trailer + 12, 4));
+  log.total = getValue(trailer + 16, 8);
+  if ((log.total > log.num_blocks * log.interval) || (log.total + log.interval <= log.num_blocks * log.interval)) {
+    throw std::runtime_error("Replay log has an inconsistent command count.");
+  }
+}
+
+// 区切りを1つ読む関数
+ReplayBlock readReplayBlock(const ReplayLog& log, uint64_t block) {
+  const size_t block_size = blockSize(log.num_landmarks, log.interval);
+  std::ifstream file(log.path, std::ios::binary);
+  std::string bytes(block_size, '\0');
+  file.seekg(replay_header_size + block * block_size);
+  file.read(&bytes[0], block_size);
+  if (!file) {
+    throw std::runtime_error("Can't read replay log \"" + log.path + "\".");
+  }
+
+  ReplayBlock result {};
+  uint32_t count = getValue(&bytes[0], 4);
+  result.state.pos.x = getValue(&bytes[4], 4);
+  result.state.pos.y = getValue(&bytes[8], 4);
+  result.state.pos.direction = static_cast<Direction>(getValue(&bytes[12], 1));
+  result.state.speed = getValue(&bytes[13], 1);
+  result.state.steps = getValue(&bytes[14], 4);
+  result.state.fuel = static_cast<int32_t>(getValue(&bytes[18], 4));
+  size_t offset = 22;
+  for (uint32_t w = 0; w < (log.num_landmarks + 63) / 64; w++, offset += 8) {
+    result.arrived.push_back(getValue(&bytes[offset], 8));
+  }
+  // 位置はマップ内の道路上でなければならない（壊れた値のまま再実行するとマップ外を読んでしまう）
+  if ((count == 0) || (count > log.interval) || (result.state.speed > max_speed)
+   || (static_cast<unsigned int>(result.state.pos.direction) > 3)
+   || (result.state.pos.x >= road_map.size_x) || (result.state.pos.y >= road_map.size_y)
+   || !is_road(result.state.pos.x, result.state.pos.y)) {
+    throw std::runtime_error("Replay log has a broken checkpoint.");
+  }
+
+  // 3ビットずつ取り出す（次のバイトにまたがる場合は2バイト分から取り出す）
+  const uint8_t* packed = reinterpret_cast<const uint8_t*>(&bytes[offset]);
+  result.commands.reserve(count);
+  for (uint32_t i = 0; i < count; i++) {
+    size_t bit = static_cast<size_t>(i) * 3;
+    unsigned int pair = packed[bit / 8] | ((bit % 8 > 5) ? (packed[bit / 8 + 1] << 8) : 0);
+    unsigned int code = (pair >> (bit % 8)) & 7;
+    result.commands.push_back((code == replay_undo_code) ? Command::Undo : static_cast<Command>(code));
+  }
+  return result;
+}
+
+// チェックポイントの状態と到達済みフラグを再実行の状態に設定する関数
+static void restoreCheckpoint(const ReplayBlock& block, LandmarkIndex& index, GameState& state) {
+  state = block.state;
+  index.arrived = block.arrived;
+  index.arrived_count = 0;
+  for (uint64_t word : index.arrived) {
+    index.arrived_count += __builtin_popcountll(word);
+  }
+}
+
+// 記録したコマンドを1つ再実行する関数（取り消しは履歴から戻し、それ以外は履歴を取りながら進める）
+// 取り消す手が履歴に無い場合はfalseを返す
+static bool replayCommand(MoveHistory& history, GameState& state, LandmarkIndex& index, Command command, StepOutcome& outcome) {
+  if (command == Command::Undo) {
+    outcome = StepOutcome::Continue;
+    return undoMove(history, state, index);
+  }
+  outcome = stepGameWithHistory(history, state, index, command);
+  return true;
+}
+
+// 記録を最初から最後まで再実行する関数
+void replayAll(const ReplayLog& log, LandmarkIndex& index, GameState& state, StepOutcome& outcome) {
+  state = initialGameState();
+  resetArrived(index);
+  outcome = StepOutcome::Continue;
+  MoveHistory history {};
+  initMoveHistory(history);
+  for (uint64_t b = 0; b < log.num_blocks; b++) {
+    ReplayBlock block = readReplayBlock(log, b);
+    if ((block.state.pos.x != state.pos.x) || (block.state.pos.y != state.pos.y) || (block.state.pos.direction != state.pos.direction)
+     || (block.state.speed != state.speed) || (block.state.steps != state.steps) || (block.state.fuel != state.fuel)
+     || (block.arrived != index.arrived)) {
+      throw std::runtime_error("Checkpoint " + std::to_string(b) + " does not match the replayed state.");
+    }
+    for (Command command : block.commands) {
+      if (!replayCommand(history, state, index, command, outcome)) {
+        throw std::runtime_error("Replay log has an undo with no move to undo.");
+      }
+    }
+  }
+}
+
+// 区切りfirstのチェックポイントから、記録の先頭からcommands個目までのコマンドを再実行する関数
+// 取り消す手がチェックポイントより前にある（履歴に無い）場合はfalseを返す
+static bool replayFromBlock(const ReplayLog& log, LandmarkIndex& index, uint64_t first, uint64_t commands, GameState& state) {
+  MoveHistory history {};
+  initMoveHistory(history);
+  StepOutcome outcome {};
+  ReplayBlock block = readReplayBlock(log, first);
+  restoreCheckpoint(block, index, state);
+  for (uint64_t b = first; b * log.interval < commands; b++) {
+    if (b != first) {
+      block = readReplayBlock(log, b);
+    }
+    uint64_t rest = std::min<uint64_t>(commands - b * log.interval, block.commands.size());
+    for (uint64_t i = 0; i < rest; i++) {
+      if (!replayCommand(history, state, index, block.commands[i], outcome)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// commands個のコマンドを実行した後の状態を、直前のチェックポイントから再実行して求める関数
+void replayTo(const ReplayLog& log, LandmarkIndex& index, uint64_t commands, GameState& state) {
+  state = initialGameState();
+  resetArrived(index);
+  if (log.num_blocks == 0) {
+    return;
+  }
+  // 最後の区切りより後を指定した場合は、最後まで進める
+  commands = std::min(commands, log.total);
+  uint64_t b = std::min(commands / log.interval, log.num_blocks - 1);
+  if (replayFromBlock(log, index, b, commands, state)) {
+    return;
+  }
+  // チェックポイントより前の手を取り消している場合は、履歴を作り直すため最初の区切りから再実行する
+  if ((b == 0) || !replayFromBlock(log, index, 0, commands, state)) {
+    throw std::runtime_error("Replay log has an undo with no move to undo.");
+  }
+}
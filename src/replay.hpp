@@ -0,0 +1,86 @@
+#ifndef REPLAY_HPP
+#define REPLAY_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "map.hpp"
+#include "game.hpp"
+
+// リプレイ記録の書式
+// ゲームを進めたコマンド（表示のみのコマンドは除く）を1つ3ビットに詰め、一定数ごとにチェックポイントを置く
+// 数値はすべてリトルエンディアン
+//
+//   ヘッダ（24バイト）：
+//     "ROADLOG1"、マップとゲーム設定の指紋（64ビット）、ランドマーク数（32ビット）、チェックポイント間隔（32ビット）
+//   区切り（すべて同じ大きさで、最後の区切りも詰め物で埋める）：
+//     区切り内のコマンド数（32ビット）
+//     区切りの最初のコマンドを実行する前の状態：X座標・Y座標（各32ビット）、向き・速度（各8ビット）、
+//     手数（32ビット）、残り燃料（符号付き32ビット）、到達済みフラグ（64ビットを (ランドマーク数 + 63) / 64 個）
+//     コマンド：間隔 * 3 ビット（下位ビットから順に詰める、取り消しは7）
+//   末尾（24バイト）：
+//     "REND"、ゲームの結果（32ビット）、手数（32ビット）、残り燃料（符号付き32ビット）、コマンドの総数（64ビット）
+//
+// 区切りの大きさが一定なので、n手目を含む区切りはファイル内の位置を計算して直接読める
+
+// チェックポイントを置くコマンドの間隔
+constexpr uint32_t replay_interval = 256;
+
+// リプレイ記録の書き込み中の状態
+typedef struct {
+  std::ofstream file;                      // 書き込み先
+  uint32_t num_landmarks;                  // ランドマーク数
+  GameState checkpoint;                    // 書き込み中の区切りの最初の状態
+  std::vector<uint64_t> checkpoint_arrived;  // 書き込み中の区切りの最初の到達済みフラグ
+  std::vector<uint8_t> packed;             // 書き込み中の区切りのコマンド
+  uint32_t count;                          // 書き込み中の区切りのコマンド数
+  uint64_t total;                          // 記録したコマンドの総数
+} ReplayRecorder;
+
+// リプレイ記録の区切り1つ分
+typedef struct {
+  GameState state;                // 区切りの最初の状態
+  std::vector<uint64_t> arrived;  // 区切りの最初の到達済みフラグ
+  std::vector<Command> commands;  // 区切りのコマンド
+} ReplayBlock;
+
+// 読み込んだリプレイ記録（ヘッダと末尾の内容）
+typedef struct {
+  std::string path;          // ファイルのパス
+  uint32_t num_landmarks;    // ランドマーク数
+  uint32_t interval;         // チェックポイント間隔
+  uint64_t num_blocks;       // 区切りの数
+  uint64_t total;            // コマンドの総数
+  StepOutcome outcome;       // 記録されたゲームの結果
+  unsigned int steps;        // 記録された手数
+  int fuel;                  // 記録された残り燃料
+} ReplayLog;
+
+// リプレイ記録の書き込みを始める関数（書き込めない場合はruntime_errorをthrowする）
+void startReplayRecord(ReplayRecorder& recorder, const std::string& path, const LandmarkIndex& index);
+
+// コマンドを1つ記録する関数（stepGameに渡す直前の状態と一緒に呼ぶこと）
+// 区切りを書き出せない場合はruntime_errorをthrowする（記録を続けない場合はfileを閉じれば、以降の記録は何もしない）
+void recordCommand(ReplayRecorder& recorder, const GameState& state, const LandmarkIndex& index, Command command);
+
+// 書き込み中の区切りと末尾を書き出して記録を終える関数（書き込めない場合はruntime_errorをthrowする）
+void finishReplayRecord(ReplayRecorder& recorder, const GameState& state, StepOutcome outcome);
+
+// リプレイ記録のヘッダと末尾を読む関数
+// 書式の誤りや、現在のマップ・ゲーム設定と異なる記録の場合はruntime_errorをthrowする
+void openReplayLog(ReplayLog& log, const std::string& path, const LandmarkIndex& index);
+
+// 区切りを1つ読む関数
+ReplayBlock readReplayBlock(const ReplayLog& log, uint64_t block);
+
+// 記録を最初から最後まで再実行する関数
+// 区切りごとにチェックポイントと再実行した状態が一致するかを確かめ、一致しない場合はruntime_errorをthrowする
+// 最後の状態と結果をstateとoutcomeに返す
+void replayAll(const ReplayLog& log, LandmarkIndex& index, GameState& state, StepOutcome& outcome);
+
+// commands個のコマンドを実行した後の状態を、直前のチェックポイントから再実行して求める関数
+// チェックポイントより前の手を取り消している場合は、最初から再実行する
+void replayTo(const ReplayLog& log, LandmarkIndex& index, uint64_t commands, GameState& state);
+
+#endif  // REPLAY_HPP
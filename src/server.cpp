@@ -0,0 +1,504 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "server.hpp"
+#include "game.hpp"
+#include "field.hpp"
+#include "cache.hpp"
+#include "graph.hpp"
+#include "renderer.hpp"
+#include "tour.hpp"
+#include "profile.hpp"
+
+// セッションの置き場をまとめて確保する単位
+constexpr size_t sessions_per_chunk = 256;
+// 1回のepoll_waitで受け取るイベントの最大数
+constexpr int max_events = 256;
+// 終了の要求を確かめる間隔(ミリ秒)
+constexpr int poll_timeout_ms = 200;
+// 1回の通知で受け付ける接続の最大数（同時に通知を受けた他のスレッドにも接続を残す）
+constexpr unsigned int accept_batch = 64;
+// 待ち受けソケットの接続待ちの最大数
+constexpr int listen_backlog = 4096;
+// 1回に読み込むバイト数
+constexpr size_t read_size = 4096;
+// 1回の読み込みで積む応答の上限（超えたら残りの行は読まずにソケットに残し、送り終えてから処理する）
+constexpr size_t max_response_per_read = 64 * 1024;
+// 入力欄
+constexpr char prompt[] = "Command: ";
+
+// 終了の要求（シグナルハンドラから設定する）
+static volatile std::sig_atomic_t stop_requested = 0;
+
+static void requestStop(int) {
+  stop_requested = 1;
+}
+
+// 1つの接続のゲームの状態
+// 到達済みフラグは、プールの同じ置き場のSession構造体の直後に置く
+typedef struct {
+  int fd;                         // 接続のファイルディスクリプタ
+  size_t list_index;              // スレッドのセッション一覧での位置
+  GameState state;                // ゲーム状態
+  uint64_t* arrived;              // 到達済みフラグ（ランドマーク番号のビット）
+  unsigned int arrived_count;     // 到達済みランドマーク数
+  unsigned int view_x;            // 表示範囲の左上のX座標
+  unsigned int view_y;            // 表示範囲の左上のY座標
+  bool show_overview;             // 縮小図を表示しているか
+  bool is_closing;                // ゲームが終わり、送り終えたら閉じるか
+  bool is_line_too_long;          // 読み込み中の行がmax_line_lengthを超えたか
+  unsigned int line_length;       // 読み込み中の行の文字数
+  char line[max_line_length];     // 読み込み中の行
+  std::string pending;            // 送りきれなかったバイト列
+} Session;
+
+// セッションの置き場のプール
+// 置き場はsessions_per_chunk個ずつまとめて確保し、閉じたセッションの置き場を使い回すので、
+// 接続の受け付けと切断を繰り返してもメモリ確保はほとんど起こらない
+class SessionPool {
+ public:
+  explicit SessionPool(size_t arrived_words)
+    : arrived_words_(arrived_words), slot_words_((sizeof(Session) + sizeof(uint64_t) - 1) / sizeof(uint64_t) + arrived_words) {}
+  ~SessionPool() = default;
+  SessionPool(const SessionPool&) = delete;
+  SessionPool& operator=(const SessionPool&) = delete;
+
+  Session* allocate() {
+    if (free_.empty()) {
+      chunks_.emplace_back(new uint64_t[slot_words_ * sessions_per_chunk]);
+      for (size_t i = sessions_per_chunk; i-- > 0;) {
+        free_.push_back(chunks_.back().get() + i * slot_words_);
+      }
+    }
+    uint64_t* slot = free_.back();
+    free_.pop_back();
+    Session* session = new (slot) Session {};
+    session->arrived = slot + (slot_words_ - arrived_words_);
+    std::fill(session->arrived, session->arrived + arrived_words_, 0);
+    return session;
+  }
+
+  void release(Session* session) {
+    session->~Session();
+    free_.push_back(reinterpret_cast<uint64_t*>(session));
+  }
+
+ private:
+  size_t arrived_words_;
+  size_t slot_words_;
+  std::vector<std::unique_ptr<uint64_t[]>> chunks_;
+  std::vector<uint64_t*> free_;
+};
+
+// スレッド間で共有する読み取り専用の情報
+typedef struct {
+  const LandmarkIndex* landmarks;   // ランドマークの索引
+  const LandmarkFields* fields;     // 回り切れるかの判定に使う距離場
+  RoadGraph* graph;                 // ヒント用の道路グラフ（全スレッドで共有し、初めてヒントを求められた時に作るかキャッシュから読む）
+  std::once_flag* graph_once;       // 道路グラフを1度だけ作るためのフラグ
+  const std::string* cache_directory;  // 事前計算のキャッシュのディレクトリ（道路グラフもここから読む）
+  int listen_fd;                    // 待ち受けソケット
+  std::atomic<uint64_t>* active;    // 接続中のセッション数
+  std::atomic<uint64_t>* peak;      // 接続中のセッション数の最大値
+  const TrajectoryAnalytics* trajectories;  // 軌跡の集計（集計しない場合はnullptr）
+} ServerShared;
+
+// スレッドごとの作業領域
+// フレームの組み立てや応答のバッファはスレッドごとに1つだけ持ち、全セッションで使い回す
+typedef struct {
+  int epoll_fd;                                  // このスレッドのepoll
+  LandmarkIndex index;                           // 到達済みフラグをセッションのものに入れ替えて使う索引のコピー
+  FrameRenderer renderer;                        // フレームの組み立て（表示範囲はセッションのものに入れ替えて使う）
+  RouteWorkspace workspace;                      // ヒントの問い合わせの作業領域
+  TrajectoryShard* trajectory;                   // このスレッドの軌跡の集計（集計しない場合はnullptr）
+  std::string response;                          // 組み立て中の応答
+  std::vector<Session*> sessions;                // 接続中のセッション
+  std::vector<uint64_t> latency;                 // コマンド1つの処理時間のヒストグラム（マイクロ秒ごと）
+  uint64_t num_sessions;                         // 受け付けたセッション数
+  uint64_t num_commands;                         // 処理したコマンド数
+} ServerWorker;
+
+// 待ち受けソケットを開く関数
+static int openListenSocket(const std::string& address) {
+  bool is_tcp = !address.empty() && std::all_of(address.begin(), address.end(), [](char c) { return (c >= '0') && (c <= '9'); });
+  int fd {-1};
+  if (is_tcp) {
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int reuse {1};
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(std::stoul(address));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((fd < 0) || (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)) {
+      throw std::runtime_error("Can't listen on port " + address + ".");
+    }
+  } else {
+    sockaddr_un addr {};
+    if (address.size() >= sizeof(addr.sun_path)) {
+      throw std::runtime_error("Socket path \"" + address + "\" is too long.");
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, address.c_str(), address.size() + 1);
+    unlink(address.c_str());
+    if ((fd < 0) || (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)) {
+      throw std::runtime_error("Can't listen on \"" + address + "\".");
+    }
+  }
+  if (listen(fd, listen_backlog) != 0) {
+    close(fd);
+    throw std::runtime_error("Can't listen on \"" + address + "\".");
+  }
+  return fd;
+}
+
+// セッションの表示範囲と到達済みフラグをスレッドの作業領域に読み込む関数
+static void loadSession(ServerWorker& worker, const Session& session) {
+  std::copy(session.arrived, session.arrived + worker.index.arrived.size(), worker.index.arrived.begin());
+  worker.index.arrived_count = session.arrived_count;
+  worker.renderer.view_x = session.view_x;
+  worker.renderer.view_y = session.view_y;
+  worker.renderer.show_overview = session.show_overview;
+}
+
+// スレッドの作業領域からセッションの表示範囲と到達済みフラグを書き戻す関数
+static void storeSession(const ServerWorker& worker, Session& session) {
+  std::copy(worker.index.arrived.begin(), worker.index.arrived.end(), session.arrived);
+  session.arrived_count = worker.index.arrived_count;
+  session.view_x = worker.renderer.view_x;
+  session.view_y = worker.renderer.view_y;
+  session.show_overview = worker.renderer.show_overview;
+}
+
+// フレームと入力欄を応答に積む関数（loadSessionの後に呼ぶこと）
+static void appendFrame(ServerWorker& worker, const Session& session, const std::string& message) {
+  composeFrame(worker.renderer, worker.index, session.state, message);
+  worker.response += worker.renderer.out;
+  worker.response += prompt;
+}
+
+// 1行のコマンドを処理し、応答を積む関数
+static void handleLine(const ServerShared& shared, ServerWorker& worker, Session& session, std::string line) {
+  PROFILE_SCOPE("server.command");
+  auto start = std::chrono::steady_clock::now();
+  if (!line.empty() && (line.back() == '\r')) {
+    line.pop_back();
+  }
+  Command command {};
+  if (session.is_line_too_long || !str2command(line, command)) {
+    worker.response += "Invalid command is input. Please retry.\n";
+    worker.response += prompt;
+    return;
+  }
+  // 履歴はセッションごとに1ゲーム分の置き場が要るので、サーバでは取り消し・やり直しを受け付けない
+  if (is_history_command(command)) {
+    worker.response += "Undo and redo are not available on the server.\n";
+    worker.response += prompt;
+    return;
+  }
+
+  loadSession(worker, session);
+  std::string message;
+  if (command == Command::ToggleOverview) {
+    toggleOverview(worker.renderer);
+  } else if (command == Command::Hint) {
+    std::call_once(*shared.graph_once, [&]() { prepareRoadGraph(*shared.graph, *shared.landmarks, *shared.cache_directory); });
+    if (worker.workspace.forward.dist.empty()) {
+      initRouteWorkspace(worker.workspace, *shared.graph);
+    }
+    message = tourHint(*shared.graph, worker.workspace, worker.index, session.state.pos);
+  } else {
+    StepOutcome outcome = stepGame(session.state, worker.index, command);
+    if (worker.trajectory != nullptr) {
+      recordTrajectoryStep(*shared.trajectories, *worker.trajectory, session.state, outcome);
+    }
+    if (outcome == StepOutcome::CommandRejected) {
+      message = rejectedMessage(command);
+    } else if (outcome == StepOutcome::OffRoad) {
+      worker.response += "Game Over: Over speeding and went off the road.\n";
+      session.is_closing = true;
+    } else if (outcome == StepOutcome::FuelOut) {
+      worker.response += "Game Over: Fuel has run out.\n";
+      session.is_closing = true;
+    } else if (outcome == StepOutcome::AllArrived) {
+      worker.response += "All landmerks reached. Congratulations!\n";
+      worker.response += "Your score: " + std::to_string(session.state.steps) + " steps, "
+                       + std::to_string(session.state.fuel) + " remaining fuel.\n";
+      session.is_closing = true;
+    } else if (outcome == StepOutcome::Quit) {
+      session.is_closing = true;
+    }
+    if (!session.is_closing) {
+      std::string warning = finishWarning(*shared.fields, worker.index, session.state);
+      if (!warning.empty()) {
+        message += (message.empty() ? "" : " ") + warning;
+      }
+    }
+  }
+
+  if (session.is_closing) {
+    worker.response += "bye!\n";
+  } else {
+    appendFrame(worker, session, message);
+  }
+  storeSession(worker, session);
+
+  worker.num_commands++;
+  auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+  worker.latency[std::min<uint64_t>(us, latency_buckets - 1)]++;
+}
+
+// セッションを閉じる関数
+// 組み立て中の応答はこのセッションのものなので捨てる（次に扱うセッションに送らないため）
+static void closeSession(const ServerShared& shared, ServerWorker& worker, SessionPool& pool, Session* session) {
+  worker.response.clear();
+  epoll_ctl(worker.epoll_fd, EPOLL_CTL_DEL, session->fd, nullptr);
+  close(session->fd);
+  // 一覧の最後のセッションを空いた位置へ移す
+  Session* last = worker.sessions.back();
+  last->list_index = session->list_index;
+  worker.sessions[session->list_index] = last;
+  worker.sessions.pop_back();
+  pool.release(session);
+  (*shared.active)--;
+}
+
+// 組み立てた応答を送る関数（送りきれない分は書き込めるようになるまでセッションに残す）
+// セッションを閉じた場合はfalseを返す
+static bool sendResponse(const ServerShared& shared, ServerWorker& worker, SessionPool& pool, Session* session) {
+  const char* data = worker.response.data();
+  size_t remaining = worker.response.size();
+  while (remaining > 0) {
+    ssize_t sent = send(session->fd, data, remaining, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+        break;
+      }
+      closeSession(shared, worker, pool, session);
+      return false;
+    }
+    data += sent;
+    remaining -= sent;
+  }
+  worker.response.clear();
+  if (remaining > 0) {
+    // 送りきるまでは次のコマンドを読まない
+    session->pending.assign(data, remaining);
+    epoll_event event {};
+    event.events = EPOLLOUT;
+    event.data.ptr = session;
+    epoll_ctl(worker.epoll_fd, EPOLL_CTL_MOD, session->fd, &event);
+    return true;
+  }
+  if (session->is_closing) {
+    closeSession(shared, worker, pool, session);
+    return false;
+  }
+  return true;
+}
+
+// 待ち受けソケットから接続を受け付け、最初のフレームを送る関数
+static void acceptSessions(const ServerShared& shared, ServerWorker& worker, SessionPool& pool) {
+  for (unsigned int i = 0; i < accept_batch; i++) {
+    int fd = accept4(shared.listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      break;
+    }
+    // TCPでは小さな応答を待たずに送る（Unixドメインソケットでは失敗するが問題ない）
+    int no_delay {1};
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+    Session* session = pool.allocate();
+    session->fd = fd;
+    session->state = initialGameState();
+    session->list_index = worker.sessions.size();
+    worker.sessions.push_back(session);
+    epoll_event event {};
+    event.events = EPOLLIN;
+    event.data.ptr = session;
+    epoll_ctl(worker.epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    worker.num_sessions++;
+    uint64_t active = ++(*shared.active);
+    uint64_t peak = shared.peak->load();
+    while ((active > peak) && !shared.peak->compare_exchange_weak(peak, active)) {
+    }
+
+    loadSession(worker, *session);
+    appendFrame(worker, *session, finishWarning(*shared.fields, worker.index, session->state));
+    storeSession(worker, *session);
+    sendResponse(shared, worker, pool, session);
+  }
+}
+
+// 接続から読み込み、届いた行ごとにコマンドを処理する関数
+// 応答がmax_response_per_readを超えたらそこで止め、処理した分だけをソケットから取り除く
+// 残りの行は読み込めることの通知が続くので、応答を送り終えた後に処理される（送れない相手からは読まない）
+static void readSession(const ServerShared& shared, ServerWorker& worker, SessionPool& pool, Session* session) {
+  char buffer[read_size];
+  ssize_t length = recv(session->fd, buffer, sizeof(buffer), MSG_PEEK);
+  if (length < 0) {
+    if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+      closeSession(shared, worker, pool, session);
+    }
+    return;
+  }
+  if (length == 0) {
+    closeSession(shared, worker, pool, session);
+    return;
+  }
+  ssize_t consumed {0};
+  while ((consumed < length) && !session->is_closing && (worker.response.size() < max_response_per_read)) {
+    const ssize_t i = consumed++;
+    if (buffer[i] == '\n') {
+      handleLine(shared, worker, *session, std::string(session->line, session->line_length));
+      session->line_length = 0;
+      session->is_line_too_long = false;
+    } else if (session->line_length < max_line_length) {
+      session->line[session->line_length++] = buffer[i];
+    } else {
+      session->is_line_too_long = true;
+    }
+  }
+  // 覗いただけのバイト列のうち、処理した分を取り除く（このスレッドだけが読むので、覗いた内容がそのまま返る）
+  while ((recv(session->fd, buffer, consumed, 0) < 0) && (errno == EINTR)) {
+  }
+  if (!worker.response.empty()) {
+    sendResponse(shared, worker, pool, session);
+  }
+}
+
+// 送りきれなかったバイト列の続きを送る関数
+static void writeSession(const ServerShared& shared, ServerWorker& worker, SessionPool& pool, Session* session) {
+  worker.response.swap(session->pending);
+  session->pending.clear();
+  if (sendResponse(shared, worker, pool, session) && session->pending.empty()) {
+    epoll_event event {};
+    event.events = EPOLLIN;
+    event.data.ptr = session;
+    epoll_ctl(worker.epoll_fd, EPOLL_CTL_MOD, session->fd, &event);
+  }
+}
+
+// 1つのスレッドのイベントループ
+static void serveLoop(const ServerShared& shared, ServerWorker& worker) {
+  SessionPool pool(worker.index.arrived.size());
+  std::array<epoll_event, max_events> events {};
+  while (stop_requested == 0) {
+    int count = epoll_wait(worker.epoll_fd, events.data(), max_events, poll_timeout_ms);
+    for (int i = 0; i < count; i++) {
+      Session* session = static_cast<Session*>(events[i].data.ptr);
+      if (session == nullptr) {
+        acceptSessions(shared, worker, pool);
+      } else if (events[i].events & EPOLLOUT) {
+        writeSession(shared, worker, pool, session);
+      } else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        readSession(shared, worker, pool, session);
+      }
+    }
+  }
+  while (!worker.sessions.empty()) {
+    closeSession(shared, worker, pool, worker.sessions.back());
+  }
+}
+
+// ヒストグラムからパーセンタイル（マイクロ秒）を求める関数
+static double latencyPercentile(const std::vector<uint64_t>& histogram, uint64_t total, double percentile) {
+  uint64_t rank = static_cast<uint64_t>(total * percentile);
+  uint64_t seen {0};
+  for (size_t us = 0; us < histogram.size(); us++) {
+    seen += histogram[us];
+    if (seen > rank) {
+      return us;
+    }
+  }
+  return histogram.size();
+}
+
+// サーバを実行する関数
+void runServer(const ServerConfig& config, const LandmarkIndex& landmarks, ServerStats& stats) {
+  unsigned int num_threads = config.num_threads;
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  LandmarkFields fields {};
+  prepareLandmarkFields(fields, landmarks, config.cache_directory);
+  RoadGraph graph {};
+  std::once_flag graph_once;
+  std::atomic<uint64_t> active {0};
+  std::atomic<uint64_t> peak {0};
+  if (config.trajectories != nullptr) {
+    initTrajectoryAnalytics(*config.trajectories, num_threads);
+  }
+  ServerShared shared {&landmarks, &fields, &graph, &graph_once, &config.cache_directory, openListenSocket(config.address), &active, &peak, config.trajectories};
+
+  std::vector<ServerWorker> workers(num_threads);
+  for (unsigned int t = 0; t < num_threads; t++) {
+    ServerWorker& worker = workers[t];
+    worker.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event event {};
+    event.events = EPOLLIN | EPOLLEXCLUSIVE;
+    event.data.ptr = nullptr;
+    epoll_ctl(worker.epoll_fd, EPOLL_CTL_ADD, shared.listen_fd, &event);
+    worker.index = landmarks;
+    initRenderer(worker.renderer, -1);
+    worker.latency.assign(latency_buckets, 0);
+    worker.num_sessions = 0;
+    worker.num_commands = 0;
+    worker.trajectory = (config.trajectories != nullptr) ? &config.trajectories->shards[t] : nullptr;
+  }
+
+  stop_requested = 0;
+  std::signal(SIGINT, requestStop);
+  std::signal(SIGTERM, requestStop);
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (unsigned int t = 1; t < num_threads; t++) {
+    threads.emplace_back(serveLoop, std::cref(shared), std::ref(workers[t]));
+  }
+  serveLoop(shared, workers[0]);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  std::signal(SIGINT, SIG_DFL);
+  std::signal(SIGTERM, SIG_DFL);
+
+  // 集計
+  stats = ServerStats {0, 0, peak.load(), 0, 0, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()};
+  std::vector<uint64_t> latency(latency_buckets, 0);
+  for (ServerWorker& worker : workers) {
+    close(worker.epoll_fd);
+    stats.sessions += worker.num_sessions;
+    stats.commands += worker.num_commands;
+    for (unsigned int us = 0; us < latency_buckets; us++) {
+      latency[us] += worker.latency[us];
+    }
+  }
+  stats.p50_us = latencyPercentile(latency, stats.commands, 0.5);
+  stats.p99_us = latencyPercentile(latency, stats.commands, 0.99);
+  close(shared.listen_fd);
+  if (!std::all_of(config.address.begin(), config.address.end(), [](char c) { return (c >= '0') && (c <= '9'); })) {
+    unlink(config.address.c_str());
+  }
+}
@@ -0,0 +1,44 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <cstdint>
+#include <string>
+#include "map.hpp"
+#include "trajectory.hpp"
+
+// 1行のコマンドとして受け付ける最大の文字数（超えた行は不正なコマンドとして扱う）
+constexpr unsigned int max_line_length = 64;
+// コマンド1つの処理時間を数えるヒストグラムの区間数（1マイクロ秒ごと、最後の区間はそれ以上すべて）
+constexpr unsigned int latency_buckets = 10000;
+
+// サーバの通信の書式
+// 接続ごとに1つのゲーム（セッション）を始め、対話モードを端末以外に出力した時と同じ文字列をやり取りする
+//   サーバ→クライアント：メッセージ（あれば）とフレーム全体、続けて入力欄 "Command: "（改行なし）
+//   クライアント→サーバ：1行に1コマンド（対話モードの入力と同じ書式）
+// ゲームが終わると結果と "bye!" を送って接続を閉じる
+
+// サーバの設定
+typedef struct {
+  std::string address;       // 待ち受け先（数字だけならループバックのTCPポート、それ以外はUnixドメインソケットのパス）
+  unsigned int num_threads;  // スレッド数（0の場合はハードウェアのスレッド数）
+  TrajectoryAnalytics* trajectories;  // 1手ごとの位置と結果を集計する場合の置き場（スレッドごとのシャードを用意する。nullptrの場合は集計しない）
+  std::string cache_directory;        // 事前計算のキャッシュのディレクトリ（空の場合は使わない）
+} ServerConfig;
+
+// サーバの集計
+typedef struct {
+  uint64_t sessions;           // 受け付けたセッション数
+  uint64_t commands;           // 処理したコマンド数
+  uint64_t peak_sessions;      // 同時に接続していたセッション数の最大値
+  double p50_us;               // コマンド1つの処理時間の中央値(マイクロ秒)
+  double p99_us;               // コマンド1つの処理時間の99パーセンタイル(マイクロ秒)
+  double seconds;              // 実行した時間(秒)
+} ServerStats;
+
+// 待ち受け先で接続を受け付け、接続ごとのゲームを進めるサーバを、SIGINTかSIGTERMを受けるまで実行する関数
+// スレッドごとにepollで多数の接続を受け持ち、どのスレッドも同じ待ち受けソケットから直接受け付ける
+// セッションの状態は受け付けたスレッドだけが触るので、セッションごとのロックは無い
+// 待ち受けできない場合はruntime_errorをthrowする
+void runServer(const ServerConfig& config, const LandmarkIndex& landmarks, ServerStats& stats);
+
+#endif  // SERVER_HPP
@@ -0,0 +1,247 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include "solver.hpp"
+
+// 探索できるランドマーク数の上限（状態数が 2^ランドマーク数 に比例するため）
+constexpr unsigned int max_solver_landmarks = 16;
+// 探索の表（状態ごとの残り燃料とマスごとの道路マス番号）に使ってよいメモリの上限（バイト）
+constexpr uint64_t max_solver_table_bytes = uint64_t {512} << 20;
+// 1スレッドあたりに割り当てる最小ノード数（これ未満の層は並列化しない）
+constexpr size_t min_nodes_per_thread = 4096;
+// 探索で試すコマンド（GameEndは除く）
+constexpr std::array<Command, 6> solver_commands {
+  Command::TurnLeft, Command::TurnRight, Command::ContinueStraight,
+  Command::Accelerate, Command::Decelerate, Command::Stop,
+};
+
+// 探索の方法
+typedef enum {
+  IgnoreFuel,   // 燃料切れを無視して各状態を初回のみ展開する（最小手数の下界が求まる）
+  FirstVisit,   // 燃料切れを考慮し各状態を初回のみ展開する（実行可能な解＝上界が求まる）
+  ParetoFuel,   // より多くの燃料で再訪した状態も展開する（厳密解が求まる）
+} SearchMode;
+
+// 探索中の層のノード
+typedef struct {
+  uint64_t key;      // 状態キー（到達済みマスク, 道路マス番号, 向き, 速度を詰めたもの）
+  int fuel;          // 残り燃料
+  uint32_t parent;   // 1つ前の層でのノード番号
+  Command command;   // このノードに来たコマンド
+} SearchNode;
+
+// コマンド列の復元用に全層分保持するノード情報
+typedef struct {
+  uint32_t parent;   // 1つ前の層でのノード番号
+  uint8_t command;   // このノードに来たコマンド
+} NodeLink;
+
+// 探索の前計算データ
+typedef struct {
+  std::vector<int32_t> road_index;       // マス(y * size_x + x)ごとの道路マス番号、道路外は-1
+  std::vector<Position> road_cells;      // 道路マス番号ごとの座標
+  std::vector<uint64_t> landmark_masks;  // 道路マス番号ごとの、そのマスにあるランドマークのビット
+  uint64_t full_mask;                    // 全ランドマーク到達時のマスク
+  uint64_t num_keys;                     // 状態キーの総数
+} SolverTables;
+
+// 層ごとの探索結果（スレッドごとに持つ）
+typedef struct {
+  std::vector<SearchNode> next;  // 次の層のノード
+  bool is_solved;                // 全ランドマーク到達の手が見つかったか
+  SearchNode goal;               // 見つかった手のうち残り燃料最大のもの
+} LayerResult;
+
+// 状態キーの生成と分解
+static uint64_t packStateKey(uint64_t mask, uint64_t road, Direction direction, unsigned int speed, uint64_t num_road) {
+  return ((mask * num_road + road) * 4 + direction) * (max_speed + 1) + speed;
+}
+
+static void unpackStateKey(uint64_t key, uint64_t num_road, uint64_t& mask, uint64_t& road, Direction& direction, unsigned int& speed) {
+  speed = key % (max_speed + 1);
+  key /= (max_speed + 1);
+  direction = static_cast<Direction>(key % 4);
+  key /= 4;
+  road = key % num_road;
+  mask = key / num_road;
+}
+
+// 1層分のノードを展開する関数（スレッドごとに担当範囲を呼び出す）
+// best_fuelはキーごとの既知の最大残り燃料（0は未到達）で、それ以下の燃料で同じ状態に来た手は枝刈りする
+static void expandLayer(const std::vector<SearchNode>& layer, size_t begin, size_t end, const SolverTables& tables,
+                        SearchMode mode, std::atomic<int>* best_fuel, LayerResult& result) {
+  const uint64_t num_road = tables.road_cells.size();
+  for (size_t i = begin; i < end; i++) {
+    uint64_t mask {};
+    uint64_t road {};
+    Direction direction {};
+    unsigned int speed {};
+    unpackStateKey(layer[i].key, num_road, mask, road, direction, speed);
+
+    for (Command command : solver_commands) {
+      Position pos {tables.road_cells[road].x, tables.road_cells[road].y, direction};
+      unsigned int next_speed {speed};
+      // 実行できないコマンドは手数と燃料を消費するだけで状態が変わらないので展開しない
+      if (moveCar(pos, next_speed, command) != MoveResult::Moved) {
+        continue;
+      }
+
+      // stepGameと同様、燃料が0以下になった時点でゲームオーバー
+      int fuel = layer[i].fuel - fuel_consumption[next_speed];
+      if (mode == SearchMode::IgnoreFuel) {
+        fuel = 1;
+      } else if (fuel <= 0) {
+        continue;
+      }
+
+      int32_t next_road = tables.road_index[static_cast<size_t>(pos.y) * road_map.size_x + pos.x];
+      uint64_t next_mask = mask | tables.landmark_masks[next_road];
+      SearchNode node {0, fuel, static_cast<uint32_t>(i), command};
+      if (next_mask == tables.full_mask) {
+        if (!result.is_solved || (result.goal.fuel < fuel)) {
+          result.is_solved = true;
+          result.goal = node;
+        }
+        continue;
+      }
+
+      node.key = packStateKey(next_mask, next_road, pos.direction, next_speed, num_road);
+      int known = best_fuel[node.key].load(std::memory_order_relaxed);
+      while ((known == 0) || ((mode == SearchMode::ParetoFuel) && (known < fuel))) {
+        if (best_fuel[node.key].compare_exchange_weak(known, fuel, std::memory_order_relaxed)) {
+          result.next.push_back(node);
+          break;
+        }
+      }
+    }
+  }
+}
+
+// 初期状態から1層（1手）ずつ幅優先で展開し、最初に全ランドマークに到達した層の解を返す関数
+static SolveResult searchLayers(const SolverTables& tables, SearchMode mode, unsigned int num_threads) {
+  std::unique_ptr<std::atomic<int>[]> best_fuel(new std::atomic<int>[tables.num_keys]);
+  for (uint64_t i = 0; i < tables.num_keys; i++) {
+    best_fuel[i].store(0, std::memory_order_relaxed);
+  }
+
+  const uint64_t num_road = tables.road_cells.size();
+  uint64_t initial_key = packStateKey(0, tables.road_index[static_cast<size_t>(initial_position.y) * road_map.size_x + initial_position.x], initial_position.direction, min_speed, num_road);
+  best_fuel[initial_key].store(fuel_init, std::memory_order_relaxed);
+  std::vector<SearchNode> layer {SearchNode {initial_key, fuel_init, 0, Command::GameEnd}};
+  std::vector<std::vector<NodeLink>> history;
+
+  SolveResult solve_result {false, 0, 0, {}};
+  while (!layer.empty()) {
+    size_t threads = std::min<size_t>(num_threads, (layer.size() + min_nodes_per_thread - 1) / min_nodes_per_thread);
+    std::vector<LayerResult> results(threads, LayerResult {{}, false, {}});
+    if (threads == 1) {
+      expandLayer(layer, 0, layer.size(), tables, mode, best_fuel.get(), results[0]);
+    } else {
+      size_t chunk = (layer.size() + threads - 1) / threads;
+      std::vector<std::thread> workers;
+      for (size_t t = 0; t < threads; t++) {
+        size_t begin = t * chunk;
+        size_t end = std::min(layer.size(), begin + chunk);
+        workers.emplace_back(expandLayer, std::cref(layer), begin, end, std::cref(tables), mode, best_fuel.get(), std::ref(results[t]));
+      }
+      for (std::thread& worker : workers) {
+        worker.join();
+      }
+    }
+
+    // 復元用に今の層のリンクを保存
+    std::vector<NodeLink> links(layer.size());
+    for (size_t i = 0; i < layer.size(); i++) {
+      links[i] = NodeLink {layer[i].parent, static_cast<uint8_t>(layer[i].command)};
+    }
+    history.push_back(std::move(links));
+
+    // スレッドごとの結果をまとめる
+    const SearchNode* goal {nullptr};
+    for (const LayerResult& result : results) {
+      if (result.is_solved && ((goal == nullptr) || (goal->fuel < result.goal.fuel))) {
+        goal = &result.goal;
+      }
+    }
+    if (goal != nullptr) {
+      // ゴールからparentをたどってコマンド列を復元する
+      solve_result.is_solved = true;
+      solve_result.steps = history.size();
+      solve_result.fuel = goal->fuel;
+      solve_result.commands.push_back(goal->command);
+      uint32_t parent = goal->parent;
+      for (size_t depth = history.size() - 1; depth > 0; depth--) {
+        solve_result.commands.push_back(static_cast<Command>(history[depth][parent].command));
+        parent = history[depth][parent].parent;
+      }
+      std::reverse(solve_result.commands.begin(), solve_result.commands.end());
+      break;
+    }
+
+    layer.clear();
+    for (const LayerResult& result : results) {
+      layer.insert(layer.end(), result.next.begin(), result.next.end());
+    }
+  }
+  return solve_result;
+}
+
+// 全ランドマークに到達する最小手数とそのコマンド列を探索する関数
+SolveResult solveOptimalRoute(const LandmarkIndex& index, unsigned int num_threads) {
+  const std::vector<LandMark>& landmarks = index.landmarks;
+  if (landmarks.size() > max_solver_landmarks) {
+    throw std::runtime_error("Too many landmarks for the solver (max " + std::to_string(max_solver_landmarks) + ").");
+  }
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  // 状態数が多すぎる地図では表を確保する前に断る（道路マス数はビットマップから数える）
+  SolverTables tables {};
+  uint64_t num_road {0};
+  for (unsigned int y = 0; y < road_map.size_y; y++) {
+    for (unsigned int w = 0; w < road_map.words_per_row; w++) {
+      num_road += __builtin_popcountll(gridWord(road_map, w, y));
+    }
+  }
+  // 掛け算があふれないよう、道路マス1つあたりのバイト数で割って比べる
+  tables.full_mask = (uint64_t {1} << landmarks.size()) - 1;
+  const uint64_t bytes_per_road = (tables.full_mask + 1) * 4 * (max_speed + 1) * sizeof(std::atomic<int>);
+  const uint64_t index_bytes = uint64_t {road_map.size_x} * road_map.size_y * sizeof(int32_t);
+  if ((index_bytes > max_solver_table_bytes) || (num_road > (max_solver_table_bytes - index_bytes) / bytes_per_road)) {
+    throw std::runtime_error("Search space is too large for the solver.");
+  }
+  tables.num_keys = (tables.full_mask + 1) * num_road * 4 * (max_speed + 1);
+
+  // 道路マスに番号を振り、ランドマークのビットを割り当てる
+  tables.road_index.assign(static_cast<size_t>(road_map.size_x) * road_map.size_y, -1);
+  tables.road_cells.reserve(num_road);
+  for (unsigned int i = 0; i < road_map.size_y; i++) {
+    for (unsigned int j = 0; j < road_map.size_x; j++) {
+      if (is_road(j, i)) {
+        tables.road_index[static_cast<size_t>(i) * road_map.size_x + j] = tables.road_cells.size();
+        tables.road_cells.push_back(Position {j, i, Direction::North});
+      }
+    }
+  }
+  tables.landmark_masks.assign(tables.road_cells.size(), 0);
+  for (size_t i = 0; i < landmarks.size(); i++) {
+    // validateLandmarksで道路上にあることを確認済み
+    tables.landmark_masks[tables.road_index[static_cast<size_t>(landmarks[i].y) * road_map.size_x + landmarks[i].x]] |= (uint64_t {1} << i);
+  }
+
+  // 燃料を無視した最小手数（下界）と、各状態を初回のみ展開した解（上界）が一致すればそれが最適解
+  // 一致しない場合のみ、燃料の多い再訪も展開する厳密探索を行う
+  SolveResult lower = searchLayers(tables, SearchMode::IgnoreFuel, num_threads);
+  if (!lower.is_solved) {
+    return lower;
+  }
+  SolveResult upper = searchLayers(tables, SearchMode::FirstVisit, num_threads);
+  if (upper.is_solved && (upper.steps == lower.steps)) {
+    return upper;
+  }
+  return searchLayers(tables, SearchMode::ParetoFuel, num_threads);
+}
@@ -0,0 +1,22 @@
+#ifndef SOLVER_HPP
+#define SOLVER_HPP
+
+#include <vector>
+#include "map.hpp"
+#include "game.hpp"
+
+// 最短手数探索の結果
+typedef struct {
+  bool is_solved;                 // 全ランドマークに到達できたか
+  unsigned int steps;             // 最小手数
+  int fuel;                       // 最小手数で到達した時の残り燃料（同手数の中で最大のもの）
+  std::vector<Command> commands;  // 最小手数を実現するコマンド列
+} SolveResult;
+
+// 全ランドマークに到達する最小手数とそのコマンド列を探索する関数
+// 状態（位置、向き、速度、残り燃料、到達済みランドマーク）を幅優先探索する
+// num_threadsが0の場合はハードウェアのスレッド数を使用する
+// 探索空間が大きすぎる場合はruntime_errorをthrowする
+SolveResult solveOptimalRoute(const LandmarkIndex& index, unsigned int num_threads);
+
+#endif  // SOLVER_HPP
@@ -0,0 +1,261 @@
+#include <algorithm>
+#include <thread>
+#include "tour.hpp"
+
+// 1スレッドが受け持つビットマスクの最小数（これより少ない層は分割しない）
+constexpr size_t min_masks_per_thread = 1u << 14;
+// ヒントに表示する経路の区間数の上限
+constexpr size_t hint_route_legs = 3;
+
+// 近似解の作業用の地点番号（出発地点と、巡回の終わり）
+constexpr unsigned int tour_start = UINT32_MAX;
+constexpr unsigned int tour_end = UINT32_MAX - 1;
+
+// 経路の無い場合（no_route）を保ったまま距離を足す関数
+static uint32_t addDistance(uint32_t a, uint32_t b) {
+  return static_cast<uint32_t>(std::min<uint64_t>(static_cast<uint64_t>(a) + b, no_route));
+}
+
+// Held-Karpの動的計画法で厳密解を求める関数
+// dp[mask * n + last] は、maskのランドマークを回り終えてlastにいる時の最短の道のり
+// 訪問数（maskの立っているビット数）が同じmaskどうしは互いに依存しないので、層ごとにスレッドへ分けて計算する
+static TourResult solveExactTour(const std::vector<uint32_t>& start_distances, const std::vector<uint32_t>& distances, unsigned int num_threads) {
+  const unsigned int n = start_distances.size();
+  const size_t num_masks = size_t {1} << n;
+  std::vector<uint32_t> dp(num_masks * n, no_route);
+  for (unsigned int i = 0; i < n; i++) {
+    dp[(size_t {1} << i) * n + i] = start_distances[i];
+  }
+
+  // begin〜endのmaskのうち、訪問数がlayerのものを計算する
+  auto compute_range = [&](unsigned int layer, size_t begin, size_t end) {
+    for (size_t mask = begin; mask < end; mask++) {
+      if (static_cast<unsigned int>(__builtin_popcountll(mask)) != layer) {
+        continue;
+      }
+      for (unsigned int last = 0; last < n; last++) {
+        if (((mask >> last) & 1) == 0) {
+          continue;
+        }
+        const size_t prev_mask = mask ^ (size_t {1} << last);
+        uint32_t best = no_route;
+        for (unsigned int prev = 0; prev < n; prev++) {
+          if ((prev_mask >> prev) & 1) {
+            best = std::min(best, addDistance(dp[prev_mask * n + prev], distances[prev * n + last]));
+          }
+        }
+        dp[mask * n + last] = best;
+      }
+    }
+  };
+  size_t threads = std::max<size_t>(1, std::min<size_t>(num_threads, num_masks / min_masks_per_thread));
+  for (unsigned int layer = 2; layer <= n; layer++) {
+    if (threads == 1) {
+      compute_range(layer, 0, num_masks);
+      continue;
+    }
+    size_t chunk = (num_masks + threads - 1) / threads;
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+      workers.emplace_back(compute_range, layer, t * chunk, std::min(num_masks, (t + 1) * chunk));
+    }
+    for (std::thread& worker : workers) {
+      worker.join();
+    }
+  }
+
+  // 最後に訪れるランドマークを決め、距離表と照らし合わせて順番をさかのぼる
+  TourResult result {no_route, {}, true};
+  size_t mask = num_masks - 1;
+  unsigned int last {0};
+  for (unsigned int i = 0; i < n; i++) {
+    if (dp[mask * n + i] < result.distance) {
+      result.distance = dp[mask * n + i];
+      last = i;
+    }
+  }
+  if (result.distance == no_route) {
+    return result;
+  }
+  result.order.resize(n);
+  for (unsigned int k = n; k-- > 0;) {
+    result.order[k] = last;
+    const size_t prev_mask = mask ^ (size_t {1} << last);
+    for (unsigned int prev = 0; prev < n; prev++) {
+      if (((prev_mask >> prev) & 1) && (addDistance(dp[prev_mask * n + prev], distances[prev * n + last]) == dp[mask * n + last])) {
+        last = prev;
+        break;
+      }
+    }
+    mask = prev_mask;
+  }
+  return result;
+}
+
+// 最近傍法で作った順番を2-optとOr-optで改善して近似解を求める関数
+static TourResult solveHeuristicTour(const std::vector<uint32_t>& start_distances, const std::vector<uint32_t>& distances) {
+  const unsigned int n = start_distances.size();
+  // 地点aからbへの距離（巡回の終わりへは0、経路が無い場合は大きな値として比較する）
+  auto edge = [&](unsigned int a, unsigned int b) -> int64_t {
+    if (b == tour_end) {
+      return 0;
+    }
+    return (a == tour_start) ? start_distances[b] : distances[static_cast<size_t>(a) * n + b];
+  };
+
+  // 最近傍法：未訪問のうち最も近いランドマークへ順に向かう
+  std::vector<unsigned int> order;
+  std::vector<bool> visited(n, false);
+  for (unsigned int current = tour_start; order.size() < n;) {
+    unsigned int next {0};
+    int64_t best {INT64_MAX};
+    for (unsigned int i = 0; i < n; i++) {
+      if (!visited[i] && (edge(current, i) < best)) {
+        best = edge(current, i);
+        next = i;
+      }
+    }
+    visited[next] = true;
+    order.push_back(next);
+    current = next;
+  }
+
+  bool improved {true};
+  while (improved) {
+    improved = false;
+    // 2-opt：order[i..j]を逆順にして、交差する区間をほどく
+    for (unsigned int i = 0; i < n; i++) {
+      unsigned int before = (i == 0) ? tour_start : order[i - 1];
+      for (unsigned int j = i + 1; j < n; j++) {
+        unsigned int after = (j + 1 < n) ? order[j + 1] : tour_end;
+        int64_t delta = edge(before, order[j]) + edge(order[i], after) - edge(before, order[i]) - edge(order[j], after);
+        if (delta < 0) {
+          std::reverse(order.begin() + i, order.begin() + j + 1);
+          improved = true;
+        }
+      }
+    }
+    // Or-opt：1〜3個の連続したランドマークを、向きを含めて別の位置へ移す
+    for (unsigned int length = 1; length <= 3; length++) {
+      for (unsigned int i = 0; i + length <= n; i++) {
+        unsigned int first = order[i];
+        unsigned int last = order[i + length - 1];
+        unsigned int before = (i == 0) ? tour_start : order[i - 1];
+        unsigned int after = (i + length < n) ? order[i + length] : tour_end;
+        int64_t removed = edge(before, first) + edge(last, after) - edge(before, after);
+
+        std::vector<unsigned int> rest(order.begin(), order.begin() + i);
+        rest.insert(rest.end(), order.begin() + i + length, order.end());
+        int64_t best_delta {0};
+        size_t best_position {0};
+        bool best_reversed {false};
+        for (size_t k = 0; k <= rest.size(); k++) {
+          if (k == i) {
+            continue;
+          }
+          unsigned int u = (k == 0) ? tour_start : rest[k - 1];
+          unsigned int v = (k < rest.size()) ? rest[k] : tour_end;
+          int64_t forward = edge(u, first) + edge(last, v) - edge(u, v) - removed;
+          int64_t backward = edge(u, last) + edge(first, v) - edge(u, v) - removed;
+          if (std::min(forward, backward) < best_delta) {
+            best_delta = std::min(forward, backward);
+            best_position = k;
+            best_reversed = (backward < forward);
+          }
+        }
+        if (best_delta < 0) {
+          std::vector<unsigned int> segment(order.begin() + i, order.begin() + i + length);
+          if (best_reversed) {
+            std::reverse(segment.begin(), segment.end());
+          }
+          rest.insert(rest.begin() + best_position, segment.begin(), segment.end());
+          order.swap(rest);
+          improved = true;
+        }
+      }
+    }
+  }
+
+  TourResult result {0, order, false};
+  for (unsigned int k = 0; k < n; k++) {
+    uint32_t step = (k == 0) ? start_distances[order[0]] : distances[static_cast<size_t>(order[k - 1]) * n + order[k]];
+    result.distance = addDistance(result.distance, step);
+  }
+  return result;
+}
+
+// 出発地点から全ランドマークを1度ずつ回る最短の順番を求める関数
+TourResult optimizeTour(const std::vector<uint32_t>& start_distances, const std::vector<uint32_t>& distances,
+                        unsigned int exact_limit, unsigned int num_threads) {
+  if (start_distances.empty()) {
+    return TourResult {0, {}, true};
+  }
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  if (start_distances.size() <= std::min(exact_limit, exact_tour_limit)) {
+    return solveExactTour(start_distances, distances, num_threads);
+  }
+  return solveHeuristicTour(start_distances, distances);
+}
+
+// 現在位置から未到達のランドマークを回る順番を求め、次に向かうランドマークと経路を表すメッセージを返す関数
+std::string tourHint(const RoadGraph& graph, RouteWorkspace& workspace, const LandmarkIndex& index, const Position& pos) {
+  // 未到達のランドマークだけの距離表を作る（現在位置からの距離だけ問い合わせ、ランドマーク間は前計算したものを使う）
+  std::vector<unsigned int> remaining;
+  std::vector<GraphNode> targets;
+  for (unsigned int i = 0; i < index.landmarks.size(); i++) {
+    if (!is_arrived(index, i)) {
+      remaining.push_back(i);
+      targets.push_back(GraphNode {index.landmarks[i].x, index.landmarks[i].y});
+    }
+  }
+  if (remaining.empty()) {
+    return "Hint: All landmarks have been reached.";
+  }
+  const GraphNode current {pos.x, pos.y};
+  std::vector<uint32_t> start_distances = routeDistanceTable(graph, workspace, {current}, targets);
+  std::vector<uint32_t> distances(remaining.size() * remaining.size());
+  for (size_t i = 0; i < remaining.size(); i++) {
+    for (size_t j = 0; j < remaining.size(); j++) {
+      distances[i * remaining.size() + j] = landmarkDistance(graph, remaining[i], remaining[j]);
+    }
+  }
+  // ヒントはサーバの各スレッドからも呼ばれるので、さらにスレッドを増やさず呼び出し元のスレッドだけで解く
+  TourResult tour = optimizeTour(start_distances, distances, hint_exact_limit, 1);
+  if (tour.distance == no_route) {
+    return "Hint: The remaining landmarks can't be reached from here.";
+  }
+
+  // 次のランドマークまでの経路を、同じ向きに進む区間ごとにまとめる
+  const unsigned int next = tour.order[0];
+  std::vector<GraphNode> path = routePath(graph, workspace, current, targets[next]);
+  std::vector<std::pair<Direction, unsigned int>> legs;
+  for (size_t k = 1; k < path.size(); k++) {
+    Direction direction {};
+    unsigned int length {};
+    if (path[k].x != path[k - 1].x) {
+      direction = (path[k].x > path[k - 1].x) ? Direction::East : Direction::West;
+      length = std::max(path[k].x, path[k - 1].x) - std::min(path[k].x, path[k - 1].x);
+    } else {
+      direction = (path[k].y > path[k - 1].y) ? Direction::South : Direction::North;
+      length = std::max(path[k].y, path[k - 1].y) - std::min(path[k].y, path[k - 1].y);
+    }
+    if (!legs.empty() && (legs.back().first == direction)) {
+      legs.back().second += length;
+    } else {
+      legs.emplace_back(direction, length);
+    }
+  }
+
+  std::string str = "Hint: go to \"" + index.landmarks[remaining[next]].name + "\" next ("
+                  + std::to_string(start_distances[next]) + " cells";
+  for (size_t k = 0; k < std::min(legs.size(), hint_route_legs); k++) {
+    str += ((k == 0) ? ": " : ", ") + direction2str(legs[k].first) + " " + std::to_string(legs[k].second);
+  }
+  if (legs.size() > hint_route_legs) {
+    str += ", ...";
+  }
+  str += "), " + std::to_string(remaining.size()) + " left, " + std::to_string(tour.distance) + " cells in total";
+  return str;
+}
@@ -0,0 +1,33 @@
+#ifndef TOUR_HPP
+#define TOUR_HPP
+
+#include <string>
+#include <vector>
+#include "map.hpp"
+#include "graph.hpp"
+
+// 厳密解（Held-Karpのビットマスク動的計画法）を求めるランドマーク数の上限
+// 作業領域は 2^n * n 個の距離で、20個で約80MBになる
+constexpr unsigned int exact_tour_limit = 20;
+// ヒントで厳密解を求める残りランドマーク数の上限（対話の応答時間に収まる範囲）
+constexpr unsigned int hint_exact_limit = 15;
+
+// ランドマークの巡回順の最適化結果
+typedef struct {
+  uint32_t distance;                // 出発地点から全ランドマークを回り終えるまでの道のり（回れない場合はno_route）
+  std::vector<unsigned int> order;  // 訪問順（距離表の番号）
+  bool is_exact;                    // 厳密解か（falseは近似解）
+} TourResult;
+
+// 出発地点から全ランドマークを1度ずつ回る最短の順番を求める関数（出発地点へは戻らない）
+// start_distancesは出発地点から各ランドマークへの距離、distancesはランドマーク間の距離（i * n + j、対称）
+// ランドマーク数がexact_limit以下なら厳密解を、それより多ければ最近傍法と2-opt・Or-optによる近似解を求める
+// num_threadsが0の場合はハードウェアのスレッド数を使用する
+TourResult optimizeTour(const std::vector<uint32_t>& start_distances, const std::vector<uint32_t>& distances,
+                        unsigned int exact_limit, unsigned int num_threads);
+
+// 現在位置から未到達のランドマークを回る順番を求め、次に向かうランドマークと経路を表すメッセージを返す関数
+// 道のりは向きや速度の制約を考えない、道路上を縦横にたどるマス数
+std::string tourHint(const RoadGraph& graph, RouteWorkspace& workspace, const LandmarkIndex& index, const Position& pos);
+
+#endif  // TOUR_HPP
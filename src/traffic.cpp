@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include "game.hpp"
+#include "traffic.hpp"
+
+// 車を置く場所を探す試行回数の上限（車1台あたり）
+constexpr unsigned int place_attempts = 1000;
+
+// 全スレッドがそろうまで待つ待ち合わせ（C++17にはstd::barrierが無いため用意する）
+class Barrier {
+ public:
+  explicit Barrier(unsigned int count) : count_(count) {}
+
+  void wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    unsigned int generation = generation_;
+    if (++waiting_ == count_) {
+      waiting_ = 0;
+      generation_++;
+      condition_.notify_all();
+    } else {
+      condition_.wait(lock, [&] { return generation != generation_; });
+    }
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  unsigned int count_;
+  unsigned int waiting_ {0};
+  unsigned int generation_ {0};
+};
+
+// xorshift32で次の乱数を返す関数
+static uint32_t nextRandom(uint32_t& state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+// 道路上の空いているマスにnum_cars台の車を置き、シミュレーションを初期化する関数
+void initTraffic(TrafficSim& sim, size_t num_cars, uint32_t seed) {
+  initRoadShapedGrid(sim.occupied);
+  sim.cars = TrafficCars {};
+  sim.ticks = 0;
+  uint32_t state = (seed == 0) ? 1 : seed;
+  for (size_t car = 0; car < num_cars; car++) {
+    unsigned int attempt {0};
+    unsigned int x {};
+    unsigned int y {};
+    do {
+      if (++attempt > place_attempts) {
+        throw std::runtime_error("Can't place " + std::to_string(num_cars) + " cars on the road.");
+      }
+      x = nextRandom(state) % road_map.size_x;
+      y = nextRandom(state) % road_map.size_y;
+    } while (!is_road(x, y) || gridBit(sim.occupied, x, y));
+
+    // 前が道路になる向きに置く（袋小路が無いので、どの道路マスにも1つはある）
+    Position pos {x, y, static_cast<Direction>(nextRandom(state) % 4)};
+    while (!is_continue_straight_enable(pos)) {
+      pos.direction = rotateDirection(pos.direction, true);
+    }
+    setGridBit(sim.occupied, x, y, true);
+    sim.cars.x.push_back(x);
+    sim.cars.y.push_back(y);
+    sim.cars.direction.push_back(pos.direction);
+    sim.cars.speed.push_back(min_speed);
+    sim.cars.waited.push_back(0);
+    sim.cars.rng.push_back(nextRandom(state) | 1);
+  }
+
+  const unsigned int num_bands = road_map.tile_rows;
+  sim.band_begin.assign(num_bands + 1, 0);
+  sim.band_cars.assign(num_cars, 0);
+  sim.band_moves.assign(num_bands, 0);
+  sim.band_waits.assign(num_bands, 0);
+}
+
+// 車を帯ごとに並べ直す処理（帯の中は車の番号順）は、車の番号を連続した範囲に分けて各スレッドで数え、並べる
+// 番号の範囲[begin, end)の車を帯ごとに数える関数（countsは帯数分）
+static void countCarsByBand(const TrafficSim& sim, uint32_t begin, uint32_t end, uint32_t* counts) {
+  std::fill(counts, counts + road_map.tile_rows, 0);
+  for (uint32_t car = begin; car < end; car++) {
+    counts[sim.cars.y[car] / tile_size]++;
+  }
+}
+
+// 各スレッドの帯ごとの数から帯の開始位置を求め、countsをスレッドごとの書き込み位置に置き換える関数
+// 同じ帯の中は番号の小さい範囲のスレッドから順に並べるので、1スレッドで並べた時と同じ順になる
+static void placeBands(TrafficSim& sim, std::vector<uint32_t>& counts, unsigned int threads) {
+  const unsigned int num_bands = road_map.tile_rows;
+  uint32_t position {0};
+  for (unsigned int b = 0; b < num_bands; b++) {
+    sim.band_begin[b] = position;
+    for (unsigned int t = 0; t < threads; t++) {
+      const uint32_t count = counts[t * num_bands + b];
+      counts[t * num_bands + b] = position;
+      position += count;
+    }
+  }
+  sim.band_begin[num_bands] = position;
+}
+
+// 番号の範囲[begin, end)の車を、placeBandsで求めた書き込み位置（nextは帯数分）へ並べる関数
+static void scatterCarsByBand(TrafficSim& sim, uint32_t begin, uint32_t end, uint32_t* next) {
+  for (uint32_t car = begin; car < end; car++) {
+    sim.band_cars[next[sim.cars.y[car] / tile_size]++] = car;
+  }
+}
+
+// コマンドをspeedで実行した時に、道路外にも他の車のいるマスにも入らなければposを進めてtrueを返す関数
+// calcNextPositonを1マスずつ呼び、通るマスごとに空いているかを確認する
+static bool tryMove(const BitGrid& occupied, Position& pos, Command command, unsigned int speed) {
+  Position next {pos};
+  for (unsigned int i = 0; i < speed; i++) {
+    if (!calcNextPositon(next, command, 1) || gridBit(occupied, next.x, next.y)) {
+      return false;
+    }
+    command = Command::ContinueStraight;
+  }
+  pos = next;
+  return true;
+}
+
+// 1台の車を1ティック進める関数（その場で待った場合はfalseを返す）
+static bool stepCar(TrafficSim& sim, uint32_t car) {
+  TrafficCars& cars = sim.cars;
+  Position pos {cars.x[car], cars.y[car], cars.direction[car]};
+  const unsigned int speed = cars.speed[car];
+
+  // 行き先を決める（曲がれる交差点ではturn_ratio回に1回曲がり、直進できない角では曲がれる方へ曲がる）
+  const bool can_straight = is_continue_straight_enable(pos);
+  const bool can_left = is_turn_left_enable(pos);
+  const bool can_right = is_turn_right_enable(pos);
+  uint32_t random = nextRandom(cars.rng[car]);
+  Command heading {Command::ContinueStraight};
+  if ((can_left || can_right) && (!can_straight || (random % turn_ratio == 0))) {
+    bool is_left = (can_left && can_right) ? (((random >> 8) & 1) == 0) : can_left;
+    heading = is_left ? Command::TurnLeft : Command::TurnRight;
+  }
+
+  // 候補のコマンドを優先順に試す（直進は加速・そのまま・減速の順、行きたい方へ進めない場合は他の方へ進む）
+  std::array<std::pair<Command, unsigned int>, 6> candidates {};
+  size_t num_candidates {0};
+  if (heading != Command::ContinueStraight) {
+    candidates[num_candidates++] = {heading, speed};
+  }
+  if (can_straight) {
+    candidates[num_candidates++] = {Command::ContinueStraight, std::min(speed + 1, traffic_max_speed)};
+    candidates[num_candidates++] = {Command::ContinueStraight, speed};
+    candidates[num_candidates++] = {Command::ContinueStraight, std::max(speed - 1, min_speed)};
+  }
+  if (can_left && (heading != Command::TurnLeft)) {
+    candidates[num_candidates++] = {Command::TurnLeft, speed};
+  }
+  if (can_right && (heading != Command::TurnRight)) {
+    candidates[num_candidates++] = {Command::TurnRight, speed};
+  }
+  for (size_t i = 0; i < num_candidates; i++) {
+    Position next {pos};
+    if (tryMove(sim.occupied, next, candidates[i].first, candidates[i].second)) {
+      setGridBit(sim.occupied, pos.x, pos.y, false);
+      setGridBit(sim.occupied, next.x, next.y, true);
+      cars.x[car] = next.x;
+      cars.y[car] = next.y;
+      cars.direction[car] = next.direction;
+      cars.speed[car] = candidates[i].second;
+      cars.waited[car] = 0;
+      return true;
+    }
+  }
+  cars.speed[car] = min_speed;
+  if (++cars.waited[car] >= reverse_wait_ticks) {
+    cars.direction[car] = rotateDirection(rotateDirection(pos.direction, true), true);
+    cars.waited[car] = 0;
+  }
+  return false;
+}
+
+// 1つの帯の車を番号順に1ティック進める関数
+static void stepBand(TrafficSim& sim, unsigned int band) {
+  for (uint32_t k = sim.band_begin[band]; k < sim.band_begin[band + 1]; k++) {
+    if (stepCar(sim, sim.band_cars[k])) {
+      sim.band_moves[band]++;
+    } else {
+      sim.band_waits[band]++;
+    }
+  }
+}
+
+// 全車をticksティック進める関数
+void runTraffic(TrafficSim& sim, unsigned int ticks, unsigned int num_threads) {
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  const unsigned int num_bands = road_map.tile_rows;
+  const unsigned int threads = std::max(1u, std::min(num_threads, num_bands / 2));
+
+  // ティックごとに、全スレッドで車を帯ごとに並べ直し、偶数番目・奇数番目の帯を全スレッドで分けて進める
+  // 並べ直しで1スレッドだけが動くのは、帯数×スレッド数の開始位置を求める間だけ
+  // 帯の処理順はスレッド間で取り合うが、同じ回の帯どうしは互いに影響しないので結果は変わらない
+  const uint32_t num_cars = sim.cars.y.size();
+  std::vector<uint32_t> band_counts(static_cast<size_t>(threads) * num_bands);
+  std::array<std::atomic<unsigned int>, 2> next_band {};
+  Barrier barrier(threads);
+  auto worker = [&](unsigned int thread) {
+    const uint32_t begin = static_cast<uint64_t>(num_cars) * thread / threads;
+    const uint32_t end = static_cast<uint64_t>(num_cars) * (thread + 1) / threads;
+    uint32_t* counts = band_counts.data() + static_cast<size_t>(thread) * num_bands;
+    for (unsigned int tick = 0; tick < ticks; tick++) {
+      countCarsByBand(sim, begin, end, counts);
+      barrier.wait();
+      if (thread == 0) {
+        placeBands(sim, band_counts, threads);
+        next_band[0] = 0;
+        next_band[1] = 1;
+      }
+      barrier.wait();
+      scatterCarsByBand(sim, begin, end, counts);
+      barrier.wait();
+      for (unsigned int parity = 0; parity < 2; parity++) {
+        for (unsigned int band = next_band[parity].fetch_add(2); band < num_bands; band = next_band[parity].fetch_add(2)) {
+          stepBand(sim, band);
+        }
+        barrier.wait();
+      }
+    }
+  };
+  std::vector<std::thread> workers;
+  for (unsigned int t = 1; t < threads; t++) {
+    workers.emplace_back(worker, t);
+  }
+  worker(0);
+  for (std::thread& w : workers) {
+    w.join();
+  }
+  sim.ticks += ticks;
+}
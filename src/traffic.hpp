@@ -0,0 +1,53 @@
+#ifndef TRAFFIC_HPP
+#define TRAFFIC_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "map.hpp"
+#include "game.hpp"
+
+// 交差点で曲がる確率（1/turn_ratio）
+constexpr uint32_t turn_ratio = 4;
+// 続けて待ったら向きを反対にするティック数（1車線の道路で向かい合った車が動けなくなるのを防ぐ）
+constexpr unsigned int reverse_wait_ticks = 3;
+// 車の最大速度（ゲームの最大速度が大きい場合も、帯の高さの半分未満に抑える）
+constexpr unsigned int traffic_max_speed = std::min(max_speed, tile_size / 2 - 1);
+static_assert(min_speed < tile_size / 2, "min_speed must be less than half the band height for the traffic simulation.");
+
+// 交通シミュレーションの車の状態
+// 1ティックの処理は項目ごとに全車をなめるので、車ごとの構造体ではなく項目ごとの配列に持つ
+typedef struct {
+  std::vector<unsigned int> x;          // X座標
+  std::vector<unsigned int> y;          // Y座標
+  std::vector<Direction> direction;     // 向き
+  std::vector<unsigned int> speed;      // 速度
+  std::vector<unsigned int> waited;     // 続けて待ったティック数
+  std::vector<uint32_t> rng;            // 行き先を決める乱数の状態（xorshift32）
+} TrafficCars;
+
+// 交通シミュレーションの状態
+// マップをタイルの行（64行）ごとの帯に分け、1ティックを偶数番目の帯と奇数番目の帯の2回に分けて進める
+// 車は1ティックでtraffic_max_speed（帯の高さの半分未満）マスしか進まないので、同じ回に進める帯どうしは触るマスが重ならず、スレッドへ分けて同時に進められる
+typedef struct {
+  TrafficCars cars;                   // 車の状態
+  BitGrid occupied;                   // 車のいるマスのビットマップ
+  std::vector<uint32_t> band_begin;   // 帯ごとの車の並びの開始位置（帯数 + 1 個）
+  std::vector<uint32_t> band_cars;    // 帯ごとに並べた車の番号
+  std::vector<uint64_t> band_moves;   // 帯ごとの移動した車の延べ数
+  std::vector<uint64_t> band_waits;   // 帯ごとの先が詰まっていて待った車の延べ数
+  unsigned long long ticks;           // 進めたティック数
+} TrafficSim;
+
+// 道路上の空いているマスにnum_cars台の車を置き、シミュレーションを初期化する関数
+// 配置はseedだけで決まり、車を置ききれない場合はruntime_errorをthrowする
+void initTraffic(TrafficSim& sim, size_t num_cars, uint32_t seed);
+
+// 全車をticksティック進める関数
+// 各車は交差点でランダムに曲がり、直線では加速し、calcNextPositonと同じ規則で1マスずつ進む
+// 道路外に出る、または他の車のいるマスに入ることになるコマンドは選ばず、どれも選べない場合はその場で待って速度を最低速度に戻す
+// reverse_wait_ticks回続けて待った車は、その場で向きを反対にする（ゲームには無い、シミュレーションだけの規則）
+// 結果はスレッド数によらず同じになる（num_threadsが0の場合はハードウェアのスレッド数を使用する）
+void runTraffic(TrafficSim& sim, unsigned int ticks, unsigned int num_threads);
+
+#endif  // TRAFFIC_HPP
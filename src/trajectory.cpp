@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+#include "trajectory.hpp"
+
+// 使用中の地図の大きさに合わせて、num_shards個の空のシャードを用意する関数
+void initTrajectoryAnalytics(TrajectoryAnalytics& analytics, unsigned int num_shards) {
+  analytics.shift = 0;
+  while ((static_cast<size_t>((road_map.size_x - 1) >> analytics.shift) + 1) * (((road_map.size_y - 1) >> analytics.shift) + 1)
+         > trajectory_max_blocks) {
+    analytics.shift++;
+  }
+  analytics.width = ((road_map.size_x - 1) >> analytics.shift) + 1;
+  analytics.height = ((road_map.size_y - 1) >> analytics.shift) + 1;
+  const size_t num_counters = static_cast<size_t>(analytics.width) * analytics.height * trajectory_counters;
+  analytics.shards.clear();
+  analytics.shards.resize(num_shards);
+  for (TrajectoryShard& shard : analytics.shards) {
+    shard.counters.reset(new std::atomic<uint32_t>[num_counters]);
+    for (size_t i = 0; i < num_counters; i++) {
+      shard.counters[i].store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+// 全シャードを足し合わせる関数
+void mergeTrajectories(const TrajectoryAnalytics& analytics, TrajectoryHeatmap& heatmap) {
+  heatmap.shift = analytics.shift;
+  heatmap.width = analytics.width;
+  heatmap.height = analytics.height;
+  heatmap.counters.assign(static_cast<size_t>(analytics.width) * analytics.height * trajectory_counters, 0);
+  for (const TrajectoryShard& shard : analytics.shards) {
+    for (size_t i = 0; i < heatmap.counters.size(); i++) {
+      heatmap.counters[i] += shard.counters[i].load(std::memory_order_relaxed);
+    }
+  }
+}
+
+// ブロックの通過数（4方向の合計）を返す関数
+static uint64_t blockPasses(const TrajectoryHeatmap& heatmap, size_t block) {
+  const uint64_t* counters = &heatmap.counters[block * trajectory_counters];
+  return counters[TrajectoryCounter::PassNorth] + counters[TrajectoryCounter::PassSouth]
+         + counters[TrajectoryCounter::PassEast] + counters[TrajectoryCounter::PassWest];
+}
+
+// ブロックに道路のマスがあるかを返す関数（行ごとにワード単位で調べる）
+static bool is_road_block(const TrajectoryHeatmap& heatmap, unsigned int block_x, unsigned int block_y) {
+  const unsigned int x_begin = block_x << heatmap.shift;
+  const unsigned int x_end = std::min(road_map.size_x, (block_x + 1) << heatmap.shift);
+  const unsigned int y_end = std::min(road_map.size_y, (block_y + 1) << heatmap.shift);
+  for (unsigned int y = block_y << heatmap.shift; y < y_end; y++) {
+    for (unsigned int word_x = x_begin / 64; word_x * 64 < x_end; word_x++) {
+      uint64_t mask = ~uint64_t {0};
+      if (word_x == x_begin / 64) {
+        mask &= ~uint64_t {0} << (x_begin % 64);
+      }
+      if ((word_x + 1) * 64 > x_end) {
+        mask &= ~uint64_t {0} >> (64 - x_end % 64);
+      }
+      if ((gridWord(road_map, word_x, y) & mask) != 0) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// 指定した種類の数の多いブロックを、多い順に最大count個返す関数
+std::vector<TrajectoryHotspot> findTrajectoryHotspots(const TrajectoryHeatmap& heatmap, HotspotKind kind, size_t count) {
+  std::vector<TrajectoryHotspot> hotspots;
+  const size_t num_blocks = static_cast<size_t>(heatmap.width) * heatmap.height;
+  for (size_t block = 0; block < num_blocks; block++) {
+    uint64_t value {};
+    if (kind == HotspotKind::Passes) {
+      value = blockPasses(heatmap, block);
+    } else if (kind == HotspotKind::OffRoads) {
+      value = heatmap.counters[block * trajectory_counters + TrajectoryCounter::OffRoadEnd];
+    } else {
+      value = heatmap.counters[block * trajectory_counters + TrajectoryCounter::FuelOutEnd];
+    }
+    if (value != 0) {
+      hotspots.push_back(TrajectoryHotspot {static_cast<unsigned int>(block % heatmap.width) << heatmap.shift,
+                                            static_cast<unsigned int>(block / heatmap.width) << heatmap.shift, value});
+    }
+  }
+  // 数の多い順（同じ数は座標の順）に並べ、先頭のcount個だけを残す
+  auto is_hotter = [](const TrajectoryHotspot& a, const TrajectoryHotspot& b) {
+    return (a.count != b.count) ? (a.count > b.count) : ((a.y != b.y) ? (a.y < b.y) : (a.x < b.x));
+  };
+  count = std::min(count, hotspots.size());
+  std::partial_sort(hotspots.begin(), hotspots.begin() + count, hotspots.end(), is_hotter);
+  hotspots.resize(count);
+  return hotspots;
+}
+
+// 道路のあるブロックのうち、どの向きにも1度も通過されなかったブロックの数を返す関数
+size_t countUnusedRoadBlocks(const TrajectoryHeatmap& heatmap) {
+  size_t unused {0};
+  for (unsigned int block_y = 0; block_y < heatmap.height; block_y++) {
+    for (unsigned int block_x = 0; block_x < heatmap.width; block_x++) {
+      if ((blockPasses(heatmap, static_cast<size_t>(block_y) * heatmap.width + block_x) == 0) && is_road_block(heatmap, block_x, block_y)) {
+        unused++;
+      }
+    }
+  }
+  return unused;
+}
+
+// 通過数のヒートマップを画像（PGM、1ブロック1画素）で書き出す関数
+void saveTrajectoryHeatmap(const std::string& path, const TrajectoryHeatmap& heatmap) {
+  std::ofstream file(path, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("Can't write heatmap file \"" + path + "\".");
+  }
+  const size_t num_blocks = static_cast<size_t>(heatmap.width) * heatmap.height;
+  uint64_t max_passes {0};
+  for (size_t block = 0; block < num_blocks; block++) {
+    max_passes = std::max(max_passes, blockPasses(heatmap, block));
+  }
+  const double scale = (max_passes == 0) ? 0.0 : 191.0 / std::log1p(static_cast<double>(max_passes));
+
+  file << "P5\n" << heatmap.width << " " << heatmap.height << "\n255\n";
+  std::vector<char> row(heatmap.width);
+  for (unsigned int block_y = 0; block_y < heatmap.height; block_y++) {
+    for (unsigned int block_x = 0; block_x < heatmap.width; block_x++) {
+      uint64_t passes = blockPasses(heatmap, static_cast<size_t>(block_y) * heatmap.width + block_x);
+      unsigned int level {0};
+      if (passes != 0) {
+        level = 64 + static_cast<unsigned int>(std::log1p(static_cast<double>(passes)) * scale);
+      } else if (is_road_block(heatmap, block_x, block_y)) {
+        level = 40;
+      }
+      row[block_x] = static_cast<char>(std::min(level, 255u));
+    }
+    file.write(row.data(), row.size());
+  }
+  if (!file) {
+    throw std::runtime_error("Can't write heatmap file \"" + path + "\".");
+  }
+}
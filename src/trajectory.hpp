@@ -0,0 +1,105 @@
+#ifndef TRAJECTORY_HPP
+#define TRAJECTORY_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "map.hpp"
+#include "game.hpp"
+
+// 1ブロックに持つカウンタの並び（向きごとの通過数、道路外に出た数、燃料切れの数）
+typedef enum {
+  PassNorth,     // 北向きで1手を終えた数
+  PassSouth,     // 南向きで1手を終えた数
+  PassEast,      // 東向きで1手を終えた数
+  PassWest,      // 西向きで1手を終えた数
+  OffRoadEnd,    // 道路外に出た数（道路外に出る直前にいたマスで数える）
+  FuelOutEnd,    // 燃料を使い切った数
+} TrajectoryCounter;
+constexpr unsigned int trajectory_counters = 6;
+
+// シャード1つあたりのブロック数の上限
+// 地図が大きい場合はブロックを (1 << shift) マス四方に広げて、この数に収める
+// どれだけ多くのセッションを集計しても、メモリはシャード数 * trajectory_max_blocks * trajectory_counters * 4バイトを超えない
+constexpr size_t trajectory_max_blocks = size_t {1} << 20;
+// 集計の多い場所として表示する数
+constexpr size_t trajectory_hotspots = 5;
+
+// 1スレッド分の集計（シャード）
+// 書き込むのは持ち主のスレッドだけで、カウンタは読み込みと書き込みを分けたrelaxedのatomicなので、ロックもread-modify-writeの命令も使わない
+// 他のスレッドは書き込み中でもmergeTrajectoriesで読み出せる
+typedef struct {
+  std::unique_ptr<std::atomic<uint32_t>[]> counters;  // ブロックごとのカウンタ（(Y方向の番号 * 幅 + X方向の番号) * trajectory_counters + TrajectoryCounter）
+} TrajectoryShard;
+
+// 軌跡の集計（シャードの集まり）
+typedef struct {
+  unsigned int shift;                  // ブロックの一辺のマス数の2の対数
+  unsigned int width;                  // X方向のブロック数
+  unsigned int height;                 // Y方向のブロック数
+  std::vector<TrajectoryShard> shards; // スレッドごとのシャード
+} TrajectoryAnalytics;
+
+// シャードを足し合わせた集計
+typedef struct {
+  unsigned int shift;              // ブロックの一辺のマス数の2の対数
+  unsigned int width;              // X方向のブロック数
+  unsigned int height;             // Y方向のブロック数
+  std::vector<uint64_t> counters;  // ブロックごとのカウンタ（並びはシャードと同じ）
+} TrajectoryHeatmap;
+
+// 多い順に並べる集計の種類
+typedef enum {
+  Passes,    // 通過数（4方向の合計）
+  OffRoads,  // 道路外に出た数
+  FuelOuts,  // 燃料を使い切った数
+} HotspotKind;
+
+// 集計の多いブロック
+typedef struct {
+  unsigned int x;   // ブロックの左上のX座標
+  unsigned int y;   // ブロックの左上のY座標
+  uint64_t count;   // 集計した数
+} TrajectoryHotspot;
+
+// 使用中の地図の大きさに合わせて、num_shards個の空のシャードを用意する関数
+void initTrajectoryAnalytics(TrajectoryAnalytics& analytics, unsigned int num_shards);
+
+// 1手進めた後のゲーム状態と結果をシャードに数える関数（シャードの持ち主のスレッドだけが呼ぶこと）
+// 道路外に出た場合のposは、calcNextPositonが止まった道路外に出る直前のマスを指す
+inline void recordTrajectoryStep(const TrajectoryAnalytics& analytics, TrajectoryShard& shard, const GameState& state, StepOutcome outcome) {
+  unsigned int counter {};
+  if (outcome == StepOutcome::OffRoad) {
+    counter = TrajectoryCounter::OffRoadEnd;
+  } else if (outcome == StepOutcome::FuelOut) {
+    counter = TrajectoryCounter::FuelOutEnd;
+  } else if (outcome == StepOutcome::Quit) {
+    return;
+  } else {
+    counter = TrajectoryCounter::PassNorth + static_cast<unsigned int>(state.pos.direction);
+  }
+  size_t block = static_cast<size_t>(state.pos.y >> analytics.shift) * analytics.width + (state.pos.x >> analytics.shift);
+  std::atomic<uint32_t>& value = shard.counters[block * trajectory_counters + counter];
+  uint32_t current = value.load(std::memory_order_relaxed);
+  if (current != UINT32_MAX) {
+    value.store(current + 1, std::memory_order_relaxed);
+  }
+}
+
+// 全シャードを足し合わせる関数（書き込み中のシャードがあってもよく、その場合は読んだ時点までの数になる）
+void mergeTrajectories(const TrajectoryAnalytics& analytics, TrajectoryHeatmap& heatmap);
+
+// 指定した種類の数の多いブロックを、多い順に最大count個返す関数（0のブロックは含まない）
+std::vector<TrajectoryHotspot> findTrajectoryHotspots(const TrajectoryHeatmap& heatmap, HotspotKind kind, size_t count);
+
+// 道路のあるブロックのうち、どの向きにも1度も通過されなかったブロックの数を返す関数
+size_t countUnusedRoadBlocks(const TrajectoryHeatmap& heatmap);
+
+// 通過数のヒートマップを画像（PGM、1ブロック1画素）で書き出す関数
+// 道路の無いブロックは黒、1度も通過されなかった道路は暗い灰色、通過されたブロックは通過数の対数に応じて明るくする
+// 書き込めない場合はruntime_errorをthrowする
+void saveTrajectoryHeatmap(const std::string& path, const TrajectoryHeatmap& heatmap);
+
+#endif  // TRAJECTORY_HPP